@@ -11,6 +11,7 @@
    при парсинге не более 40 мл */
 #include <NeoSWSerial.h>
 #include <Kraken_GPS_Parser.h>
+#include "PhtCalib.h"
 #include <SPI.h>
 
 #include <SD.h>
@@ -21,15 +22,66 @@
 #define I2C_BUEMU 0x2
 #define I2C_BUSOS 0x3
 #define I2C_DETECTOR 86
+#define IC2_CMD_MGN_CALIB_START 11
+#define IC2_CMD_GET_MGN_CALIB   12
 #define IC2_CMD_GET_AKB      30
 #define IC2_CMD_GET_IMU_1    31
 #define IC2_CMD_GET_IMU_2    32
+#define IC2_CMD_GET_ATTITUDE 35
+#define IC2_CMD_GET_BARO     37
+#define IC2_CMD_GET_TIME     39
 #define IC2_CMD_GET_PTH      43
+#define IC2_CMD_GET_PTH_FILTER 44
+#define IC2_CMD_SET_PTH_FILTER 45
+#define IC2_CMD_GET_SUN      46
+#define IC2_CMD_GET_PTH_STATUS 47
 #define IC2_CMD_GET_PTH_COEF 70
+#define IC2_CMD_GET_PTH_LUT  71
+// Команды детектора: фиксация гистограммы, число каналов (| log2), часть гистограммы (| номер)
+#define IC2_DET_CMD_HIST_LATCH 0x01
+#define IC2_DET_CMD_HIST_BINS  0x10
+#define IC2_DET_CMD_HIST_CHUNK 0x80
+#define DET_HIST_CHUNK_BINS    16
 
 #define RX_GPS_PIN 2
 #define TX_GPS_PIN 3
 
+// Навигационный режим GPS
+#define GPS_NAV_RATE_HZ          10   // Частота выдачи решений модулем (Гц)
+#define GPS_NAV_RATE_FALLBACK    1    // Частота, если модуль не принял GPS_NAV_RATE_HZ
+#define GPS_GGA_MAX_LENGTH       82   // Максимальная длина NMEA сообщения (символов)
+#define GPS_UART_MAX_LOAD        50   // Допустимая загрузка UART сообщениями GGA (%)
+#define GPS_CONFIG_CHECK_TIME    2000 // Время проверки применения настроек (мс)
+#define GPS_RATE_TOLERANCE       20   // Допустимое отклонение периода решений (%)
+#define GPS_RATE_CHECK_FIXES     5    // Количество решений для проверки частоты
+
+// Шкала времени UTC
+#define GPS_OUTPUT_DELAY_US      20000 // Задержка начала выдачи GGA после момента решения (мкс)
+#define TIME_SYNC_ALPHA          0.25f // Коэффициент коррекции смещения
+#define TIME_SYNC_BETA           0.05f // Коэффициент коррекции ухода частоты
+#define TIME_SYNC_STEP_US        20000 // Невязка, при которой шкала перезапускается скачком (мкс)
+#define TIME_SYNC_MAX_DRIFT      0.01f // Максимальный уход частоты кварца/резонатора (с/с)
+#define TIME_SYNC_HOLDOVER_US    1000000UL // Период перепривязки без решений, защита от переполнения micros()
+#define UTC_DAY_MS               86400000UL
+
+// Оценка положения между решениями GPS (счисление пути по данным IMU)
+#define DR_MIN_SATELLITES        4     // Минимум спутников, чтобы решение GPS корректировало оценку
+#define DR_GPS_POS_SIGMA         5.0f  // СКО координат GPS (м)
+#define DR_VEL_SIGMA             0.5f  // СКО скорости после коррекции (м/с)
+#define DR_ACL_SIGMA             0.5f  // СКО ускорения после компенсации g (м/с²)
+#define DR_POS_GAIN              0.6f  // Доля невязки положения, принимаемая по решению
+#define DR_VEL_GAIN              0.3f  // Доля невязки, переходящая в скорость (за период решений)
+#define DR_STATIC_G_TOL          1.5f  // Допуск ||a| - g|, при котором ориентация берётся по акселерометру (м/с²)
+#define DR_MAX_COAST_TIME        30000 // Время без GPS, после которого оценка недействительна (мс)
+#define DR_GRAVITY               9.80665f
+#define DR_METERS_PER_DEG_LAT    111320.0f
+
+// Геозоны
+#define GEOFENCE_MAX_FENCES      6     // Зон всего (из таблицы и загруженных по радио)
+#define GEOFENCE_MAX_VERTICES    16    // Вершин всех многоугольников вместе
+#define GEOFENCE_NONE            0xFF  // Нет подходящей зоны
+#define GEOFENCE_SCALE           1e7f  // Координаты зон - целые в 1e-7 градуса
+
 #define SERIAL_SEP ';'
 
 #include <RF24.h>
@@ -40,28 +92,34 @@
 #define NRF_RETRIES_DELAY  0
 #define NRF_RETRIES_COUNT  3
 #define NRF_AUTO_ACK       1
-#define NRF_RX_PACKET_SIZE 20
+#define NRF_RX_PACKET_SIZE 32
 #define NRF_TX_PACKET_SIZE 32
 
 // Мнимально допустимый интревал
 #define MIN_INTERVAL_VALUE     10
 // Временные интервалы (мс)
 #define detectorUpdateInterval 1000
-#define gpsUpdateInterval      1000
-#define imuUpdateInterval      1000
-#define phtUpdateInterval      1000
+#define detectorHistInterval   10000 // Чтение, запись и отправка спектра детектора
+#define imuUpdateInterval      100
+#define phtUpdateInterval      100  // Опрос состояния фоторезисторов на BUSOS
+#define phtHeartbeatInterval   5000 // Наибольший интервал без отправки фоторезисторов
 #define akbUpdateInterval      1000
 #define gpsSendInterval        1000
 #define detectorSendInterval   1000
 #define imuSendInterval        1000
-#define phtSendInterval        1000
+#define phtSendInterval        200  // Отправка только новых значений фоторезисторов
 #define sdWriteInterval        1000
+#define drUpdateInterval       100
+#define timeSyncSendInterval   1000
+#define attitudeSendInterval   1000
 
 // Флаги
 #define FLG_BUSOS_UPDATE_IMU   0x01
 #define FLG_CALIB_RNG_READED   0x02
 #define SD_CARD_INITIALIZATRED 0x04
 #define GPS_READY              0x08
+#define GPS_RATE_CONFIRMED     0x10
+#define FLG_PHT_UPDATED        0x20 // Значения фоторезисторов ещё не отправлены
 uint8_t FLAGS = FLG_BUSOS_UPDATE_IMU;
 
 NeoSWSerial gpsSerial(RX_GPS_PIN, TX_GPS_PIN);
@@ -86,11 +144,169 @@ float gpsLatitude = 0,  gpsLongitude = 0, gpsAltitude = 0, gpsTime = 0;
 float mainVoltage = 0, batteryVoltage = 0, solarVoltage = 0;
 // Остальное
 float press = 0, temp = 0;
+// Барометр после фильтрации на BUSOS: давление (Па), высота (м), вертикальная скорость (м/с)
+float pressFiltered = 0, baroAltitude = 0, verticalSpeed = 0;
 uint32_t detectionCount = 0;
 uint32_t lastTimeDetectorSynch = 0;
+// Последняя зафиксированная гистограмма амплитуд: число каналов, номер фиксации, число импульсов, время набора (мс)
+struct DetectorHist {
+    uint16_t bins;
+    uint16_t seq;
+    uint32_t pulses;
+    uint32_t time;
+} detHist;
+// Чтение зафиксированной гистограммы: следующая часть, число частей (0 - чтение не идёт)
+// и куда части пишутся: карта, радио
+struct DetectorHistRead {
+    uint8_t chunk;
+    uint8_t chunks;
+    bool sd;
+    bool radio;
+} detHistRead;
 uint16_t phtValues[8];
 Range phtCalibRange[8];
+PhtCalib phtCalib; // Диапазоны в целых числах и таблица линеаризации с БУСОС
+// Направление на Солнце по фоторезисторам (единичный вектор в осях спутника) и уверенность 0..1
+Vector sunVector;
+float sunConfidence = 0;
 Vector gyro, acl, mgn;
+// Отсчёт BUSOS: номер и момент в часах БК (micros)
+struct SampleStamp {
+    uint16_t seq;
+    uint32_t micros;
+};
+SampleStamp imuStamp = {}, baroStamp = {};
+// Последние записанные на карту и переданные отсчёты, повторно не пишутся и не передаются
+uint16_t imuLoggedSeq = 0, baroLoggedSeq = 0, imuSentSeq = 0;
+// micros() БК минус micros() BUSOS
+uint32_t busosClockOffset = 0;
+// Чтений IMU, в которых части 1 и 2 оказались от разных отсчётов
+uint16_t imuTornReads = 0;
+// Ориентация с BUSOS: кватернион (W X Y Z) и углы Эйлера (°): x - крен, y - тангаж, z - рыскание
+float quaternion[4] = {1, 0, 0, 0};
+Vector rotateAngle;
+
+// Событие нового решения GPS, выставляется в прерывании парсера
+volatile bool     gpsFixEvent = false;
+// Значение micros() в конце пакета с новым решением
+volatile uint32_t gpsFixMicros = 0;
+// Время решения из пакета (ЧЧММСС, дробная часть и её цифры) и длина пакета в символах
+volatile uint32_t gpsFixTimeM = 0, gpsFixTimeL = 0;
+volatile uint8_t  gpsFixTimeD = 0;
+volatile uint8_t  gpsFixLength = 0;
+uint8_t gpsSentenceLength = 0;
+// Текущая скорость UART модуля GPS
+uint16_t gpsBaud = 9600;
+// Время последнего решения, по которому было выставлено событие
+float gpsEventTime = 0;
+// Текущая частота решений (Гц)
+uint8_t gpsNavRate = GPS_NAV_RATE_FALLBACK;
+// Проверка частоты не закончена в setup() (холодный старт), доводится в loop()
+bool gpsRateCheckPending = false;
+
+// Статистика прихода решений GPS (мкс)
+struct GpsRateStats {
+    uint32_t fixCount = 0;
+    uint32_t firstFixMicros = 0;
+    uint32_t lastFixMicros = 0;
+    uint32_t lastInterval = 0;
+    uint32_t minInterval = 0xFFFFFFFF;
+    uint32_t maxInterval = 0;
+    // Максимальное отклонение периода от номинального с последней записи на карту
+    uint32_t jitterMax = 0;
+    // Максимальное отклонение периода от номинального за всё время
+    uint32_t jitterMaxTotal = 0;
+    uint32_t jitterSum = 0;
+};
+GpsRateStats gpsStats;
+
+/* Шкала времени UTC, привязанная к micros().
+   Опорная точка (localUs, utcUs) и относительный уход часов МК (drift)
+   уточняются альфа-бета фильтром по каждому решению GPS */
+struct TimeSync {
+    bool     locked = false;
+    uint32_t localUs = 0;       // micros() опорной точки
+    int64_t  utcUs = 0;         // UTC опорной точки, мкс от полуночи
+    float    drift = 0;         // Уход часов МК (с/с)
+    uint32_t lastMeasLocalUs = 0;
+    int32_t  lastResidualUs = 0;
+    uint16_t steps = 0;         // Количество перезапусков скачком
+    uint32_t updates = 0;
+};
+TimeSync timeSync;
+
+/* Счисление пути между решениями GPS.
+   Положение и скорость - в местной системе Север-Восток-Низ относительно
+   точки привязки (последней скорректированной оценки) */
+struct DeadReckoning {
+    bool     valid = false;
+    float    originLat = 0, originLon = 0, originAlt = 0;
+    float    metersPerDegLon = DR_METERS_PER_DEG_LAT;
+    Vector   pos, vel;
+    // Оси Север, Восток, Низ в связанной системе (строки матрицы поворота)
+    Vector   north, east, down;
+    bool     attitudeValid = false;
+    uint32_t lastFixMillis = 0;
+    uint32_t lastUpdateMillis = 0;
+};
+DeadReckoning dr;
+// Оценка положения с частотой drUpdateInterval и её погрешность (м)
+float drLatitude = 0, drLongitude = 0, drAltitude = 0, drSigma = 0;
+
+// Результат проверки частоты решений GPS
+enum GpsRateCheck : uint8_t {
+    GPS_RATE_OK,         // Средний период совпал с номинальным
+    GPS_RATE_UNVERIFIED, // Решений меньше двух - модуль ещё не выдаёт решения, проверка отложена
+    GPS_RATE_WRONG       // Решения приходят с другой частотой
+};
+
+/* Геозоны.
+   Зона задаётся в таблице GEOFENCE_TABLE или загружается по радио.
+   Для каждой зоны заранее вычисляется описанный прямоугольник в целых 1e-7 градуса,
+   по нему отбрасывается большинство точек, точная проверка - только внутри него.
+   Зоны проверяются в порядке номеров, подходит первая */
+enum GeofenceType : uint8_t {
+    FENCE_CIRCLE,   // a, b - широта и долгота центра, c - радиус (м)
+    FENCE_BOX,      // a, b - минимальные широта и долгота, c, d - максимальные
+    FENCE_POLYGON,  // a - номер первой вершины в GEOFENCE_VERTICES, b - количество вершин
+    FENCE_ALTITUDE, // Только диапазон высот
+    FENCE_DISABLED = 0xFE, // Зона не задана (слот загрузки по радио), пропускается
+    FENCE_END = 0xFF
+};
+struct GeofenceDef {
+    uint8_t type;
+    uint8_t intervalDiv; // Во сколько раз чаще отправлять телеметрию в зоне
+    int32_t a, b, c, d;
+    int32_t altMin, altMax; // Диапазон высот (м)
+};
+// Зоны, известные до полёта. Пример:
+// {FENCE_CIRCLE,  2, 447000000, 397000000, 5000, 0, 0, 30000},
+// {FENCE_POLYGON, 1, 0, 4, 0, 0, 0, 30000},
+// {FENCE_ALTITUDE, 1, 0, 0, 0, 0, 1000, 30000},
+constexpr GeofenceDef GEOFENCE_TABLE[] = {
+    {FENCE_END, 1, 0, 0, 0, 0, 0, 0}
+};
+// Вершины многоугольников (широта, долгота в 1e-7 градуса)
+constexpr int32_t GEOFENCE_VERTICES[][2] = {
+    {0, 0}
+};
+// Подготовленная зона
+struct Geofence {
+    uint8_t type;
+    uint8_t intervalDiv;
+    int32_t latMin, latMax, lonMin, lonMax;
+    int32_t altMin, altMax;
+    uint8_t firstVertex, vertexCount;
+};
+Geofence geofences[GEOFENCE_MAX_FENCES];
+int32_t  geofenceVertices[GEOFENCE_MAX_VERTICES][2];
+// Вершины, загружаемые по радио: активные зоны читают geofenceVertices до применения
+int32_t  geofenceVerticesUpload[GEOFENCE_MAX_VERTICES][2];
+// Зоны, загружаемые по радио; слоты, которые не задавались, - FENCE_DISABLED
+GeofenceDef geofenceUpload[GEOFENCE_MAX_FENCES];
+uint8_t  geofenceCount = 0;
+// Номер зоны, в которой находится спутник, GEOFENCE_NONE - ни в одной
+uint8_t  geofenceMatch = GEOFENCE_NONE;
 
 // Обновление данных
 void updateAkbData() {
@@ -116,37 +332,151 @@ void updatePhtData() {
     for (uint8_t i = 0; i < 16; ++i) { data[i] = Wire.read(); }
 
     memcpy(phtValues, data, 16);
+
+    Wire.beginTransmission(I2C_BUSOS);
+    Wire.write(IC2_CMD_GET_SUN);
+    Wire.endTransmission(false);
+
+    Wire.requestFrom(I2C_BUSOS, 16);
+    for (uint8_t i = 0; i < 16; ++i) { data[i] = Wire.read(); }
+
+    memcpy(&sunVector.x, data, 4);
+    memcpy(&sunVector.y, data+4, 4);
+    memcpy(&sunVector.z, data+8, 4);
+    memcpy(&sunConfidence, data+12, 4);
+}
+// Изменились ли фоторезисторы на BUSOS дальше порога с прошлого опроса
+bool isPhtChanged() {
+    Wire.beginTransmission(I2C_BUSOS);
+    Wire.write(IC2_CMD_GET_PTH_STATUS);
+    Wire.endTransmission(false);
+
+    Wire.requestFrom(I2C_BUSOS, 5);
+    uint8_t data[5];
+    for (uint8_t i = 0; i < 5; ++i) { data[i] = Wire.read(); }
+    return data[0];
+}
+/* Привязка часов BUSOS: BUSOS отвечает своим micros() в начале чтения,
+   точность - длительность транзакции (меньше 1 мс) */
+void syncBusosClock() {
+    Wire.beginTransmission(I2C_BUSOS);
+    Wire.write(IC2_CMD_GET_TIME);
+    Wire.endTransmission(false);
+
+    uint32_t start = micros();
+    Wire.requestFrom(I2C_BUSOS, 4);
+    uint32_t end = micros();
+    uint8_t data[4];
+    for (uint8_t i = 0; i < 4; ++i) { data[i] = Wire.read(); }
+
+    uint32_t busosMicros;
+    memcpy(&busosMicros, data, 4);
+    busosClockOffset = start + (end - start) / 2 - busosMicros;
+}
+// Возраст отсчёта (мс) в момент вызова
+uint32_t sampleAge(const SampleStamp &stamp) {
+    return (micros() - stamp.micros) / 1000;
 }
 void updateIMUData() {
-    uint8_t data[24];
+    uint8_t data[30];
+    uint16_t seq, seq2;
+    float newPress, newTemp;
+    Vector newGyro, newAcl, newMgn;
+    uint32_t sampleMicros;
+    // Части читаются двумя транзакциями, между ними BUSOS может обновить данные:
+    // тогда чтение повторяется один раз
+    for (uint8_t attempt = 0; attempt < 2; ++attempt) {
+        Wire.beginTransmission(I2C_BUSOS);
+        Wire.write(IC2_CMD_GET_IMU_1);
+        Wire.endTransmission(false);
+
+        Wire.requestFrom(I2C_BUSOS, 30);
+        for (uint8_t i = 0; i < 30; ++i) { data[i] = Wire.read(); }
+
+        memcpy(&newPress,  data+0, 4);
+        memcpy(&newTemp,   data+4, 4);
+        memcpy(&newGyro.x, data+8, 4);
+        memcpy(&newGyro.y, data+12, 4);
+        memcpy(&newGyro.z, data+16, 4);
+        memcpy(&newAcl.x,  data+20, 4);
+        memcpy(&seq,       data+24, 2);
+        memcpy(&sampleMicros, data+26, 4);
+
+        /* Буфер библиотеки Wire не может вместить все 44 байта данных,
+           поэтому пакет был разделён на две части */
+        Wire.beginTransmission(I2C_BUSOS);
+        Wire.write(IC2_CMD_GET_IMU_2);
+        Wire.endTransmission(false);
+
+        Wire.requestFrom(I2C_BUSOS, 22);
+        for (uint8_t i = 0; i < 22; ++i) { data[i] = Wire.read(); }
+
+        memcpy(&newAcl.y, data+0, 4);
+        memcpy(&newAcl.z, data+4, 4);
+        memcpy(&newMgn.x, data+8, 4);
+        memcpy(&newMgn.y, data+12, 4);
+        memcpy(&newMgn.z, data+16, 4);
+        memcpy(&seq2,     data+20, 2);
+        if (seq2 == seq) { break; }
+        ++imuTornReads;
+    }
+    // Части так и остались от разных отсчётов: остаётся прошлый отсчёт, номер
+    // не меняется, и sdWriteData/sendImuData не примут его за новый
+    if (seq2 != seq) { return; }
+
+    press = newPress; temp = newTemp;
+    gyro = newGyro; acl = newAcl; mgn = newMgn;
+    imuStamp.seq = seq;
+    imuStamp.micros = sampleMicros + busosClockOffset;
+}
+void updateBaroData() {
+    uint8_t data[26];
     Wire.beginTransmission(I2C_BUSOS);
-    Wire.write(IC2_CMD_GET_IMU_1);
+    Wire.write(IC2_CMD_GET_BARO);
     Wire.endTransmission(false);
-    
-    Wire.requestFrom(I2C_BUSOS, 24);
-    for (uint8_t i = 0; i < 24; ++i) { data[i] = Wire.read(); }
-    
-    memcpy(&press,  data+0, 4);
-    memcpy(&temp,   data+4, 4);
-    memcpy(&gyro.x, data+8, 4);
-    memcpy(&gyro.y, data+12, 4);
-    memcpy(&gyro.z, data+16, 4);
-    memcpy(&acl.x,  data+20, 4);
-    
-    /* Буфер библиотеки Wire не может вместить все 44 байта данных, 
-       поэтому пакет был разделён на две части */
+
+    Wire.requestFrom(I2C_BUSOS, 26);
+    for (uint8_t i = 0; i < 26; ++i) { data[i] = Wire.read(); }
+
+    // Сырые давление и температура приходят и в IMU часть 1
+    memcpy(&pressFiltered, data+8, 4);
+    memcpy(&baroAltitude,  data+12, 4);
+    memcpy(&verticalSpeed, data+16, 4);
+    uint32_t sampleMicros;
+    memcpy(&baroStamp.seq, data+20, 2);
+    memcpy(&sampleMicros,  data+22, 4);
+    baroStamp.micros = sampleMicros + busosClockOffset;
+}
+void updateAttitudeData() {
+    uint8_t data[28];
     Wire.beginTransmission(I2C_BUSOS);
-    Wire.write(IC2_CMD_GET_IMU_2);
+    Wire.write(IC2_CMD_GET_ATTITUDE);
     Wire.endTransmission(false);
-    
-    Wire.requestFrom(I2C_BUSOS, 20);
-    for (uint8_t i = 0; i < 20; ++i) { data[i] = Wire.read(); }
-    
-    memcpy(&acl.y, data+0, 4);
-    memcpy(&acl.z, data+4, 4);
-    memcpy(&mgn.x, data+8, 4);
-    memcpy(&mgn.y, data+12, 4);
-    memcpy(&mgn.z, data+16, 4);
+
+    Wire.requestFrom(I2C_BUSOS, 28);
+    for (uint8_t i = 0; i < 28; ++i) { data[i] = Wire.read(); }
+
+    memcpy(quaternion, data, 16);
+    memcpy(&rotateAngle.x, data+16, 4);
+    memcpy(&rotateAngle.y, data+20, 4);
+    memcpy(&rotateAngle.z, data+24, 4);
+}
+// Запуск калибровки магнитометра на БУСОС, спутник нужно вращать до её завершения
+void startMgnCalibration() {
+    Wire.beginTransmission(I2C_BUSOS);
+    Wire.write(IC2_CMD_MGN_CALIB_START);
+    Wire.endTransmission();
+}
+/* Настройка обработки фоторезисторов на БУСОС: передискретизация 4^oversampling,
+   фильтр (0 - нет, 1 - скользящее среднее по 2^shift, 2 - IIR с весом 2^-shift).
+   Недопустимые значения БУСОС не применяет */
+void setPhtFilter(uint8_t oversampling, uint8_t mode, uint8_t shift) {
+    Wire.beginTransmission(I2C_BUSOS);
+    Wire.write(IC2_CMD_SET_PTH_FILTER);
+    Wire.write(oversampling);
+    Wire.write(mode);
+    Wire.write(shift);
+    Wire.endTransmission();
 }
 void updateDetectorData() {
     Wire.requestFrom(I2C_DETECTOR, 4);
@@ -156,6 +486,83 @@ void updateDetectorData() {
     memcpy(&detectionCount, data, 4);
     lastTimeDetectorSynch = millis();
 }
+/* Спектр детектора: фиксация гистограммы амплитуд на детекторе, затем чтение
+   по одной части за проход основного цикла (readDetectorHistChunk), чтобы
+   чтение всех частей не задерживало остальной опрос. Часть сразу дописывается
+   в строку hist.csv и передаётся двумя пакетами 0x48, целиком гистограмма
+   в RAM БК не хранится */
+void latchDetectorHist() {
+    Wire.beginTransmission(I2C_DETECTOR);
+    Wire.write(IC2_DET_CMD_HIST_LATCH);
+    Wire.endTransmission(false);
+
+    Wire.requestFrom(I2C_DETECTOR, 12);
+    uint8_t data[12];
+    for (uint8_t i = 0; i < 12; ++i) { data[i] = Wire.read(); }
+    memcpy(&detHist, data, 12);
+    if (detHist.bins < DET_HIST_CHUNK_BINS || detHist.bins > 1024) { return; }
+
+    detHistRead.chunk = 0;
+    detHistRead.chunks = detHist.bins / DET_HIST_CHUNK_BINS;
+    detHistRead.sd = FLAGS&SD_CARD_INITIALIZATRED;
+    detHistRead.radio = isTargetPosition();
+    if (detHistRead.sd) {
+        // Время записи, номер фиксации, число каналов, импульсы, время набора (мс), каналы
+        logfile = SD.open("hist.csv", FILE_WRITE);
+        logfile.print(millis()); logfile.print('|');
+        logfile.print(detHist.seq); logfile.print('|');
+        logfile.print(detHist.bins); logfile.print('|');
+        logfile.print(detHist.pulses); logfile.print('|');
+        logfile.print(detHist.time);
+        logfile.close();
+    }
+}
+// Следующая часть зафиксированной гистограммы, после последней - конец строки hist.csv
+void readDetectorHistChunk() {
+    uint8_t data[DET_HIST_CHUNK_BINS * 2];
+    uint8_t chunk = detHistRead.chunk;
+    Wire.beginTransmission(I2C_DETECTOR);
+    Wire.write(IC2_DET_CMD_HIST_CHUNK | chunk);
+    Wire.endTransmission(false);
+
+    Wire.requestFrom(I2C_DETECTOR, DET_HIST_CHUNK_BINS * 2);
+    for (uint8_t i = 0; i < DET_HIST_CHUNK_BINS * 2; ++i) { data[i] = Wire.read(); }
+
+    bool last = ++detHistRead.chunk >= detHistRead.chunks;
+    if (detHistRead.sd) {
+        logfile = SD.open("hist.csv", FILE_WRITE);
+        for (uint8_t j = 0; j < DET_HIST_CHUNK_BINS; ++j) {
+            uint16_t value;
+            memcpy(&value, data + 2*j, 2);
+            logfile.print('|'); logfile.print(value);
+        }
+        if (last) { logfile.print('\n'); }
+        logfile.close();
+    }
+    if (detHistRead.radio) {
+        sendDetectorHist(chunk * DET_HIST_CHUNK_BINS, data);
+        sendDetectorHist(chunk * DET_HIST_CHUNK_BINS + DET_HIST_CHUNK_BINS/2, data + DET_HIST_CHUNK_BINS);
+    }
+    if (last) { detHistRead.chunks = 0; }
+}
+// Прервать чтение гистограммы: строка hist.csv закрывается неполной
+void abortDetectorHist() {
+    if (!detHistRead.chunks) { return; }
+    if (detHistRead.sd) {
+        logfile = SD.open("hist.csv", FILE_WRITE);
+        logfile.print('\n');
+        logfile.close();
+    }
+    detHistRead.chunks = 0;
+}
+// Число каналов гистограммы детектора: 2^binsLog2, 6..10; гистограмма очищается
+void setDetectorHistBins(uint8_t binsLog2) {
+    // Гистограмма на детекторе очищается, оставшиеся части уже не от неё
+    abortDetectorHist();
+    Wire.beginTransmission(I2C_DETECTOR);
+    Wire.write(IC2_DET_CMD_HIST_BINS | binsLog2);
+    Wire.endTransmission();
+}
 void updateGPSData() {
     // Координаты
     gpsLatitude = Kraken::getLat();
@@ -167,63 +574,613 @@ void updateGPSData() {
     gpsTime = Kraken::getTime();
 }
 
+// Каждый символ от GPS попадает сюда из прерывания NeoSWSerial
+void onGpsChar(uint8_t s) {
+    Kraken::parseNMEA(s);
+    if (s == '$') { gpsSentenceLength = 0; }
+    ++gpsSentenceLength;
+    // Парсер обновляет данные только по '\r' с верной контрольной суммой,
+    // новое время решения означает новое решение
+    if (s == '\r' && Kraken::gpsTime != gpsEventTime) {
+        gpsEventTime = Kraken::gpsTime;
+        gpsFixMicros = micros();
+        gpsFixTimeM = Kraken::gpsTime_m;
+        gpsFixTimeL = Kraken::gpsTime_l;
+        gpsFixTimeD = Kraken::gpsTime_d;
+        gpsFixLength = gpsSentenceLength;
+        gpsFixEvent = true;
+    }
+}
+// Учёт периода прихода решений
+void gpsRecordFix(uint32_t fixMicros) {
+    if (gpsStats.fixCount) {
+        uint32_t interval = fixMicros - gpsStats.lastFixMicros;
+        uint32_t nominal = 1000000UL / gpsNavRate;
+        uint32_t jitter = interval > nominal ? interval - nominal : nominal - interval;
+
+        gpsStats.lastInterval = interval;
+        if (interval < gpsStats.minInterval) { gpsStats.minInterval = interval; }
+        if (interval > gpsStats.maxInterval) { gpsStats.maxInterval = interval; }
+        if (jitter > gpsStats.jitterMax) { gpsStats.jitterMax = jitter; }
+        if (jitter > gpsStats.jitterMaxTotal) { gpsStats.jitterMaxTotal = jitter; }
+        gpsStats.jitterSum += jitter;
+    }
+    else { gpsStats.firstFixMicros = fixMicros; }
+    gpsStats.lastFixMicros = fixMicros;
+    ++gpsStats.fixCount;
+
+    // Частота подтверждается по среднему периоду первых решений
+    if (!(FLAGS&GPS_RATE_CONFIRMED) && gpsStats.fixCount >= GPS_RATE_CHECK_FIXES
+        && isGpsPeriodValid(gpsMeanPeriod())) {
+        FLAGS |= GPS_RATE_CONFIRMED;
+    }
+}
+// Средний период решений с момента настройки (мкс)
+uint32_t gpsMeanPeriod() {
+    if (gpsStats.fixCount < 2) { return 0; }
+    return (gpsStats.lastFixMicros - gpsStats.firstFixMicros) / (gpsStats.fixCount - 1);
+}
+// Обработка события нового решения
+void handleGpsFix() {
+    noInterrupts();
+    uint32_t fixMicros = gpsFixMicros;
+    uint32_t timeM = gpsFixTimeM, timeL = gpsFixTimeL;
+    uint8_t timeD = gpsFixTimeD;
+    uint8_t length = gpsFixLength;
+    gpsFixEvent = false;
+    interrupts();
+
+    updateGPSData();
+    gpsRecordFix(fixMicros);
+    if (Kraken::gpsReady) { FLAGS |= GPS_READY; }
+    if (Kraken::gpsReady && stlCount >= DR_MIN_SATELLITES) {
+        drCorrect(gpsLatitude, gpsLongitude, gpsAltitude);
+        geofenceUpdate(drLatitude, drLongitude, drAltitude);
+    }
+
+    // Момент решения: конец пакета минус время его передачи и задержка выдачи
+    uint32_t epochUs = fixMicros - (uint32_t)length * 10 * 1000000UL / gpsBaud - GPS_OUTPUT_DELAY_US;
+    timeSyncUpdate(gpsTimeToUtcMs(timeM, timeL, timeD), epochUs);
+}
+
+// Шкала времени UTC
+// ЧЧММСС и дробная часть из GGA (digits цифр) -> мс от полуночи UTC
+uint32_t gpsTimeToUtcMs(uint32_t hhmmss, uint32_t frac, uint8_t digits) {
+    uint32_t seconds = (hhmmss / 10000) * 3600UL + (hhmmss / 100 % 100) * 60 + hhmmss % 100;
+    for (uint8_t i = digits; i < 3; ++i) { frac *= 10; }
+    for (uint8_t i = 3; i < digits; ++i) { frac /= 10; }
+    return seconds * 1000 + frac;
+}
+// Приведение времени к диапазону [0, сутки)
+int64_t normUtcDayUs(int64_t us) {
+    const int64_t dayUs = (int64_t)UTC_DAY_MS * 1000;
+    while (us >= dayUs) { us -= dayUs; }
+    while (us < 0) { us += dayUs; }
+    return us;
+}
+// Приведение разности времени к диапазону ±12 часов (переход через полночь)
+int64_t wrapUtcDayUs(int64_t us) {
+    const int64_t dayUs = (int64_t)UTC_DAY_MS * 1000;
+    while (us >= dayUs / 2) { us -= dayUs; }
+    while (us < -dayUs / 2) { us += dayUs; }
+    return us;
+}
+// UTC (мкс от полуночи) для значения micros()
+int64_t timeSyncPredict(uint32_t localUs) {
+    int32_t elapsed = localUs - timeSync.localUs;
+    return normUtcDayUs(timeSync.utcUs + elapsed + (int32_t)(elapsed * timeSync.drift));
+}
+// Новое измерение: utcMs - время решения по GPS, localUs - micros() в момент решения
+void timeSyncUpdate(uint32_t utcMs, uint32_t localUs) {
+    int64_t measured = (int64_t)utcMs * 1000;
+    ++timeSync.updates;
+
+    if (!timeSync.locked) {
+        timeSync.locked = true;
+        timeSync.localUs = timeSync.lastMeasLocalUs = localUs;
+        timeSync.utcUs = measured;
+        return;
+    }
+
+    int64_t predicted = timeSyncPredict(localUs);
+    int32_t residual = wrapUtcDayUs(measured - predicted);
+    int32_t elapsed = localUs - timeSync.lastMeasLocalUs;
+    timeSync.lastResidualUs = residual;
+    timeSync.lastMeasLocalUs = localUs;
+    timeSync.localUs = localUs;
+
+    if (residual > TIME_SYNC_STEP_US || residual < -TIME_SYNC_STEP_US || elapsed <= 0) {
+        // Потеря привязки (сбой GPS или первое решение после настройки) - перезапуск скачком
+        timeSync.utcUs = measured;
+        ++timeSync.steps;
+        return;
+    }
+    timeSync.utcUs = normUtcDayUs(predicted + (int32_t)(residual * TIME_SYNC_ALPHA));
+    timeSync.drift = constrain(timeSync.drift + TIME_SYNC_BETA * residual / elapsed,
+                               -TIME_SYNC_MAX_DRIFT, TIME_SYNC_MAX_DRIFT);
+}
+// Перепривязка без решений GPS, чтобы разность micros() не переполнялась
+void timeSyncTick() {
+    uint32_t now = micros();
+    if (timeSync.locked && now - timeSync.localUs > TIME_SYNC_HOLDOVER_US) {
+        timeSync.utcUs = timeSyncPredict(now);
+        timeSync.localUs = now;
+    }
+}
+bool isTimeSynced() { return timeSync.locked; }
+// Текущее время UTC, мс от полуночи
+uint32_t nowUtc() {
+    return timeSyncPredict(micros()) / 1000;
+}
+// Время UTC (мс от полуночи) для ранее сохранённого значения millis()
+uint32_t millisToUtc(uint32_t ms) {
+    int32_t delta = ms - millis();
+    int32_t utc = nowUtc() + delta + (int32_t)(delta * timeSync.drift);
+    if (utc < 0) { utc += UTC_DAY_MS; }
+    return (uint32_t)utc % UTC_DAY_MS;
+}
+
+// Счисление пути
+float dot(const Vector &a, const Vector &b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+Vector cross(const Vector &a, const Vector &b) {
+    Vector c;
+    c.x = a.y*b.z - a.z*b.y;
+    c.y = a.z*b.x - a.x*b.z;
+    c.z = a.x*b.y - a.y*b.x;
+    return c;
+}
+bool normalize(Vector &v) {
+    float norm = sqrt(dot(v, v));
+    if (norm < 1e-6f) { return false; }
+    v.x /= norm; v.y /= norm; v.z /= norm;
+    return true;
+}
+/* Ориентация по векторам ускорения и магнитного поля (TRIAD).
+   Обновляется только когда аппарат не ускоряется, иначе остаётся прежней */
+void drUpdateAttitude() {
+    float aclNorm = sqrt(dot(acl, acl));
+    if (fabs(aclNorm - DR_GRAVITY) > DR_STATIC_G_TOL) { return; }
+
+    Vector down, east, north;
+    down.x = -acl.x; down.y = -acl.y; down.z = -acl.z;
+    if (!normalize(down)) { return; }
+    east = cross(down, mgn);
+    if (!normalize(east)) { return; }
+    north = cross(east, down);
+
+    dr.down = down; dr.east = east; dr.north = north;
+    dr.attitudeValid = true;
+}
+// Пересчёт оценки в широту, долготу и высоту
+void drPublish(uint32_t now) {
+    drLatitude = dr.originLat + dr.pos.x / DR_METERS_PER_DEG_LAT;
+    drLongitude = dr.originLon + dr.pos.y / dr.metersPerDegLon;
+    drAltitude = dr.originAlt - dr.pos.z;
+    // Погрешность растёт с момента последнего решения
+    float t = (now - dr.lastFixMillis) / 1000.0f;
+    drSigma = DR_GPS_POS_SIGMA + DR_VEL_SIGMA*t + 0.5f*DR_ACL_SIGMA*t*t;
+}
+// Перенос точки привязки в текущую оценку, чтобы смещения в float оставались малыми
+void drSetOrigin(float lat, float lon, float alt) {
+    dr.originLat = lat;
+    dr.originLon = lon;
+    dr.originAlt = alt;
+    dr.metersPerDegLon = DR_METERS_PER_DEG_LAT * cos(lat * DEG_TO_RAD);
+    if (dr.metersPerDegLon < 1) { dr.metersPerDegLon = 1; }
+    dr.pos = Vector();
+}
+// Прогноз по данным IMU, вызывается с периодом drUpdateInterval
+void drPropagate() {
+    uint32_t now = millis();
+    float dt = (now - dr.lastUpdateMillis) / 1000.0f;
+    dr.lastUpdateMillis = now;
+    if (!dr.valid) { return; }
+    if (now - dr.lastFixMillis > DR_MAX_COAST_TIME) { dr.valid = false; return; }
+
+    drUpdateAttitude();
+    if (dr.attitudeValid) {
+        // Ускорение в местной системе, акселерометр измеряет a - g
+        Vector a;
+        a.x = dot(dr.north, acl);
+        a.y = dot(dr.east, acl);
+        a.z = dot(dr.down, acl) + DR_GRAVITY;
+
+        dr.vel.x += a.x*dt; dr.vel.y += a.y*dt; dr.vel.z += a.z*dt;
+    }
+    dr.pos.x += dr.vel.x*dt; dr.pos.y += dr.vel.y*dt; dr.pos.z += dr.vel.z*dt;
+    drPublish(now);
+}
+// Коррекция по решению GPS
+void drCorrect(float lat, float lon, float alt) {
+    uint32_t now = millis();
+    if (!dr.valid) {
+        dr.valid = true;
+        dr.vel = Vector();
+        dr.lastFixMillis = dr.lastUpdateMillis = now;
+        drSetOrigin(lat, lon, alt);
+        drPublish(now);
+        return;
+    }
+
+    // Невязка между решением и оценкой (м)
+    Vector innov;
+    innov.x = (lat - dr.originLat) * DR_METERS_PER_DEG_LAT - dr.pos.x;
+    innov.y = (lon - dr.originLon) * dr.metersPerDegLon - dr.pos.y;
+    innov.z = (dr.originAlt - alt) - dr.pos.z;
+
+    float dtFix = (now - dr.lastFixMillis) / 1000.0f;
+    if (dtFix < 0.05f) { dtFix = 0.05f; }
+    dr.lastFixMillis = now;
+
+    dr.pos.x += DR_POS_GAIN*innov.x; dr.pos.y += DR_POS_GAIN*innov.y; dr.pos.z += DR_POS_GAIN*innov.z;
+    dr.vel.x += DR_VEL_GAIN*innov.x/dtFix; dr.vel.y += DR_VEL_GAIN*innov.y/dtFix; dr.vel.z += DR_VEL_GAIN*innov.z/dtFix;
+
+    drPublish(now);
+    drSetOrigin(drLatitude, drLongitude, drAltitude);
+}
+
+// Поле лога, fresh = false - пустое поле
+void sdWriteField(float value, bool fresh) {
+  if (fresh) { logfile.print(value); }
+  logfile.print('|');
+}
 // Запись данных на карту
 void sdWriteData() {
   logfile = SD.open("log.csv", FILE_WRITE);
   /* Опорное напряжение
      Балансировачное напряжение
      Напряжение панелей
+     Номер отсчёта барометра на BUSOS
+     Возраст отсчёта барометра (мс)
      Давление
      Температура
+     Давление после фильтра
+     Высота по барометру
+     Вертикальная скорость по барометру
+     Номер отсчёта IMU на BUSOS
+     Возраст отсчёта IMU (мс)
      Гироском по 3-ём осям
      Акселерометр по 3-ём осям
      Магнитометр по 3-ём осям
+     (значения барометра и IMU, уже записанные раньше, не повторяются - поля пустые)
+     Кватернион ориентации (W X Y Z)
+     Углы Эйлера (крен, тангаж, рыскание)
      Высота по GPS
      Широта по GPS
      Долгота по GPS
      Время по GPS
+     Оценка широты между решениями GPS
+     Оценка долготы между решениями GPS
+     Оценка высоты между решениями GPS
+     Погрешность оценки положения (м), -1 - оценки нет
+     Номер текущей геозоны, 255 - вне зон
      Количество видимых спутников 
+     Последний период решений GPS (мкс)
+     Максимальное отклонение периода решений GPS с прошлой записи (мкс)
      Количество детектированных частиц
      Время последнего измерения радиации
-     Время со старта МК */
+     Время последнего измерения радиации, UTC (мс от полуночи, 0 - нет привязки)
+     Время со старта МК
+     Время записи, UTC (мс от полуночи, 0 - нет привязки) */
   logfile.print(mainVoltage); logfile.print('|');
   logfile.print(batteryVoltage); logfile.print('|');
   logfile.print(solarVoltage); logfile.print('|');
-  logfile.print(press); logfile.print('|');
-  logfile.print(temp); logfile.print('|');
-  logfile.print(gyro.x); logfile.print('|');
-  logfile.print(gyro.y); logfile.print('|');
-  logfile.print(gyro.z); logfile.print('|');
-  logfile.print(acl.x); logfile.print('|');
-  logfile.print(acl.y); logfile.print('|');
-  logfile.print(acl.z); logfile.print('|');
-  logfile.print(mgn.x); logfile.print('|');
-  logfile.print(mgn.y); logfile.print('|');
-  logfile.print(mgn.z); logfile.print('|');
+  bool baroFresh = baroStamp.seq != baroLoggedSeq;
+  logfile.print(baroStamp.seq); logfile.print('|');
+  logfile.print(sampleAge(baroStamp)); logfile.print('|');
+  sdWriteField(press, baroFresh);
+  sdWriteField(temp, baroFresh);
+  sdWriteField(pressFiltered, baroFresh);
+  sdWriteField(baroAltitude, baroFresh);
+  sdWriteField(verticalSpeed, baroFresh);
+  baroLoggedSeq = baroStamp.seq;
+  bool imuFresh = imuStamp.seq != imuLoggedSeq;
+  logfile.print(imuStamp.seq); logfile.print('|');
+  logfile.print(sampleAge(imuStamp)); logfile.print('|');
+  sdWriteField(gyro.x, imuFresh);
+  sdWriteField(gyro.y, imuFresh);
+  sdWriteField(gyro.z, imuFresh);
+  sdWriteField(acl.x, imuFresh);
+  sdWriteField(acl.y, imuFresh);
+  sdWriteField(acl.z, imuFresh);
+  sdWriteField(mgn.x, imuFresh);
+  sdWriteField(mgn.y, imuFresh);
+  sdWriteField(mgn.z, imuFresh);
+  imuLoggedSeq = imuStamp.seq;
+  for (uint8_t i = 0; i < 4; ++i) { logfile.print(quaternion[i], 4); logfile.print('|'); }
+  logfile.print(rotateAngle.x); logfile.print('|');
+  logfile.print(rotateAngle.y); logfile.print('|');
+  logfile.print(rotateAngle.z); logfile.print('|');
   logfile.print(gpsAltitude); logfile.print('|');
   logfile.print(gpsLatitude); logfile.print('|');
   logfile.print(gpsLongitude); logfile.print('|');
   logfile.print(gpsTime); logfile.print('|');
+  logfile.print(drLatitude, 6); logfile.print('|');
+  logfile.print(drLongitude, 6); logfile.print('|');
+  logfile.print(drAltitude); logfile.print('|');
+  logfile.print(dr.valid ? drSigma : -1); logfile.print('|');
+  logfile.print(geofenceMatch); logfile.print('|');
   logfile.print(stlCount); logfile.print('|');
+  logfile.print(gpsStats.lastInterval); logfile.print('|');
+  logfile.print(gpsStats.jitterMax); logfile.print('|');
   logfile.print(detectionCount); logfile.print('|');
   logfile.print(lastTimeDetectorSynch); logfile.print('|');
-  logfile.print(millis()); logfile.print('\n');
+  logfile.print(isTimeSynced() ? millisToUtc(lastTimeDetectorSynch) : 0); logfile.print('|');
+  logfile.print(millis()); logfile.print('|');
+  logfile.print(isTimeSynced() ? nowUtc() : 0); logfile.print('\n');
   
   logfile.close();
+  gpsStats.jitterMax = 0;
+}
+
+// Геозоны
+// Подготовка зоны: описанный прямоугольник вычисляется один раз
+bool geofenceCompile(const GeofenceDef &def, Geofence &fence) {
+    fence.type = def.type;
+    fence.intervalDiv = def.intervalDiv ? def.intervalDiv : 1;
+    fence.altMin = def.altMin;
+    fence.altMax = def.altMax;
+    switch (def.type) {
+    case FENCE_CIRCLE: {
+        int32_t dLat = def.c / DR_METERS_PER_DEG_LAT * GEOFENCE_SCALE;
+        float cosLat = cos(def.a / GEOFENCE_SCALE * DEG_TO_RAD);
+        if (cosLat < 0.01f) { return false; }
+        int32_t dLon = dLat / cosLat;
+        fence.latMin = def.a - dLat; fence.latMax = def.a + dLat;
+        // Рядом с ±180° сумма не помещается в int32_t
+        fence.lonMin = constrain((int64_t)def.b - dLon, (int64_t)INT32_MIN, (int64_t)INT32_MAX);
+        fence.lonMax = constrain((int64_t)def.b + dLon, (int64_t)INT32_MIN, (int64_t)INT32_MAX);
+        return true; }
+    case FENCE_BOX:
+        fence.latMin = def.a; fence.lonMin = def.b;
+        fence.latMax = def.c; fence.lonMax = def.d;
+        return def.a <= def.c && def.b <= def.d;
+    case FENCE_POLYGON:
+        if (def.b < 3 || def.a < 0 || def.a + def.b > GEOFENCE_MAX_VERTICES) { return false; }
+        fence.firstVertex = def.a;
+        fence.vertexCount = def.b;
+        fence.latMin = fence.lonMin = INT32_MAX;
+        fence.latMax = fence.lonMax = INT32_MIN;
+        for (uint8_t i = fence.firstVertex; i < fence.firstVertex + fence.vertexCount; ++i) {
+            fence.latMin = min(fence.latMin, geofenceVertices[i][0]);
+            fence.latMax = max(fence.latMax, geofenceVertices[i][0]);
+            fence.lonMin = min(fence.lonMin, geofenceVertices[i][1]);
+            fence.lonMax = max(fence.lonMax, geofenceVertices[i][1]);
+        }
+        return true;
+    case FENCE_ALTITUDE:
+        fence.latMin = fence.lonMin = INT32_MIN;
+        fence.latMax = fence.lonMax = INT32_MAX;
+        return true;
+    case FENCE_DISABLED:
+        return false;
+    }
+    return false;
+}
+// Все слоты загрузки по радио - не заданы
+void geofenceClearUpload() {
+    for (uint8_t i = 0; i < GEOFENCE_MAX_FENCES; ++i) { geofenceUpload[i].type = FENCE_DISABLED; }
+}
+// Загрузка зон из таблицы GEOFENCE_TABLE
+void setupGeofences() {
+    for (uint8_t i = 0; i < sizeof(GEOFENCE_VERTICES)/sizeof(GEOFENCE_VERTICES[0]) && i < GEOFENCE_MAX_VERTICES; ++i) {
+        geofenceVertices[i][0] = GEOFENCE_VERTICES[i][0];
+        geofenceVertices[i][1] = GEOFENCE_VERTICES[i][1];
+    }
+    memcpy(geofenceVerticesUpload, geofenceVertices, sizeof(geofenceVertices));
+    geofenceClearUpload();
+    geofenceCount = 0;
+    for (uint8_t i = 0; GEOFENCE_TABLE[i].type != FENCE_END && geofenceCount < GEOFENCE_MAX_FENCES; ++i) {
+        if (geofenceCompile(GEOFENCE_TABLE[i], geofences[geofenceCount])) { ++geofenceCount; }
+    }
+}
+// Разность координат: долготы у ±180° отличаются больше, чем на INT32_MAX
+float geofenceDelta(int32_t a, int32_t b) {
+    return (int64_t)a - b;
+}
+// Точная проверка попадания в зону, точка уже внутри описанного прямоугольника
+bool geofenceContains(const Geofence &fence, int32_t lat, int32_t lon) {
+    switch (fence.type) {
+    case FENCE_CIRCLE: {
+        // Центр и радиус восстанавливаются из прямоугольника
+        float rLat = (fence.latMax - fence.latMin) / 2.0f;
+        float rLon = geofenceDelta(fence.lonMax, fence.lonMin) / 2.0f;
+        float dLat = (lat - fence.latMin) - rLat;
+        float dLon = (geofenceDelta(lon, fence.lonMin) - rLon) * (rLat / rLon);
+        return dLat*dLat + dLon*dLon <= rLat*rLat; }
+    case FENCE_POLYGON: {
+        // Чётность пересечений луча, координаты - относительно точки
+        bool inside = false;
+        uint8_t last = fence.firstVertex + fence.vertexCount - 1;
+        for (uint8_t i = fence.firstVertex, j = last; i <= last; j = i++) {
+            float yi = geofenceVertices[i][0] - lat, xi = geofenceDelta(geofenceVertices[i][1], lon);
+            float yj = geofenceVertices[j][0] - lat, xj = geofenceDelta(geofenceVertices[j][1], lon);
+            if ((yi > 0) != (yj > 0) && 0 < xj + (xi - xj) * yj / (yj - yi)) { inside = !inside; }
+        }
+        return inside; }
+    default:
+        return true;
+    }
+}
+// Поиск зоны для текущей оценки положения, результат - в geofenceMatch
+void geofenceUpdate(float latitude, float longitude, float altitude) {
+    int32_t lat = latitude * GEOFENCE_SCALE;
+    int32_t lon = longitude * GEOFENCE_SCALE;
+    int32_t alt = altitude;
+
+    geofenceMatch = GEOFENCE_NONE;
+    for (uint8_t i = 0; i < geofenceCount; ++i) {
+        const Geofence &fence = geofences[i];
+        if (alt < fence.altMin || alt > fence.altMax ||
+            lat < fence.latMin || lat > fence.latMax ||
+            lon < fence.lonMin || lon > fence.lonMax) { continue; }
+        if (geofenceContains(fence, lat, lon)) { geofenceMatch = i; return; }
+    }
+}
+// Делитель интервалов отправки телеметрии для текущей зоны
+uint8_t telemetryDivider() {
+    return geofenceMatch == GEOFENCE_NONE ? 1 : geofences[geofenceMatch].intervalDiv;
+}
+/* Загрузка зон по радио (пакет 71, 32 байта).
+   data[1]: младшие 4 бита - операция, старшие - номер зоны
+   data[30..31] - контрольная сумма, пакет с неверной суммой отбрасывается
+   0 - удалить все зоны и загруженные слоты
+   1 - геометрия: data[2] - тип, data[3] - делитель интервалов, data[4..19] - a, b, c, d
+   2 - диапазон высот: data[2..5] - altMin, data[6..9] - altMax
+   3 - вершины: data[2] - номер первой, data[3] - количество (до 2), data[4..19] - пары широта, долгота
+   4 - применить: вершины и зоны с номера 0 до указанного включительно становятся активными,
+       слоты без операции 1 пропускаются.
+   До применения загруженные данные хранятся отдельно и не меняют активные зоны */
+void nrf24GeofenceRequest(const uint8_t *data) {
+    uint16_t cCRC = calcCRC16(reinterpret_cast<const uint16_t*>(data), 15);
+    uint16_t rCRC = (data[31]<<8) | data[30];
+    if (cCRC != rCRC) { return; }
+
+    uint8_t op = data[1] & 0x0F;
+    uint8_t index = data[1] >> 4;
+    if (index >= GEOFENCE_MAX_FENCES) { return; }
+
+    switch (op) {
+    case 0:
+        geofenceCount = 0;
+        geofenceMatch = GEOFENCE_NONE;
+        geofenceClearUpload();
+        break;
+    case 1:
+        geofenceUpload[index].type = data[2];
+        geofenceUpload[index].intervalDiv = data[3];
+        memcpy(&geofenceUpload[index].a, data+4, 16);
+        // По умолчанию высота не ограничена
+        geofenceUpload[index].altMin = INT32_MIN;
+        geofenceUpload[index].altMax = INT32_MAX;
+        break;
+    case 2:
+        memcpy(&geofenceUpload[index].altMin, data+2, 4);
+        memcpy(&geofenceUpload[index].altMax, data+6, 4);
+        break;
+    case 3:
+        for (uint8_t i = 0; i < data[3] && i < 2 && data[2] + i < GEOFENCE_MAX_VERTICES; ++i) {
+            memcpy(geofenceVerticesUpload[data[2] + i], data+4+i*8, 8);
+        }
+        break;
+    case 4:
+        memcpy(geofenceVertices, geofenceVerticesUpload, sizeof(geofenceVertices));
+        geofenceCount = 0;
+        geofenceMatch = GEOFENCE_NONE;
+        for (uint8_t i = 0; i <= index; ++i) {
+            if (geofenceCompile(geofenceUpload[i], geofences[geofenceCount])) { ++geofenceCount; }
+        }
+        break;
+    }
 }
 
 // Проверка позиции
 bool isTargetPosition() {
     if (FLAGS&GPS_READY) {
-        /*  Писать в этом блоке
-         *  gpsLatitude  -  Широта
-         *  gpsLongitude -  Долгота
-         *  gpsAltitude  -  Высота   */
-        return true;
+        // Без зон телеметрия отправляется везде
+        return !geofenceCount || geofenceMatch != GEOFENCE_NONE;
     }
     return true;
 }
 
+// Отправка команды модулю GPS, контрольная сумма вычисляется здесь
+void gpsSendCommand(const char *body) {
+    uint8_t crc = 0;
+    for (const char *c = body; *c; ++c) { crc ^= *c; }
+
+    const char hex[] = "0123456789ABCDEF";
+    gpsSerial.write('$');
+    gpsSerial.write(body);
+    gpsSerial.write('*');
+    gpsSerial.write(hex[crc >> 4]);
+    gpsSerial.write(hex[crc & 0x0F]);
+    gpsSerial.write("\r\n");
+}
+// Минимальная скорость UART, при которой GGA с частотой rate занимает не более GPS_UART_MAX_LOAD
+uint16_t gpsSelectBaud(uint8_t rate) {
+    // 10 бит на символ: старт, 8 бит данных, стоп
+    uint32_t required = (uint32_t)GPS_GGA_MAX_LENGTH * 10 * rate * 100 / GPS_UART_MAX_LOAD;
+    if (required <= 9600) { return 9600; }
+    if (required <= 19200) { return 19200; }
+    return 38400;
+}
+// Попадает ли период решений в допуск для текущей частоты
+bool isGpsPeriodValid(uint32_t period) {
+    uint32_t nominal = 1000000UL / gpsNavRate;
+    uint32_t tolerance = nominal / 100 * GPS_RATE_TOLERANCE;
+    return nominal - tolerance <= period && period <= nominal + tolerance;
+}
+/* Настройка частоты решений и скорости UART модуля GPS.
+   Модуль может работать на любой из скоростей (после перезапуска BC без снятия
+   питания с GPS он остаётся на прошлой), поэтому команды отправляются на каждой */
+void gpsSetNavRate(uint8_t rate) {
+    const uint16_t bauds[] = {9600, 19200, 38400};
+    uint16_t baud = gpsSelectBaud(rate);
+    char command[16];
+
+    gpsSerial.detachInterrupt();
+    for (uint8_t i = 0; i < 3; ++i) {
+        gpsSerial.begin(bauds[i]);
+        // Отключаем все заголовки, кроме GGA
+        gpsSendCommand("PCAS03,1,0,0,0,0,0,0,0,0,0,0,0,0,0");
+        // Период выдачи решений (мс)
+        sprintf(command, "PCAS02,%u", 1000 / rate);
+        gpsSendCommand(command);
+        // Скорость UART: 1 - 9600, 2 - 19200, 3 - 38400
+        sprintf(command, "PCAS01,%u", baud == 9600 ? 1 : (baud == 19200 ? 2 : 3));
+        gpsSendCommand(command);
+        gpsSerial.end();
+    }
+    delay(100);
+
+    gpsNavRate = rate;
+    gpsBaud = baud;
+    gpsEventTime = Kraken::gpsTime;
+    gpsFixEvent = false;
+    gpsStats = GpsRateStats();
+    FLAGS &= ~GPS_RATE_CONFIRMED;
+
+    // Каждый полученный символ будет доставлен в парсер
+    gpsSerial.attachInterrupt(onGpsChar);
+    gpsSerial.begin(baud);
+}
+/* Проверка, что модуль принял частоту: ждём решения и сравниваем
+   средний период с номинальным */
+GpsRateCheck gpsVerifyNavRate() {
+    uint32_t timeMark = millis() + GPS_CONFIG_CHECK_TIME;
+    while (millis() < timeMark && !(FLAGS&GPS_RATE_CONFIRMED)) {
+        if (gpsFixEvent) { handleGpsFix(); }
+    }
+    // Меньше двух решений - период не измерить, частота не подтверждена
+    if (gpsStats.fixCount < 2) { return GPS_RATE_UNVERIFIED; }
+    return isGpsPeriodValid(gpsMeanPeriod()) ? GPS_RATE_OK : GPS_RATE_WRONG;
+}
+void setupGps() {
+    // Две попытки, затем переход на резервную частоту.
+    // Без решений (холодный старт) частота остаётся, проверку заканчивает gpsFinishRateCheck
+    for (uint8_t attempt = 0; attempt < 2; ++attempt) {
+        gpsSetNavRate(GPS_NAV_RATE_HZ);
+        GpsRateCheck check = gpsVerifyNavRate();
+        if (check == GPS_RATE_OK) { return; }
+        if (check == GPS_RATE_UNVERIFIED) {
+            gpsRateCheckPending = true;
+            Serial.print(F("GPS rate not verified yet, pending\n"));
+            return;
+        }
+    }
+    Serial.print(F("GPS rate not accepted, fallback\n"));
+    gpsSetNavRate(GPS_NAV_RATE_FALLBACK);
+}
+/* Отложенная проверка частоты: после GPS_RATE_CHECK_FIXES решений частота
+   либо подтверждена в gpsRecordFix, либо модуль её не принял - переход на резервную */
+void gpsFinishRateCheck() {
+    if (!gpsRateCheckPending || gpsStats.fixCount < GPS_RATE_CHECK_FIXES) { return; }
+    gpsRateCheckPending = false;
+    if (FLAGS&GPS_RATE_CONFIRMED) { return; }
+    Serial.print(F("GPS rate not accepted, fallback\n"));
+    gpsSetNavRate(GPS_NAV_RATE_FALLBACK);
+}
+
 // Настройка модуля радиосвязи
 void setupNrf() {
   if (!nrf24.begin()) {
@@ -262,7 +1219,19 @@ void readPhtCalibRange() {
         memcpy(&phtCalibRange[i].min, data, 4);
         for (uint8_t q = 0; q < 4; ++q) { data[q] = Wire.read(); }
         memcpy(&phtCalibRange[i].max, data, 4);
+        PhtCalib_compileChannel(phtCalib.channel[i], phtCalibRange[i].min, phtCalibRange[i].max);
     }
+
+    // Таблица линеаризации: признак и узлы
+    Wire.beginTransmission(I2C_BUSOS);
+    Wire.write(IC2_CMD_GET_PTH_LUT);
+    Wire.endTransmission(false);
+
+    Wire.requestFrom(I2C_BUSOS, 1 + sizeof(phtCalib.lut));
+    phtCalib.useLut = Wire.read() == 1;
+    uint8_t lut[sizeof(phtCalib.lut)];
+    for (uint8_t i = 0; i < sizeof(lut); ++i) { lut[i] = Wire.read(); }
+    memcpy(phtCalib.lut, lut, sizeof(lut));
 }
 
 // Сжатие данных, для более быстрой передачи
@@ -273,10 +1242,10 @@ uint32_t floatToUint32(float value, int32_t minValue, int32_t maxValue, int32_t
     else { return 0; }
 }
 // Вычисление контрольной суммы
-uint16_t calcCRC16(uint16_t *data, uint8_t count) {
+uint16_t calcCRC16(const uint16_t *data, uint8_t count) {
     uint16_t CRC = 0;
     for (uint8_t i = 0; i < count; ++i) {
-        CRC = CRC + *data*44111;  //все данные 16-битные
+        CRC = CRC + data[i]*44111;  //все данные 16-битные
         CRC = CRC ^ (CRC >> 8);
     }
     return CRC;
@@ -308,7 +1277,35 @@ bool sendDetectorData() {
 
     return nrf24SendData(data);
 }
+// 8 каналов гистограммы детектора, начиная с first
+bool sendDetectorHist(uint16_t first, const uint8_t *bins) {
+    uint8_t data[32];
+
+  // Заголовок
+    data[0] = 0x48;
+    data[1] = 0xFF;
+    data[2] = 0xFF;
+
+  // Номер фиксации, число каналов, первый канал, 8 каналов, время набора (0.1 с),
+  // в первой части - число импульсов (3 байта, ограничено 0xFFFFFF)
+    memcpy(data+3, &detHist.seq, 2);
+    memcpy(data+5, &detHist.bins, 2);
+    memcpy(data+7, &first, 2);
+    memcpy(data+9, bins, 16);
+    uint16_t time = detHist.time < 6553500UL ? detHist.time / 100 : 65535;
+    memcpy(data+25, &time, 2);
+    uint32_t pulses = first == 0 && detHist.pulses < 0xFFFFFFUL ? detHist.pulses : 0xFFFFFFUL;
+    memcpy(data+27, &pulses, 3);
+
+  // Контрольная сумма
+    uint16_t CRC = calcCRC16(reinterpret_cast<uint16_t*>(data), 15);
+    memcpy(data+30, &CRC, 2);
+
+    return nrf24SendData(data);
+}
 bool sendImuData() {
+    // Этот отсчёт уже передан
+    if (imuStamp.seq == imuSentSeq) { return false; }
     uint8_t data[32];
     uint32_t value;
 
@@ -345,13 +1342,15 @@ bool sendImuData() {
     value = floatToUint32(mgn.z, -16000, 16000, 65535);
     memcpy(data+3+21, &value, 2);
 
-    value = millis();
+    // Момент отсчёта на BUSOS в часах БК
+    value = millis() - sampleAge(imuStamp);
     memcpy(data+3+23, &value, 4);
 
   // Контрольная сумма
     uint16_t CRC = calcCRC16(reinterpret_cast<uint16_t*>(data), 15);
     memcpy(data+30, &CRC, 2);
 
+    imuSentSeq = imuStamp.seq;
     return nrf24SendData(data);
 }
 bool sendGpsData() {
@@ -364,6 +1363,8 @@ bool sendGpsData() {
     data[2] = 0xFF;
   // Неиспользуемые байты
     data[25] = 0xFF;
+  // Номер текущей геозоны
+    data[15] = geofenceMatch;
 
   // Копирование данных
     memcpy(data+3+0, &gpsLatitude, 4);
@@ -435,6 +1436,17 @@ bool sendCalibCoef() {
     data[25] = 0xFF;
     data[26] = 0xFF;
   
+  // Контрольная сумма
+    CRC = calcCRC16(reinterpret_cast<uint16_t*>(data), 15);
+    memcpy(data+30, &CRC, 2);
+    nrf24SendData(data);
+
+  // Таблица линеаризации: признак и узлы, приёмник считает так же, как БУСОС
+    data[2] = 0x04;
+    data[3] = phtCalib.useLut;
+    memcpy(data+4, phtCalib.lut, sizeof(phtCalib.lut));
+    memset(data+4+sizeof(phtCalib.lut), 0xFF, 27 - 4 - sizeof(phtCalib.lut));
+
   // Контрольная сумма
     CRC = calcCRC16(reinterpret_cast<uint16_t*>(data), 15);
     memcpy(data+30, &CRC, 2);
@@ -448,11 +1460,17 @@ bool sendPhtData() {
     data[0] = 0x2B;
     data[1] = 0xFF;
     data[2] = 0xFF;
-  // Неиспользуемые байты
-    for (uint8_t i = 19; i < 26; ++i) { data[i] = 0xFF; }
 
   // Данные
     memcpy(data+3, phtValues, 16);
+  // Направление на Солнце в 1/16384, уверенность в 1/255
+    int16_t sun[3] = {
+        static_cast<int16_t>(sunVector.x * 16384),
+        static_cast<int16_t>(sunVector.y * 16384),
+        static_cast<int16_t>(sunVector.z * 16384)
+    };
+    memcpy(data+19, sun, 6);
+    data[25] = static_cast<uint8_t>(sunConfidence * 255 + 0.5f);
 
   // Время
     uint32_t value = millis();
@@ -464,6 +1482,61 @@ bool sendPhtData() {
 
     return nrf24SendData(data);
 }
+/* Привязка millis() BC к UTC, по ней на земле все метки времени millis()
+   из остальных пакетов переводятся в UTC */
+bool sendTimeSyncData() {
+    uint8_t data[32];
+    uint32_t value;
+
+  // Заголовок
+    data[0] = 0x54;
+    data[1] = 0xFF;
+    data[2] = 0xFF;
+  // Неиспользуемые байты
+    for (uint8_t i = 20; i < 30; ++i) { data[i] = 0xFF; }
+
+  // Данные: millis(), соответствующее ему время UTC, уход часов, последняя невязка
+    value = millis();
+    uint32_t utc = nowUtc();
+    memcpy(data+3, &value, 4);
+    memcpy(data+7, &utc, 4);
+    memcpy(data+11, &timeSync.drift, 4);
+    memcpy(data+15, &timeSync.lastResidualUs, 4);
+    data[19] = timeSync.locked;
+
+  // Контрольная сумма
+    uint16_t CRC = calcCRC16(reinterpret_cast<uint16_t*>(data), 15);
+    memcpy(data+30, &CRC, 2);
+
+    return nrf24SendData(data);
+}
+bool sendAttitudeData() {
+    uint8_t data[32];
+    uint32_t value;
+
+  // Заголовок
+    data[0] = 0x23;
+    data[1] = 0xFF;
+    data[2] = 0xFF;
+  // Неиспользуемые байты
+    data[25] = 0xFF;
+
+  // Кватернион без сжатия, углы Эйлера - в сотых долях градуса
+    memcpy(data+3, quaternion, 16);
+    int16_t angle[3] = {static_cast<int16_t>(rotateAngle.x * 100),
+                        static_cast<int16_t>(rotateAngle.y * 100),
+                        static_cast<int16_t>(rotateAngle.z * 100)};
+    memcpy(data+3+16, angle, 6);
+
+    value = millis();
+    memcpy(data+26, &value, 4);
+
+  // Контрольная сумма
+    uint16_t CRC = calcCRC16(reinterpret_cast<uint16_t*>(data), 15);
+    memcpy(data+30, &CRC, 2);
+
+    return nrf24SendData(data);
+}
 // Отправка готовых данных
 bool nrf24SendData(uint8_t *data) {
     nrf24.setPayloadSize(NRF_TX_PACKET_SIZE);
@@ -479,10 +1552,19 @@ bool nrf24SendData(uint8_t *data) {
 // Запрос по Serial
 /* Список команд
 K10 - Начать калибровку фоторезисторов
+K11 - Начать калибровку магнитометра на БУСОС
+K12 - Вывести состояние калибровки магнитометра
 K30 - Вывести данные с СЕП
 K31 - Вывести данные с IMU
+K35 - Вывести ориентацию (кватернион и углы Эйлера)
 K36 - Вывести координаты
+K37 - Вывести статистику частоты решений GPS
+K39 - Вывести состояние шкалы времени UTC
+K40 - Вывести активные геозоны и текущую зону
 K42 - Вывести значения фоторезисторов
+K44 - Вывести отфильтрованные значения фоторезисторов с БУСОС
+K45 - Настроить обработку фоторезисторов на БУСОС (передискретизация, фильтр, сдвиг)
+K46 - Настроить гистограмму амплитуд детектора (число каналов: 64, 128, 256, 512, 1024) и вывести последнюю фиксацию
 K70 - Вывести калибровачные значение для фоторезисторов
 */
 void serialRequest() {
@@ -496,11 +1578,20 @@ void serialRequest() {
       Serial.print('\n');
 
       switch (request) {
+        case 11: serialRequest_11(); break;
+        case 12: serialRequest_12(); break;
         case 30: serialRequest_30(); break;
         case 31: serialRequest_31(); break;
+        case 35: serialRequest_35(); break;
         case 36: serialRequest_36(); break;
+        case 37: serialRequest_37(); break;
+        case 39: serialRequest_39(); break;
+        case 40: serialRequest_40(); break;
         case 42: serialRequest_42(); break;
         case 43: serialRequest_43(); break;
+        case 44: serialRequest_44(); break;
+        case 45: serialRequest_45(); break;
+        case 46: serialRequest_46(); break;
         case 70: serialRequest_70(); break;
         default: serialRequestIndefined(request);
       }
@@ -568,6 +1659,13 @@ void serialRequest_31() {
     Serial.print(gyro.z);
     Serial.print(SERIAL_SEP);
     Serial.print(millis());
+    // Номер и возраст (мс) отсчёта IMU, чтений с разорванными частями
+    Serial.print(SERIAL_SEP);
+    Serial.print(imuStamp.seq);
+    Serial.print(SERIAL_SEP);
+    Serial.print(sampleAge(imuStamp));
+    Serial.print(SERIAL_SEP);
+    Serial.print(imuTornReads);
     Serial.print('\n');
 }
 void serialRequest_36() {
@@ -615,18 +1713,121 @@ void serialRequest_36() {
     Serial.print(SERIAL_SEP);
     Serial.println(millis());
 }
+void serialRequest_11() {
+    startMgnCalibration();
+}
+void serialRequest_12() {
+    // Состояние (0 - не запускалась, 1 - идёт, 2 - завершена, 3 - ошибка), октанты,
+    // отсчёты, невязка, радиус и смещение (Гаусс)
+    uint8_t data[24];
+    Wire.beginTransmission(I2C_BUSOS);
+    Wire.write(IC2_CMD_GET_MGN_CALIB);
+    Wire.endTransmission(false);
+
+    Wire.requestFrom(I2C_BUSOS, 24);
+    for (uint8_t i = 0; i < 24; ++i) { data[i] = Wire.read(); }
+
+    uint16_t samples;
+    float values[5];
+    memcpy(&samples, data+2, 2);
+    memcpy(values, data+4, 20);
+    Serial.print(data[0]);
+    Serial.print(SERIAL_SEP);
+    Serial.print(data[1]);
+    Serial.print(SERIAL_SEP);
+    Serial.print(samples);
+    for (uint8_t i = 0; i < 5; ++i) {
+        Serial.print(SERIAL_SEP);
+        Serial.print(values[i], 4);
+    }
+    Serial.print('\n');
+}
+void serialRequest_35() {
+    for (uint8_t i = 0; i < 4; ++i) {
+        Serial.print(quaternion[i], 4);
+        Serial.print(SERIAL_SEP);
+    }
+    Serial.print(rotateAngle.x);
+    Serial.print(SERIAL_SEP);
+    Serial.print(rotateAngle.y);
+    Serial.print(SERIAL_SEP);
+    Serial.println(rotateAngle.z);
+}
+void serialRequest_37() {
+    // Частота (Гц), подтверждена ли, количество решений, средний,
+    // последний, минимальный и максимальный период, макс. и среднее отклонение (мкс)
+    Serial.print(gpsNavRate);
+    Serial.print(SERIAL_SEP);
+    Serial.print((FLAGS&GPS_RATE_CONFIRMED) ? 1 : 0);
+    Serial.print(SERIAL_SEP);
+    Serial.print(gpsStats.fixCount);
+    Serial.print(SERIAL_SEP);
+    Serial.print(gpsMeanPeriod());
+    Serial.print(SERIAL_SEP);
+    Serial.print(gpsStats.lastInterval);
+    Serial.print(SERIAL_SEP);
+    Serial.print(gpsStats.minInterval);
+    Serial.print(SERIAL_SEP);
+    Serial.print(gpsStats.maxInterval);
+    Serial.print(SERIAL_SEP);
+    Serial.print(gpsStats.jitterMaxTotal);
+    Serial.print(SERIAL_SEP);
+    Serial.println(gpsStats.fixCount > 1 ? gpsStats.jitterSum / (gpsStats.fixCount - 1) : 0);
+}
+void serialRequest_39() {
+    // Привязана ли шкала, UTC (мс от полуночи), уход часов (ppm),
+    // последняя невязка (мкс), количество измерений и перезапусков
+    Serial.print(timeSync.locked);
+    Serial.print(SERIAL_SEP);
+    Serial.print(nowUtc());
+    Serial.print(SERIAL_SEP);
+    Serial.print(timeSync.drift * 1e6);
+    Serial.print(SERIAL_SEP);
+    Serial.print(timeSync.lastResidualUs);
+    Serial.print(SERIAL_SEP);
+    Serial.print(timeSync.updates);
+    Serial.print(SERIAL_SEP);
+    Serial.println(timeSync.steps);
+}
+void serialRequest_40() {
+    // Текущая зона (255 - вне зон), затем по строке на зону:
+    // тип, делитель интервалов, описанный прямоугольник, диапазон высот
+    Serial.println(geofenceMatch);
+    for (uint8_t i = 0; i < geofenceCount; ++i) {
+        const Geofence &fence = geofences[i];
+        Serial.print(fence.type);
+        Serial.print(SERIAL_SEP);
+        Serial.print(fence.intervalDiv);
+        Serial.print(SERIAL_SEP);
+        Serial.print(fence.latMin);
+        Serial.print(SERIAL_SEP);
+        Serial.print(fence.latMax);
+        Serial.print(SERIAL_SEP);
+        Serial.print(fence.lonMin);
+        Serial.print(SERIAL_SEP);
+        Serial.print(fence.lonMax);
+        Serial.print(SERIAL_SEP);
+        Serial.print(fence.altMin);
+        Serial.print(SERIAL_SEP);
+        Serial.println(fence.altMax);
+    }
+}
 void serialRequest_42() {
+    uint16_t input[8];
+    int32_t values[8];
+    for (uint8_t i = 0; i < 8; ++i) { input[i] = phtValues[i] << 6; }
+    PhtCalib_apply(phtCalib, input, values);
+
     // Экономия FLASH памяти:
     for (uint8_t i = 0; i < 7; ++i) {
         //Serial.print(F("Значение фоторезистора ("));
         //Serial.print(i + 1);
         //Serial.print(F("): "));
-        Serial.print(map(phtValues[i], 0, 1023, phtCalibRange[i].min, phtCalibRange[i].max));
+        Serial.print(values[i] / 256.0);
         Serial.print(SERIAL_SEP);
-        //Serial.println(map(phtValues[i], 0, 1023, phtCalibRange[i].min, phtCalibRange[i].max));
     }
     //Serial.print(F("OK\n"));
-    Serial.println(map(phtValues[7], 0, 1023, phtCalibRange[7].min, phtCalibRange[7].max));
+    Serial.println(values[7] / 256.0);
 }
 void serialRequest_43() {
     // Экономия FLASH памяти:
@@ -640,6 +1841,50 @@ void serialRequest_43() {
     Serial.println(phtValues[7]);
     //Serial.print(F("OK\n"));
 }
+void serialRequest_44() {
+    // Передискретизация, фильтр, сдвиг, номер отсчёта, значения (единицы АЦП)
+    uint8_t data[21];
+    Wire.beginTransmission(I2C_BUSOS);
+    Wire.write(IC2_CMD_GET_PTH_FILTER);
+    Wire.endTransmission(false);
+
+    Wire.requestFrom(I2C_BUSOS, 21);
+    for (uint8_t i = 0; i < 21; ++i) { data[i] = Wire.read(); }
+
+    uint16_t values[9];
+    memcpy(values, data, 18);
+    Serial.print(data[18]);
+    Serial.print(SERIAL_SEP);
+    Serial.print(data[19]);
+    Serial.print(SERIAL_SEP);
+    Serial.print(data[20]);
+    Serial.print(SERIAL_SEP);
+    Serial.print(values[8]);
+    for (uint8_t i = 0; i < 8; ++i) {
+        Serial.print(SERIAL_SEP);
+        Serial.print(values[i] / 64.0, 2);
+    }
+    Serial.print('\n');
+}
+void serialRequest_45() {
+    uint8_t oversampling = Serial.parseInt();
+    uint8_t mode = Serial.parseInt();
+    uint8_t shift = Serial.parseInt();
+    setPhtFilter(oversampling, mode, shift);
+    // БУСОС применяет настройки в основном цикле
+    delay(10);
+    serialRequest_44();
+}
+void serialRequest_46() {
+    uint16_t bins = Serial.parseInt();
+    for (uint8_t n = 6; n <= 10; ++n) {
+        if (bins == 1U << n) { setDetectorHistBins(n); }
+    }
+    Serial.print(detHist.seq); Serial.print(SERIAL_SEP);
+    Serial.print(detHist.bins); Serial.print(SERIAL_SEP);
+    Serial.print(detHist.pulses); Serial.print(SERIAL_SEP);
+    Serial.println(detHist.time);
+}
 void serialRequest_70() {
     // Экономия FLASH памяти:
     Serial.print(phtCalibRange[0].min);
@@ -704,7 +1949,9 @@ void nrf24Request() {
     nrf24.read(data, NRF_RX_PACKET_SIZE);
     switch(data[0]) {
     case 1: Serial.println("New data!"); break;
+    case 11: startMgnCalibration(); break;
     case 70: sendCalibCoef(); break;
+    case 71: nrf24GeofenceRequest(data); break;
     };
 }
 
@@ -712,16 +1959,9 @@ void setup() {
     Serial.begin(115200);
     Wire.begin();
     
-    gpsSerial.begin(9600);
-    // Отключаем все заголовки, кроме GA
-    gpsSerial.write("$PCAS03,1,0,0,0,0,0,0,0,0,0,0,0,0,0*03");
-    // Меняем скорость передачи на 38400
-    gpsSerial.write("$PCAS01,3*1F\r\n");
-    // Перезапускаем gpsSerial, чтобы сменить скорость
-    gpsSerial.end();
-    // Каждый полученный символ будет доставлен в парсер
-    gpsSerial.attachInterrupt(Kraken::parseNMEA);
-    gpsSerial.begin(38400);
+    // Частота решений, скорость UART и доставка символов в парсер
+    setupGps();
+    setupGeofences();
     
     // ВАЖНО: РАДИОМОДУЛЬ НЕ БУДЕТ РАБОТАТЬ, БЕЗ SD КАРТЫ!
     // С недочётом сделана платы, проблема физическая
@@ -730,29 +1970,50 @@ void setup() {
     Serial.print(F("BC is ready...\n"));
 
     uint32_t detectorUpdateTimeMark = 0;
-    uint32_t gpsUpdateTimeMark = 0;
     uint32_t imuUpdateTimeMark = 0;
     uint32_t akbUpdateTimeMark = 0;
     uint32_t phtUpdateTimeMark = 0;
+    uint32_t phtFetchMillis = 0;
 
     uint32_t detectorSendTimeMark = 0;
+    uint32_t detectorHistTimeMark = detectorHistInterval;
     uint32_t imuSendTimeMark = 0;
     uint32_t gpsSendTimeMark = 0;
     uint32_t phtSendTimeMark = 0;
 
     uint32_t sdWriteTimeMark = 0;
+    uint32_t timeSyncSendTimeMark = 0;
+    uint32_t attitudeSendTimeMark = 0;
+    uint32_t drUpdateTimeMark = 0;
 
     while(true) {
       if (detectorUpdateTimeMark < millis() && detectorUpdateInterval >= MIN_INTERVAL_VALUE) {
         updateDetectorData();
         detectorUpdateTimeMark = millis() + detectorUpdateInterval;
       }
-      if (gpsUpdateTimeMark < millis() && gpsUpdateInterval >= MIN_INTERVAL_VALUE) {
-        updateGPSData();
-        gpsUpdateTimeMark = millis() + gpsUpdateInterval;
+      if (detHistRead.chunks) { // Идёт чтение гистограммы: одна часть за проход
+        readDetectorHistChunk();
+      }
+      else if (detectorHistTimeMark < millis() && detectorHistInterval >= MIN_INTERVAL_VALUE) {
+        latchDetectorHist();
+        detectorHistTimeMark = millis() + detectorHistInterval;
+      }
+      if (gpsFixEvent) { // Новое решение GPS
+        handleGpsFix();
+        gpsFinishRateCheck();
+      }
+      timeSyncTick();
+      if (drUpdateTimeMark < millis() && drUpdateInterval >= MIN_INTERVAL_VALUE) {
+        drPropagate();
+        if (dr.valid) { geofenceUpdate(drLatitude, drLongitude, drAltitude); }
+        else { geofenceMatch = GEOFENCE_NONE; } // Без оценки положения зона неизвестна
+        drUpdateTimeMark = millis() + drUpdateInterval;
       }
       if (imuUpdateTimeMark < millis() && imuUpdateInterval >= MIN_INTERVAL_VALUE) {
+        syncBusosClock();
         updateIMUData();
+        updateAttitudeData();
+        updateBaroData();
         imuUpdateTimeMark = millis() + imuUpdateInterval;
       }
       if (akbUpdateTimeMark < millis() && akbUpdateInterval >= MIN_INTERVAL_VALUE) {
@@ -760,37 +2021,56 @@ void setup() {
         akbUpdateTimeMark = millis() + akbUpdateInterval;
       }
       if (phtUpdateTimeMark < millis() && phtUpdateInterval >= MIN_INTERVAL_VALUE) {
-        updatePhtData();
+        // Значения забираются при изменении на BUSOS или по интервалу молчания
+        if (isPhtChanged() || millis() - phtFetchMillis >= phtHeartbeatInterval) {
+            updatePhtData();
+            phtFetchMillis = millis();
+            FLAGS |= FLG_PHT_UPDATED;
+        }
         phtUpdateTimeMark = millis() + phtUpdateInterval;
       }
       if (gpsSendTimeMark < millis() && gpsSendInterval >= MIN_INTERVAL_VALUE) {
         if (isTargetPosition()) { // Если мы находимся в нужной позиции
                 sendGpsData();
-                gpsSendTimeMark = millis() + gpsSendInterval;
+                gpsSendTimeMark = millis() + gpsSendInterval/telemetryDivider();
         }
         else { gpsSendTimeMark = millis() + gpsSendInterval/10; }
       }
       if (detectorSendTimeMark < millis() && detectorSendInterval >= MIN_INTERVAL_VALUE) {
         if (isTargetPosition()) { // Если мы находимся в нужной позиции
                 sendDetectorData();
-                detectorSendTimeMark = millis() + detectorSendInterval;
+                detectorSendTimeMark = millis() + detectorSendInterval/telemetryDivider();
         }
         else { detectorSendTimeMark = millis() + detectorSendInterval/10; }
       }
       if (imuSendTimeMark < millis() && imuSendInterval >= MIN_INTERVAL_VALUE) {
         if (isTargetPosition()) { // Если мы находимся в нужной позиции
                 sendImuData();
-                imuSendTimeMark = millis() + imuSendInterval;
+                imuSendTimeMark = millis() + imuSendInterval/telemetryDivider();
         }
         else { imuSendTimeMark = millis() + imuSendInterval/10; }
       }
-      if (phtSendTimeMark < millis() && phtSendInterval >= MIN_INTERVAL_VALUE) {
+      if (phtSendTimeMark < millis() && phtSendInterval >= MIN_INTERVAL_VALUE && (FLAGS&FLG_PHT_UPDATED)) {
         if (isTargetPosition()) { // Если мы находимся в нужной позиции
-                sendPhtData();
-                phtSendTimeMark = millis() + phtSendInterval;
+                if (sendPhtData()) { FLAGS &= ~FLG_PHT_UPDATED; }
+                phtSendTimeMark = millis() + phtSendInterval/telemetryDivider();
         }
         else { phtSendTimeMark = millis() + phtSendInterval/10; }
       }
+      if (attitudeSendTimeMark < millis() && attitudeSendInterval >= MIN_INTERVAL_VALUE) {
+        if (isTargetPosition()) { // Если мы находимся в нужной позиции
+                sendAttitudeData();
+                attitudeSendTimeMark = millis() + attitudeSendInterval/telemetryDivider();
+        }
+        else { attitudeSendTimeMark = millis() + attitudeSendInterval/10; }
+      }
+      if (timeSyncSendTimeMark < millis() && timeSyncSendInterval >= MIN_INTERVAL_VALUE && isTimeSynced()) {
+        if (isTargetPosition()) { // Если мы находимся в нужной позиции
+                sendTimeSyncData();
+                timeSyncSendTimeMark = millis() + timeSyncSendInterval/telemetryDivider();
+        }
+        else { timeSyncSendTimeMark = millis() + timeSyncSendInterval/10; }
+      }
       if (sdWriteTimeMark < millis() && sdWriteInterval >= MIN_INTERVAL_VALUE) {
             // Чтобы сразу инициализировать карту, при её подключении
             if (FLAGS&SD_CARD_INITIALIZATRED) {
@@ -1,12 +1,23 @@
 #include <GOST4401_81.h>
 #include <TroykaIMU.h>
 #include <MCP3008.h>
+#include <Servo.h>
 #include <string.h>
 #include <Wire.h>
 #include <SPI.h>
 
 #include <EEPROM.h>
+#include "MadgwickFixed.h"
+#include "GOST4401_Fast.h"
+#include "MCP3008Fast.h"
+#include "PhtCalib.h"
+#include "ConfigStore.h"
+#include "SunTrack.h"
+#include "MgnCalib.h"
+#include "GyroBias.h"
+// phtCalibRange прошлых прошивок, только для переноса в хранилище настроек
 #define EEPROM_PHT_ADDRESS 0
+#define EEPROM_CONFIG_ADDRESS 64 // Хранилище настроек, сразу после phtCalibRange (до 778)
 
 #define MCP3008_CLK  5
 #define MCP3008_DOUT 6
@@ -18,14 +29,160 @@
 #define I2C_BUSOS 0x3
 #define I2C_DETECTOR 86
 
-MCP3008       mcp3008(MCP3008_CLK, MCP3008_DIN, MCP3008_DOUT, MCP3008_CS);
+#define SERIAL_SEP ';'
+
+MCP3008       mcp3008(MCP3008_CLK, MCP3008_DIN, MCP3008_DOUT, MCP3008_CS); // Только для сравнения в K44
+MCP3008Fast<MCP3008_CLK, MCP3008_DIN, MCP3008_DOUT, MCP3008_CS> mcp3008Fast;
 Gyroscope     gyroscope;
 Accelerometer accelerometer;
 Compass       compass;
 Barometer     barometer;
 
+/* Прямой доступ к регистрам датчиков IMU.
+   Библиотека читает барометр и азимут по одному регистру за транзакцию,
+   здесь весь блок выходных регистров датчика читается одной транзакцией
+   с автоинкрементом адреса (старший бит адреса регистра) */
+class ImuBus : public BaseIMU {
+public:
+    ImuBus(uint8_t slaveAddress) : BaseIMU(slaveAddress) { _wire = &Wire; }
+    void read(uint8_t regAddress, uint8_t *data, uint8_t length) { _readBytes(0x80 | regAddress, data, length); }
+    void write(uint8_t regAddress, uint8_t data) { _writeByte(regAddress, data); }
+};
+ImuBus accelerometerBus(LIS331DLH_SLAVE_ADDRESS);
+ImuBus compassBus(LIS3MDL_SLAVE_ADDRESS);
+ImuBus gyroscopeBus(L3G4200D_SLAVE_ADDRESS);
+ImuBus barometerBus(LPS_SLAVE_ADDRESS);
+
+// Частота шины I2C (Fast mode), все устройства на шине поддерживают 400 кГц
+#define I2C_CLOCK 400000
+// Пересчёт сырых значений, должен соответствовать диапазонам из setupIMU()
+constexpr float ACL_SCALE  = SENS_8G * GRAVITY_EARTH; // м/с² на единицу
+constexpr float MGN_SCALE  = 1.0f / SENS_8GAUSS;      // Гаусс на единицу
+constexpr float GYRO_SCALE = SENS_250DPS;             // °/с на единицу
+// Частоты выдачи данных датчиков
+#define LIS331DLH_CTRL_REG1_DR_100HZ 0x08 // Акселерометр: 100 Гц
+#define LIS3MDL_CTRL_REG1_DO_80HZ    0x1C // Магнитометр: 80 Гц (по умолчанию 10 Гц)
+
+/* Опрос по готовности данных. Линии DRDY модуля IMU не выведены, поэтому
+   готовность берётся из регистра STATUS (0x27): он идёт перед выходными
+   регистрами и читается с данными одной транзакцией. Опрос датчика начинается
+   за 1/8 периода до ожидаемого отсчёта и повторяется не чаще SENSOR_POLL_US,
+   момент отсчёта - середина между последним пустым опросом и удачным */
+#define SENSOR_STATUS_REG    0x27
+#define SENSOR_STATUS_ZYXDA  0x08 // Акселерометр и магнитометр: новые данные по всем осям
+#define SENSOR_STATUS_ZYXOR  0x80 // Данные перезаписаны до чтения
+#define LPS_STATUS_P_DA      0x02 // Барометр: новое давление
+#define LPS_STATUS_P_OR      0x20
+#define SENSOR_POLL_US       250
+#define ACL_PERIOD_US        10000 // 100 Гц
+#define MGN_PERIOD_US        12500 // 80 Гц
+#define LPS331_PERIOD_US     80000 // 12.5 Гц (частота задаётся библиотекой)
+#define LPS25HB_PERIOD_US    40000 // 25 Гц
+
+/* FIFO гироскопа (L3G4200D, 32 отсчёта).
+   Гироскоп работает на 400 Гц и копит отсчёты сам, каждый опрос IMU забирает
+   накопленное пачкой. У акселерометра (LIS331DLH) FIFO нет, он читается по одному отсчёту */
+#define L3G4200D_CTRL_REG1_FIFO   0xBF // 400 Гц, полоса 110 Гц, все оси
+#define L3G4200D_CTRL_REG5_FIFO_EN 0x40
+#define L3G4200D_FIFO_CTRL_REG    0x2E
+#define L3G4200D_FIFO_SRC_REG     0x2F
+#define L3G4200D_FIFO_MODE_STREAM 0x40 // Новые отсчёты вытесняют старые
+#define L3G4200D_FIFO_SRC_OVRN    0x40
+#define L3G4200D_FIFO_SRC_FSS     0x1F
+#define GYRO_FIFO_DEPTH     32
+#define GYRO_FIFO_PERIOD_US 2500 // Период выдачи отсчётов (400 Гц)
+// Буфер Wire - 32 байта, за одну транзакцию читается не больше 5 отсчётов
+#define GYRO_FIFO_BURST     5
+#define GYRO_RING_SIZE      32
+
+/* Барометр: усреднение внутри датчика (RES_CONF), медиана из 3 отсчётов,
+   IIR по давлению и альфа-бета фильтр высоты и вертикальной скорости */
+#define LPS_RES_CONF            0x10
+/* LPS331: AVGT = 110 (64 отсчёта температуры), AVGP = 1010 (512 отсчётов давления).
+   По документации 0x7A запрещено при ODR 25 Гц, 0x6A - наибольшее усреднение
+   для 25 Гц, поэтому при 12.5 Гц (ODR = 110, задаёт библиотека) укладывается */
+#define LPS331_RES_CONF_AVG     0x6A
+#define LPS25HB_RES_CONF_AVG    0x05 // 32 отсчёта давления, 16 температуры
+#define BARO_IIR_DEFAULT        0.3f // Вес нового значения давления
+#define BARO_ALPHA_DEFAULT      0.2f // Коррекция высоты по невязке
+#define BARO_BETA_DEFAULT       0.02f // Коррекция вертикальной скорости по невязке
+
+// Калибровка магнитометра (K11, I2C 11), эллипсоид - в MgnCalib.h
+#define MGN_CALIB_TIMEOUT      180000 // мс
+
+// Смещение нуля гироскопа по таблице температур, окно и таблица - в GyroBias.h
+#define GYRO_TABLE_SAVE_INTERVAL 600000 // мс, изменённые ячейки пишутся в EEPROM не чаще
+
+// Фильтр ориентации (Madgwick), значения по умолчанию
+#define AHRS_FREQUENCY_DEFAULT 100 // Гц, не выше частоты опроса IMU
+#define AHRS_FREQUENCY_MAX     100
+// Фильтр в целых числах (MadgwickFixed.h), без него - float из Troyka-IMU
+#define AHRS_FIXED_POINT
+
+/* Непрерывный опрос фоторезисторов по прерыванию таймера 2 (K45),
+   без него - скан 8 каналов из основного цикла раз в phtTimeInterval.
+   Таймер: CTC, делитель 64 (4 мкс), поэтому период не больше 1024 мкс */
+#define PHT_SCAN_PERIOD_MIN 200  // мкс, скан 8 каналов занимает ~130 мкс
+#define PHT_SCAN_PERIOD_MAX 1024 // мкс
+#define PHT_SCAN_PERIOD_DEFAULT 1000 // мкс, включается в setup()
+
+/* Обработка отсчётов фоторезисторов (K46, I2C 45): сканы копятся по 4^n,
+   сумма прореживается до 10 + n бит (+1 бит на каждое учетверение),
+   затем по каналу - скользящее среднее по 2^k значениям или IIR с весом 2^-k
+   (только сдвиги, прерывание не делит). Отфильтрованные значения
+   хранятся в 1/64 единицы АЦП. Без непрерывного опроса сканы идут
+   раз в phtTimeInterval, и прореженные значения выходят в 4^n раз реже */
+#define PHT_OVERSAMPLING_MAX 3 // 64 скана, сумма 64·1023 ещё помещается в uint16_t
+#define PHT_MA_SHIFT_MAX     3 // Наибольшая длина скользящего среднего - 8
+#define PHT_IIR_SHIFT_MAX    8 // Наименьший вес IIR - 1/256
+// Сравнение чтения фоторезисторов (K44): количество сканов 8 каналов
+#define PHT_BENCH_SCANS 50
+/* Отчёт об изменении фоторезисторов (K41, I2C 47): канал считается
+   изменившимся, когда отфильтрованное значение ушло от последнего
+   отмеченного дальше порога. Маска изменившихся каналов копится до чтения
+   состояния по I2C, БК забирает значения только по ней или по своему
+   интервалу молчания */
+#define PHT_DEADBAND_DEFAULT 2 // ед. АЦП
+
+/* Направление на Солнце по фоторезисторам. Каналы 2k и 2k+1 - панель k, панели
+   по кругу через 90°: нормаль панели k - (cos 90°k, sin 90°k, 0) в осях спутника,
+   чётный канал наклонён к +Z на SUN_PANEL_TILT, нечётный - к -Z.
+   Фоторезистор - косинусный приёмник: I = A·max(0, n·s) + фон. У каналов i и
+   (i + 4) ^ 1 нормали противоположны, и их разность равна A·(n_i·s) без
+   ограничения нулём и без фона, поэтому v = A·s находится линейно: v = G·d,
+   G = (D'D + εE)^-1·D' - псевдообратная к нормалям D, считается в setup().
+   Составляющая вдоль оси, которую датчики не видят (Z при панелях без наклона),
+   получается нулевой - тогда вектор является проекцией на плоскость панелей.
+   Уверенность: |v|² / (|v|² + невязка² + шум²), невязка - расхождение
+   разностей с найденным v (в том числе двух каналов одной панели) */
+#define SUN_PANEL_TILT     0.0f  // °
+#define SUN_REGULARIZATION 1e-4f // ε
+#define SUN_NOISE          2.0f  // Шум разности, единицы калибровки
+
+/* Наведение на Солнце (K48, K49). Два мотора с винтами, как в Problem_2:
+   правый поворачивает спутник по +Z (к панели k + 1), левый - по -Z.
+   Регулятор и его коэффициенты - SunTrack.h. Команда -1..1
+   переводится в ширину импульса пропорционально, от порога запуска ESC до PWM_LIMIT.
+   При уверенности ниже SUN_TRACK_MIN_CONFIDENCE моторы стоят, интеграл не меняется */
+#define MOTOR_1_PIN      12 // Левый
+#define MOTOR_2_PIN      10 // Правый
+#define MOTOR_RESET_PIN  4
+#define PWM_MIN          1000 // мкс, мотор стоит
+#define PWM_START        1060 // мкс, порог вращения ESC
+#define PWM_LIMIT        1500 // мкс, наибольшая тяга (PWM_CENTER в Problem_2)
+#define MOTOR_ARM_TIME   3000 // мс на инициализацию ESC после включения
+#define SUN_TRACK_MIN_CONFIDENCE 0.5f
+
+/* Пакетная калибровка фоторезисторов (K17-K19): все 8 каналов сразу и в фоне,
+   основной цикл и I2C работают. Хост (host/pht_batch_cal) выставляет эталонную
+   освещённость и отправляет K17 с уровнем и эталонным значением, БУСОС усредняет отфильтрованные
+   значения всех каналов и выводит строку PHTCAL. После минимума и максимума
+   диапазоны считаются calcRange, как в K10; сохранение в EEPROM - K72 */
+#define PHT_BATCH_SETTLE   200  // мс, отсчёты после смены освещённости пропускаются
+#define PHT_BATCH_TIME     1000 // мс, усреднение по умолчанию
+#define PHT_BATCH_TIME_MAX 10000
+
 // Интервалы
-#define imuTimeInterval 1000
 #define phtTimeInterval 50
 #define posTimeInterval 50
 
@@ -42,20 +199,180 @@ struct Range {
 // Модуль IMU
 float press = 0;
 float temp = 0;
-float altitude = 0;
+float altitude = 0;      // Высота по отфильтрованному давлению (м)
+float verticalSpeed = 0; // Вертикальная скорость (м/с)
+float pressFiltered = 0; // Давление после медианы и IIR (Па)
 float azimut = 0;
+// Номер и момент (micros) опубликованного отсчёта: такт IMU - отсчёт акселерометра
+uint16_t imuSeq = 0, baroSeq = 0;
+uint32_t imuSampleMicros = 0, baroSampleMicros = 0;
 // Номер последнего запроса, полученного по I2C
 uint8_t lastRequestI2C = 0;
 // Значения с АЦП
 uint16_t phtValues[8] = {};
+// Непрерывный опрос: период (мкс, 0 - выключен), последний скан и их число
+uint16_t phtScanPeriod = 0;
+uint16_t phtScanBuffer[8] = {};
+volatile uint16_t phtScanCount = 0;
+// Отфильтрованные значения (1/64 единицы АЦП) и номер прореженного отсчёта
+uint16_t phtFiltered[8] = {};
+uint16_t phtFilterSeq = 0;
+// Порог изменения по каналам и значения в момент последнего изменения (1/64 единицы АЦП),
+// маска изменившихся каналов (сбрасывается чтением I2C 47) и число изменений
+uint16_t phtDeadband[8] = {
+    PHT_DEADBAND_DEFAULT * 64, PHT_DEADBAND_DEFAULT * 64, PHT_DEADBAND_DEFAULT * 64, PHT_DEADBAND_DEFAULT * 64,
+    PHT_DEADBAND_DEFAULT * 64, PHT_DEADBAND_DEFAULT * 64, PHT_DEADBAND_DEFAULT * 64, PHT_DEADBAND_DEFAULT * 64
+};
+uint16_t phtReported[8] = {};
+volatile uint8_t phtChangedMask = 0;
+uint16_t phtChangeSeq = 0;
 // Диапазон измерений каждого фоторезистора
 Range phtCalibRange[8];
+// Диапазоны в целых числах (PhtCalib.h) и калиброванные значения (1/256 единицы)
+PhtCalib phtCalib;
+int32_t phtCalibrated[8] = {};
+// Новый прореженный отсчёт фоторезисторов готов
+volatile bool phtSampleReady = false;
+// Направление на Солнце (единичный вектор в осях спутника), уверенность 0..1,
+// освещённость |A·s| (единицы калибровки) и номер отсчёта фоторезисторов
+Vector   sunVector;
+float    sunConfidence = 0;
+float    sunIntensity = 0;
+uint16_t sunSeq = 0;
+float    sunNormals[4][3];  // D: нормали каналов 0..3, считаются в setupSunSensor
+float    sunGeometry[3][4]; // G
 
 Vector gyro, acl, mgn;
+// Состояние фильтра барометра, меняется только в основном цикле
+struct BaroFilter {
+    float    window[3];
+    uint8_t  count = 0, index = 0;
+    float    pressure = 0;
+    float    altitude = 0, speed = 0;
+    uint32_t lastMicros = 0;
+    float    iir = BARO_IIR_DEFAULT, alpha = BARO_ALPHA_DEFAULT, beta = BARO_BETA_DEFAULT;
+} baro;
+// Ориентация: кватернион и углы Эйлера (°): x - крен, y - тангаж, z - рыскание
+#ifdef AHRS_FIXED_POINT
+MadgwickFixed ahrs;
+#else
+Madgwick ahrs;
+#endif
+float    ahrsFrequency = AHRS_FREQUENCY_DEFAULT;
+float    ahrsBeta = BETA_DEFAULT;
+float    quaternion[4] = {1, 0, 0, 0};
+Vector   rotateAngle;
+// Длительность последнего и самого долгого опроса IMU (мкс)
+uint16_t imuReadMicros = 0, imuReadMicrosMax = 0;
+// Опрос датчика по готовности данных, время в мкс
+struct SensorPoll {
+    uint32_t period;    // Номинальный период выдачи данных
+    uint32_t ready;     // Момент готовности последнего отсчёта
+    uint32_t lastPoll;  // Последний опрос без новых данных (0 - не было)
+    uint32_t samples;
+    uint16_t misses;    // Опросов без новых данных
+    uint16_t overruns;  // Отсчётов, перезаписанных до чтения
+};
+SensorPoll aclPoll = {ACL_PERIOD_US}, mgnPoll = {MGN_PERIOD_US}, baroPoll = {LPS331_PERIOD_US};
+// Отсчёты гироскопа из FIFO с временем (мкс), сырые значения
+struct GyroSample {
+    uint32_t time;
+    int16_t x, y, z;
+};
+GyroSample gyroRing[GYRO_RING_SIZE];
+uint8_t  gyroRingHead = 0;     // Куда будет записан следующий отсчёт
+uint32_t gyroSampleCount = 0;  // Всего прочитано отсчётов
+uint32_t gyroFifoStartMicros = 0;
+uint16_t gyroFifoOverruns = 0; // Сколько раз FIFO переполнялось (отсчёты потеряны)
+// Калибровка магнитометра: mgn = matrix·(сырое - bias)
+MgnCalibration mgnCalib = {{0, 0, 0}, {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+// Состояние калибровки магнитометра, меняется только в основном цикле
+MgnCalibFit mgnFit;
+// Запрос на запуск калибровки из прерывания I2C
+volatile bool mgnCalibStartRequest = false;
+// Таблица смещений гироскопа по температуре
+GyroBiasCell gyroBiasTable[GYRO_TABLE_SIZE];
+uint32_t gyroBiasDirty = 0;   // Ячейки, не записанные в EEPROM (битовая маска)
+uint32_t gyroBiasSaveMillis = 0;
+float    gyroBias[3] = {};    // Вычитаемое смещение (единицы АЦП)
+// Окно неподвижности для оценки смещения
+GyroStillWindow gyroStill;
+// Качество оценки: последняя оценка, её СКО (°/с) и температура
+struct GyroBiasStats {
+    float    estimate[3];
+    float    error[3];
+    float    temp;
+    uint32_t millis;
+    uint16_t accepted, rejected;
+} gyroBiasStats;
+// Обработка фоторезисторов: передискретизация 4^oversampling, затем фильтр
+enum PhtFilterMode : uint8_t { PHT_FILTER_NONE, PHT_FILTER_MA, PHT_FILTER_IIR };
+struct PhtFilterSettings {
+    uint8_t oversampling; // 0..PHT_OVERSAMPLING_MAX
+    uint8_t mode;         // PhtFilterMode
+    uint8_t shift;        // Длина среднего 2^shift (0..PHT_MA_SHIFT_MAX), вес IIR 2^-shift (1..PHT_IIR_SHIFT_MAX)
+};
+PhtFilterSettings phtFilter = {2, PHT_FILTER_MA, 2}; // 16 сканов (+2 бита), среднее по 4
+// Состояние меняется в прерывании таймера, в основном цикле - только при выключенном скане
+struct PhtFilterState {
+    uint16_t sum[8];              // Сумма сканов до прореживания
+    uint8_t  scans;
+    uint8_t  index;               // Позиция в кольце скользящего среднего
+    bool     primed;              // Фильтр начат с первого прореженного значения
+    uint16_t ring[8][1 << PHT_MA_SHIFT_MAX]; // Прореженные значения (1/64 единицы АЦП)
+    int32_t  acc[8];              // Сумма кольца или IIR в 1/16384 единицы АЦП
+    uint16_t out[8];
+    uint16_t seq;
+} phtState;
+// Наведение на Солнце
+Servo motorLeft;
+Servo motorRight;
+enum SunTrackMode : uint8_t { SUN_TRACK_OFF, SUN_TRACK_ARMING, SUN_TRACK_ON };
+SunTrackGains sunTrackGains = {SUN_TRACK_KP, SUN_TRACK_KI, SUN_TRACK_KD};
+SunTrackState sunTrack;
+uint8_t  sunTrackMode = SUN_TRACK_OFF;
+uint8_t  sunTrackPanel = 0;   // Целевая панель 0-3
+uint32_t sunTrackArmMillis = 0;
+float    sunTrackError = 0;   // рад
+// Пакетная калибровка фоторезисторов
+enum PhtBatchState : uint8_t { PHT_BATCH_IDLE, PHT_BATCH_RUNNING, PHT_BATCH_LEVEL_DONE, PHT_BATCH_DONE, PHT_BATCH_FAILED };
+struct PhtBatchCalib {
+    uint8_t  state;        // PhtBatchState
+    uint8_t  level;        // Текущий уровень: 0 - минимум, 1 - максимум
+    uint8_t  levels;       // Снятые уровни (битовая маска)
+    uint16_t samples;
+    uint32_t startMillis;
+    uint16_t duration;     // мс
+    uint32_t sum[8];       // Сумма отфильтрованных значений (1/64 единицы АЦП)
+    uint16_t mean[2][8];   // Средние по уровням (1/64 единицы АЦП)
+    float    reference[2]; // Эталонные значения уровней
+} phtBatch;
+// Новые настройки из прерывания I2C, применяются в основном цикле
+PhtFilterSettings phtFilterRequest;
+volatile bool phtFilterRequestPending = false;
+// Настройки в EEPROM, по 2 копии. Таблица линеаризации хранится вместе с признаком useLut
+enum ConfigKey : uint8_t { CONFIG_PHT_RANGE = 1, CONFIG_MGN_CALIB, CONFIG_GYRO_TABLE, CONFIG_PHT_LUT, CONFIG_SUN_TRACK, CONFIG_PHT_DEADBAND };
+static_assert(offsetof(PhtCalib, useLut) == offsetof(PhtCalib, lut) + sizeof(phtCalib.lut), "PhtCalib: useLut после lut");
+const ConfigEntry configEntries[] = {
+    CONFIG_ENTRY(CONFIG_PHT_RANGE, 1, 2, phtCalibRange),
+    CONFIG_ENTRY(CONFIG_MGN_CALIB, 1, 2, mgnCalib),
+    CONFIG_ENTRY(CONFIG_GYRO_TABLE, 1, 2, gyroBiasTable),
+    { CONFIG_PHT_LUT, 1, 2, CONFIG_SIZE(sizeof(phtCalib.lut) + sizeof(phtCalib.useLut)), phtCalib.lut },
+    CONFIG_ENTRY(CONFIG_SUN_TRACK, 1, 2, sunTrackGains),
+    CONFIG_ENTRY(CONFIG_PHT_DEADBAND, 1, 2, phtDeadband)
+};
+ConfigStore<sizeof(configEntries) / sizeof(ConfigEntry)> config(configEntries, EEPROM_CONFIG_ADDRESS);
 
 // Получить значения освещённости с конкретного фоторезистора
 float getPhtValue(int index) {
-    return map(phtValues[index], 0, 1023, phtCalibRange[index].min, phtCalibRange[index].max);
+    return phtCalibrated[index] * (1.0f / 256);
+}
+// Перевод диапазонов в целочисленную калибровку. Канал с недопустимым
+// диапазоном (например, NaN из чистой EEPROM) остаётся в единицах АЦП
+void compilePhtCalib() {
+    for (uint8_t i = 0; i < 8; ++i) {
+        PhtCalib_compileChannel(phtCalib.channel[i], phtCalibRange[i].min, phtCalibRange[i].max);
+    }
 }
 
 void setupIMU() {
@@ -67,25 +384,523 @@ void setupIMU() {
     compass.setRange(CompassRange::RANGE_8GAUSS);
     gyroscope.setRange(GyroscopeRange::RANGE_250DPS);
     accelerometer.setRange(AccelerometerRange::RANGE_8G);
+
+    // Частоты выдачи данных под опрос с частотой 100 Гц
+    accelerometerBus.write(BASE_IMU_CTRL_REG1, LIS331DLH_CTRL_REG1_X_EN | LIS331DLH_CTRL_REG1_Y_EN |
+                           LIS331DLH_CTRL_REG1_Z_EN | LIS331DLH_CTRL_REG1_PM0 | LIS331DLH_CTRL_REG1_DR_100HZ);
+    compassBus.write(BASE_IMU_CTRL_REG1, LIS3MDL_CTRL_REG1_DO_80HZ);
+
+    // Гироскоп: 400 Гц, потоковый режим FIFO
+    gyroscopeBus.write(BASE_IMU_CTRL_REG1, L3G4200D_CTRL_REG1_FIFO);
+    gyroscopeBus.write(BASE_IMU_CTRL_REG5, L3G4200D_CTRL_REG5_FIFO_EN);
+    gyroscopeBus.write(L3G4200D_FIFO_CTRL_REG, L3G4200D_FIFO_MODE_STREAM);
+    gyroFifoStartMicros = micros();
+
+    // Усреднение внутри барометра, настройка зависит от модели
+    uint8_t baroId;
+    barometerBus.read(BASE_IMU_WHO_AM_I, &baroId, 1);
+    if (baroId == LPS331_WHO_AM_I) { barometerBus.write(LPS_RES_CONF, LPS331_RES_CONF_AVG); }
+    else if (baroId == LPS25HB_WHO_AM_I) {
+        barometerBus.write(LPS_RES_CONF, LPS25HB_RES_CONF_AVG);
+        baroPoll.period = LPS25HB_PERIOD_US;
+    }
+
+    // begin() датчиков сбрасывает частоту шины на 100 кГц
+    Wire.setClock(I2C_CLOCK);
+}
+
+// Сборка int16_t из младшего и старшего байта
+int16_t toInt16(const uint8_t *data) {
+    return static_cast<int16_t>((static_cast<uint16_t>(data[1]) << 8) | data[0]);
+}
+// Медиана из трёх
+float median3(float a, float b, float c) {
+    return max(min(a, b), min(max(a, b), c));
+}
+// Новый отсчёт давления (Па): медиана, IIR, альфа-бета фильтр высоты и скорости
+void baroFilterUpdate(float pressure, uint32_t now) {
+    baro.window[baro.index] = pressure;
+    baro.index = (baro.index + 1) % 3;
+    if (baro.count < 3) { ++baro.count; }
+    float median = baro.count < 3 ? pressure : median3(baro.window[0], baro.window[1], baro.window[2]);
+
+    if (baro.count == 1) { // Первый отсчёт
+        baro.pressure = median;
+        baro.altitude = GOST4401Fast_getAltitude(median);
+        baro.speed = 0;
+        baro.lastMicros = now;
+        return;
+    }
+    baro.pressure += baro.iir * (median - baro.pressure);
+
+    float dt = (now - baro.lastMicros) * 1e-6f;
+    baro.lastMicros = now;
+    float residual = GOST4401Fast_getAltitude(baro.pressure) - (baro.altitude + baro.speed * dt);
+    baro.altitude += baro.speed * dt + baro.alpha * residual;
+    if (dt > 0) { baro.speed += baro.beta / dt * residual; }
+}
+// Чтение всех накопленных в FIFO отсчётов гироскопа в gyroRing
+// Возвращает количество отсчётов, mean - их среднее (°/с)
+uint8_t drainGyroFifo(Vector &mean, float rawMean[3]) {
+    uint8_t src;
+    gyroscopeBus.read(L3G4200D_FIFO_SRC_REG, &src, 1);
+    uint8_t count = src & L3G4200D_FIFO_SRC_FSS;
+    if (src & L3G4200D_FIFO_SRC_OVRN) {
+        ++gyroFifoOverruns;
+        count = GYRO_FIFO_DEPTH;
+    }
+    if (!count) { return 0; }
+
+    // Последний отсчёт считается полученным сейчас, остальные - раньше на период
+    uint32_t now = micros();
+    int32_t sumX = 0, sumY = 0, sumZ = 0;
+    for (uint8_t done = 0; done < count;) {
+        uint8_t n = min(count - done, GYRO_FIFO_BURST);
+        uint8_t raw[6*GYRO_FIFO_BURST];
+        // При включённом FIFO адрес после OUT_Z_H возвращается к OUT_X_L
+        gyroscopeBus.read(BASE_IMU_OUT_X_L, raw, 6*n);
+        for (uint8_t i = 0; i < n; ++i, ++done) {
+            GyroSample &sample = gyroRing[gyroRingHead];
+            sample.time = now - static_cast<uint32_t>(count - 1 - done) * GYRO_FIFO_PERIOD_US;
+            sample.x = toInt16(raw + 6*i);
+            sample.y = toInt16(raw + 6*i + 2);
+            sample.z = toInt16(raw + 6*i + 4);
+            sumX += sample.x; sumY += sample.y; sumZ += sample.z;
+            gyroRingHead = (gyroRingHead + 1) % GYRO_RING_SIZE;
+        }
+    }
+    gyroSampleCount += count;
+
+    rawMean[0] = static_cast<float>(sumX) / count;
+    rawMean[1] = static_cast<float>(sumY) / count;
+    rawMean[2] = static_cast<float>(sumZ) / count;
+    mean.x = (rawMean[0] - gyroBias[0]) * GYRO_SCALE;
+    mean.y = (rawMean[1] - gyroBias[1]) * GYRO_SCALE;
+    mean.z = (rawMean[2] - gyroBias[2]) * GYRO_SCALE;
+    return count;
+}
+// Смещение гироскопа по таблице для температуры (°C)
+void updateGyroBias(float temperature) {
+    gyroBiasInterpolate(gyroBiasTable, temperature, gyroBias);
+}
+// Очередной опрос IMU для оценки смещения: rawMean - среднее гироскопа за опрос
+// (единицы АЦП), acl и mgn - уже пересчитанные значения
+void updateGyroStill(const float rawMean[3], const Vector &acl, const Vector &mgn) {
+    float aclNorm = sqrt(acl.x*acl.x + acl.y*acl.y + acl.z*acl.z);
+    const float field[3] = {mgn.x, mgn.y, mgn.z};
+    float estimate[3], error[3];
+    uint8_t result = gyroStillAdd(gyroStill, rawMean, aclNorm - GRAVITY_EARTH, field, GYRO_SCALE, estimate, error);
+    if (result == GYRO_STILL_REJECTED) { ++gyroBiasStats.rejected; }
+    if (result != GYRO_STILL_ACCEPTED) { return; }
+
+    gyroBiasDirty |= 1UL << gyroBiasLearn(gyroBiasTable, temp, estimate);
+    updateGyroBias(temp);
+
+    memcpy(gyroBiasStats.estimate, estimate, sizeof(estimate));
+    memcpy(gyroBiasStats.error, error, sizeof(error));
+    gyroBiasStats.temp = temp;
+    gyroBiasStats.millis = millis();
+    // Первая оценка после старта сохраняется сразу
+    if (!gyroBiasStats.accepted++ || millis() - gyroBiasSaveMillis > GYRO_TABLE_SAVE_INTERVAL) { saveGyroBiasTable(); }
+}
+// Калибровка магнитометра
+void applyMgnCalibration(Vector &v) {
+    float r[3] = {v.x, v.y, v.z};
+    mgnCalibApply(mgnCalib, r);
+    v.x = r[0]; v.y = r[1]; v.z = r[2];
+}
+void mgnCalibStart() {
+    memset(&mgnFit, 0, sizeof(mgnFit));
+    mgnFit.state = MGN_CALIB_RUNNING;
+    mgnFit.startMillis = millis();
+}
+// Новый отсчёт (Гаусс, без калибровки), по готовности - решение и сохранение
+void mgnCalibUpdate(const Vector &raw) {
+    if (millis() - mgnFit.startMillis > MGN_CALIB_TIMEOUT) {
+        mgnFit.state = MGN_CALIB_FAILED;
+        return;
+    }
+    const float v[3] = {raw.x, raw.y, raw.z};
+    if (!mgnCalibAdd(mgnFit, v)) { return; }
+    mgnFit.state = mgnCalibSolve(mgnFit, mgnCalib) ? MGN_CALIB_DONE : MGN_CALIB_FAILED;
+    if (mgnFit.state == MGN_CALIB_DONE) { saveMgnCalibration(); }
 }
+/* Опрос датчика: true и data (статус + length - 1 байт данных), если готов новый отсчёт.
+   Раньше ожидаемого момента шина не занимается */
+bool pollSensor(SensorPoll &sensor, ImuBus &bus, uint8_t readyMask, uint8_t overrunMask, uint8_t *data, uint8_t length) {
+    uint32_t now = micros();
+    if ((int32_t)(now - (sensor.ready + sensor.period - sensor.period / 8)) < 0) { return false; }
+    if (sensor.lastPoll && now - sensor.lastPoll < SENSOR_POLL_US) { return false; }
 
-// Обновление данных
+    bus.read(SENSOR_STATUS_REG, data, length);
+    if (!(data[0] & readyMask)) {
+        ++sensor.misses;
+        sensor.lastPoll = now;
+        return false;
+    }
+    if (data[0] & overrunMask) { ++sensor.overruns; }
+    sensor.ready = sensor.lastPoll ? sensor.lastPoll + (now - sensor.lastPoll) / 2 : now;
+    sensor.lastPoll = 0;
+    ++sensor.samples;
+    return true;
+}
+// Опрос IMU, вызывается на каждом проходе основного цикла
 void updateIMUData() {
-    accelerometer.readAccelerationAXYZ(acl.x, acl.y, acl.z);
+    uint32_t startMicros = micros();
+    uint8_t raw[7];
+    bool updated = false;
+
+    // Акселерометр задаёт такт: вместе с ним забирается FIFO гироскопа
+    if (pollSensor(aclPoll, accelerometerBus, SENSOR_STATUS_ZYXDA, SENSOR_STATUS_ZYXOR, raw, 7)) {
+        Vector newAcl;
+        newAcl.x = toInt16(raw+1) * ACL_SCALE;
+        newAcl.y = toInt16(raw+3) * ACL_SCALE;
+        newAcl.z = toInt16(raw+5) * ACL_SCALE;
+        // Угловая скорость - среднее по отсчётам с прошлого опроса
+        Vector newGyro = gyro;
+        float gyroRaw[3];
+        if (drainGyroFifo(newGyro, gyroRaw)) { updateGyroStill(gyroRaw, newAcl, mgn); }
+
+        // Данные читаются из прерывания I2C, обновляются целиком
+        noInterrupts();
+        acl = newAcl;
+        gyro = newGyro;
+        ++imuSeq;
+        imuSampleMicros = aclPoll.ready;
+        interrupts();
+        updated = true;
+    }
+    if (pollSensor(mgnPoll, compassBus, SENSOR_STATUS_ZYXDA, SENSOR_STATUS_ZYXOR, raw, 7)) {
+        Vector newMgn;
+        newMgn.x = toInt16(raw+1) * MGN_SCALE;
+        newMgn.y = toInt16(raw+3) * MGN_SCALE;
+        newMgn.z = toInt16(raw+5) * MGN_SCALE;
+        if (mgnFit.state == MGN_CALIB_RUNNING) { mgnCalibUpdate(newMgn); }
+        applyMgnCalibration(newMgn);
+
+        // Азимут по уже прочитанному вектору магнитного поля
+        float heading = atan2(newMgn.x, newMgn.y);
+        if (heading < 0) { heading += TWO_PI; }
 
-    compass.readMagneticGaussXYZ(mgn.x, mgn.y, mgn.z);
+        noInterrupts();
+        mgn = newMgn;
+        azimut = heading * RAD_TO_DEG;
+        interrupts();
+        updated = true;
+    }
+    // Статус, давление (3 байта) и температура (2 байта) идут подряд
+    if (pollSensor(baroPoll, barometerBus, LPS_STATUS_P_DA, LPS_STATUS_P_OR, raw, 6)) {
+        uint32_t pressRaw = static_cast<uint32_t>(raw[3]) << 16 | static_cast<uint16_t>(raw[2]) << 8 | raw[1];
+        float newPress = pressRaw / 4096.0f * MILLIBARS_TO_PASCALS;
+        float newTemp = 42.5f + toInt16(raw+4) / 480.0f;
+        baroFilterUpdate(newPress, baroPoll.ready);
+        updateGyroBias(newTemp);
 
-    gyroscope.readRotationDegXYZ(gyro.x, gyro.y, gyro.z);
-    azimut = compass.readAzimut();
+        noInterrupts();
+        press = newPress;
+        temp = newTemp;
+        pressFiltered = baro.pressure;
+        altitude = baro.altitude;
+        verticalSpeed = baro.speed;
+        ++baroSeq;
+        baroSampleMicros = baroPoll.ready;
+        interrupts();
+        updated = true;
+    }
 
-    temp = barometer.readTemperatureC();
-    press = barometer.readPressurePascals();
-    altitude = GOST4401_getAltitude(press);
+    if (updated) {
+        imuReadMicros = micros() - startMicros;
+        if (imuReadMicros > imuReadMicrosMax) { imuReadMicrosMax = imuReadMicros; }
+    }
+}
+// Скан из основного цикла, когда непрерывный опрос выключен
+void scanPhtValues() {
+    mcp3008Fast.scan(phtScanBuffer);
+    phtAcquire(phtScanBuffer);
 }
+// Копирование нового прореженного отсчёта и калибровка
 void updatePhtValues() {
-    for (int i = 0; i <= 7; ++i) {
-        phtValues[i] = mcp3008.readADC(i);
+    noInterrupts();
+    memcpy(phtValues, phtScanBuffer, sizeof(phtValues));
+    memcpy(phtFiltered, phtState.out, sizeof(phtFiltered));
+    phtFilterSeq = phtState.seq;
+    interrupts();
+    PhtCalib_apply(phtCalib, phtFiltered, phtCalibrated);
+}
+// Отметка каналов, ушедших от последнего отмеченного значения дальше порога
+void updatePhtChanges() {
+    uint8_t changed = 0;
+    for (uint8_t i = 0; i < 8; ++i) {
+        uint16_t delta = phtFiltered[i] > phtReported[i] ? phtFiltered[i] - phtReported[i] : phtReported[i] - phtFiltered[i];
+        if (delta > phtDeadband[i]) {
+            phtReported[i] = phtFiltered[i];
+            changed |= 1 << i;
+        }
     }
+    if (!changed) { return; }
+    noInterrupts();
+    phtChangedMask |= changed;
+    ++phtChangeSeq;
+    interrupts();
+}
+/* Один скан 8 каналов в обработку: накопление, прореживание (сумма 4^n
+   отсчётов >> n даёт 10 + n бит) и фильтр по каждому каналу */
+void phtAcquire(const uint16_t *raw) {
+    for (uint8_t i = 0; i < 8; ++i) { phtState.sum[i] += raw[i]; }
+    const uint8_t n = phtFilter.oversampling;
+    if (++phtState.scans < (1 << 2 * n)) { return; }
+    phtState.scans = 0;
+
+    const uint8_t k = phtFilter.shift;
+    for (uint8_t i = 0; i < 8; ++i) {
+        uint16_t x = (phtState.sum[i] >> n) << (6 - n); // 1/64 единицы АЦП
+        phtState.sum[i] = 0;
+
+        // Первое значение заполняет фильтр целиком - без переходного процесса от нуля
+        if (phtFilter.mode == PHT_FILTER_MA) {
+            uint16_t *ring = phtState.ring[i];
+            if (!phtState.primed) {
+                for (uint8_t j = 0; j < (1 << k); ++j) { ring[j] = x; }
+                phtState.acc[i] = static_cast<int32_t>(x) << k;
+            }
+            phtState.acc[i] += static_cast<int32_t>(x) - ring[phtState.index];
+            ring[phtState.index] = x;
+            phtState.out[i] = phtState.acc[i] >> k;
+        }
+        else if (phtFilter.mode == PHT_FILTER_IIR) {
+            int32_t target = static_cast<int32_t>(x) << 8;
+            if (!phtState.primed) { phtState.acc[i] = target; }
+            phtState.acc[i] += (target - phtState.acc[i]) >> k;
+            phtState.out[i] = (phtState.acc[i] + 128) >> 8;
+        }
+        else { phtState.out[i] = x; }
+    }
+    phtState.primed = true;
+    phtState.index = (phtState.index + 1) & ((1 << k) - 1);
+    ++phtState.seq;
+    phtSampleReady = true;
+}
+// Применить настройки обработки фоторезисторов, false - недопустимые
+bool setPhtFilter(const PhtFilterSettings &settings) {
+    if (settings.oversampling > PHT_OVERSAMPLING_MAX || settings.mode > PHT_FILTER_IIR) { return false; }
+    if (settings.mode == PHT_FILTER_MA && settings.shift > PHT_MA_SHIFT_MAX) { return false; }
+    if (settings.mode == PHT_FILTER_IIR && (settings.shift < 1 || settings.shift > PHT_IIR_SHIFT_MAX)) { return false; }
+
+    // Скан по таймеру на это время запрещён, накопленное сбрасывается
+    uint8_t timerMask = TIMSK2;
+    TIMSK2 &= ~_BV(OCIE2A);
+    phtFilter = settings;
+    if (phtFilter.mode == PHT_FILTER_NONE) { phtFilter.shift = 0; }
+    uint16_t seq = phtState.seq;
+    memset(&phtState, 0, sizeof(phtState));
+    phtState.seq = seq;
+    TIMSK2 = timerMask;
+    return true;
+}
+// Чтение одного канала из основного цикла: скан по таймеру на это время
+// запрещён, чтобы не начался посреди преобразования
+uint16_t readPhtChannel(uint8_t channel) {
+    uint8_t timerMask = TIMSK2;
+    TIMSK2 &= ~_BV(OCIE2A);
+    uint16_t value = mcp3008Fast.read(channel);
+    TIMSK2 = timerMask;
+    return value;
+}
+// Непрерывный опрос по таймеру 2, period - мкс, 0 - выключить
+void setPhtScanPeriod(uint16_t period) {
+    TIMSK2 &= ~_BV(OCIE2A);
+    phtScanPeriod = period ? constrain(period, PHT_SCAN_PERIOD_MIN, PHT_SCAN_PERIOD_MAX) : 0;
+    if (!phtScanPeriod) { return; }
+
+    TCCR2A = _BV(WGM21); // CTC
+    TCCR2B = _BV(CS22);  // F_CPU/64 - 4 мкс
+    OCR2A = phtScanPeriod / 4 - 1;
+    TCNT2 = 0;
+    TIMSK2 |= _BV(OCIE2A);
+}
+/* Скан с обработкой идёт дольше 130 мкс, поэтому выполняется с разрешёнными
+   прерываниями: импульсы Servo/ESC (таймер 1), millis и ответы по I2C не ждут его.
+   Своё прерывание на это время маскируется, чтобы скан не начался повторно
+   поверх незаконченного. Обработчики I2C не трогают phtState и TIMSK2 */
+ISR(TIMER2_COMPA_vect) {
+    TIMSK2 &= ~_BV(OCIE2A);
+    sei();
+    mcp3008Fast.scan(phtScanBuffer);
+    phtAcquire(phtScanBuffer);
+    ++phtScanCount;
+    cli();
+    TIMSK2 |= _BV(OCIE2A);
+}
+
+// Нормаль фоторезистора channel в осях спутника
+Vector phtNormal(uint8_t channel) {
+    float azimuth = (channel / 2) * HALF_PI;
+    float tilt = (channel & 1 ? -SUN_PANEL_TILT : SUN_PANEL_TILT) * DEG_TO_RAD;
+    Vector normal;
+    normal.x = cos(azimuth) * cos(tilt);
+    normal.y = sin(azimuth) * cos(tilt);
+    normal.z = sin(tilt);
+    return normal;
+}
+// Нормали каналов 0..3 (строки D) и матрица G по ним: sin/cos считаются один раз
+void setupSunSensor() {
+    float (*d)[3] = sunNormals;
+    for (uint8_t p = 0; p < 4; ++p) {
+        Vector normal = phtNormal(p);
+        d[p][0] = normal.x; d[p][1] = normal.y; d[p][2] = normal.z;
+    }
+    // M = D'D + εE и обратная через присоединённую
+    float m[3][3];
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t j = 0; j < 3; ++j) {
+            m[i][j] = i == j ? SUN_REGULARIZATION : 0;
+            for (uint8_t p = 0; p < 4; ++p) { m[i][j] += d[p][i] * d[p][j]; }
+        }
+    }
+    float inv[3][3];
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t j = 0; j < 3; ++j) {
+            uint8_t r0 = (j + 1) % 3, r1 = (j + 2) % 3, c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+            inv[i][j] = m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+        }
+    }
+    float det = m[0][0] * inv[0][0] + m[0][1] * inv[1][0] + m[0][2] * inv[2][0];
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t p = 0; p < 4; ++p) {
+            sunGeometry[i][p] = 0;
+            for (uint8_t j = 0; j < 3; ++j) { sunGeometry[i][p] += inv[i][j] * d[p][j] / det; }
+        }
+    }
+}
+// Направление на Солнце по последним калиброванным значениям
+void updateSunVector() {
+    float diff[4];
+    for (uint8_t p = 0; p < 4; ++p) {
+        diff[p] = (phtCalibrated[p] - phtCalibrated[(p + 4) ^ 1]) * (1.0f / 256);
+    }
+    float v[3];
+    for (uint8_t i = 0; i < 3; ++i) {
+        v[i] = 0;
+        for (uint8_t p = 0; p < 4; ++p) { v[i] += sunGeometry[i][p] * diff[p]; }
+    }
+    float residual = 0;
+    for (uint8_t p = 0; p < 4; ++p) {
+        const float *normal = sunNormals[p];
+        float r = diff[p] - (normal[0] * v[0] + normal[1] * v[1] + normal[2] * v[2]);
+        residual += r * r;
+    }
+
+    float signal = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+    sunIntensity = sqrt(signal);
+    sunConfidence = signal / (signal + residual + SUN_NOISE * SUN_NOISE);
+    if (sunIntensity > 0) {
+        sunVector.x = v[0] / sunIntensity;
+        sunVector.y = v[1] / sunIntensity;
+        sunVector.z = v[2] / sunIntensity;
+    }
+    sunSeq = phtFilterSeq;
+}
+
+// Команда -1..1 на моторы: больше нуля - правый, меньше - левый
+void writeMotors(float output) {
+    uint16_t pwm = output != 0 ? PWM_START + fabs(output) * (PWM_LIMIT - PWM_START) : PWM_MIN;
+    motorRight.writeMicroseconds(output > 0 ? pwm : PWM_MIN);
+    motorLeft.writeMicroseconds(output < 0 ? pwm : PWM_MIN);
+}
+// Включение наведения на панель panel, выключение - panel > 3
+void setSunTrack(uint8_t panel) {
+    if (panel > 3) {
+        if (sunTrackMode != SUN_TRACK_OFF) { writeMotors(0); }
+        sunTrackMode = SUN_TRACK_OFF;
+        return;
+    }
+    if (sunTrackMode == SUN_TRACK_OFF) {
+        // Питание ESC и нулевая тяга на время инициализации
+        pinMode(MOTOR_RESET_PIN, OUTPUT);
+        digitalWrite(MOTOR_RESET_PIN, HIGH);
+        motorLeft.attach(MOTOR_1_PIN);
+        motorRight.attach(MOTOR_2_PIN);
+        writeMotors(0);
+        sunTrackMode = SUN_TRACK_ARMING;
+        sunTrackArmMillis = millis();
+    }
+    sunTrackPanel = panel;
+    memset(&sunTrack, 0, sizeof(sunTrack));
+}
+// Ошибка азимута Солнца относительно нормали панели, -pi..pi
+float sunAzimuthError(float x, float y, uint8_t panel) {
+    float error = atan2(y, x) - panel * HALF_PI;
+    if (error > PI) { error -= TWO_PI; }
+    if (error < -PI) { error += TWO_PI; }
+    return error;
+}
+// Шаг наведения раз в SUN_TRACK_PERIOD
+void updateSunTrack() {
+    if (sunTrackMode == SUN_TRACK_ARMING) {
+        if (millis() - sunTrackArmMillis < MOTOR_ARM_TIME) { return; }
+        sunTrackMode = SUN_TRACK_ON;
+    }
+    if (sunConfidence < SUN_TRACK_MIN_CONFIDENCE) {
+        sunTrack.output = 0;
+        writeMotors(0);
+        return;
+    }
+    sunTrackError = sunAzimuthError(sunVector.x, sunVector.y, sunTrackPanel);
+    writeMotors(sunTrackStep(sunTrack, sunTrackGains, sunTrackError, gyro.z * DEG_TO_RAD, SUN_TRACK_PERIOD * 1e-3f));
+}
+
+// Фильтр ориентации
+void setupAhrs() {
+    ahrs.begin();
+    ahrs.setSettings(ahrsBeta);
+    ahrs.setFrequency(ahrsFrequency);
+}
+// Шаг фильтра по последним данным IMU, вызывается с частотой ahrsFrequency
+void updateAhrs() {
+    ahrs.update(gyro.x * DEG_TO_RAD, gyro.y * DEG_TO_RAD, gyro.z * DEG_TO_RAD,
+                acl.x, acl.y, acl.z, mgn.x, mgn.y, mgn.z);
+
+    float q[4];
+    ahrs.readQuaternion(q[0], q[1], q[2], q[3]);
+    Vector angle;
+    angle.x = ahrs.getRollDeg();
+    angle.y = ahrs.getPitchDeg();
+    angle.z = ahrs.getYawDeg();
+
+    // Данные читаются из прерывания I2C, обновляются целиком
+    noInterrupts();
+    memcpy(quaternion, q, sizeof(q));
+    rotateAngle = angle;
+    interrupts();
+}
+
+/* Сравнение быстрого скана MCP3008 с библиотекой: 8 каналов библиотекой,
+   сразу за ними 8 каналов быстрым чтением. Скан по таймеру на это время выключен.
+   Результат: время скана (мкс) и максимальное расхождение (ед. АЦП), которое
+   включает шум и изменение освещения между сканами */
+void phtBench(float &libMicros, float &fastMicros, uint16_t &maxDiff) {
+    uint16_t lib[8], fast[8];
+    uint32_t libTime = 0, fastTime = 0;
+    maxDiff = 0;
+
+    uint8_t timerMask = TIMSK2;
+    TIMSK2 &= ~_BV(OCIE2A);
+    for (uint8_t scan = 0; scan < PHT_BENCH_SCANS; ++scan) {
+        uint32_t start = micros();
+        for (uint8_t i = 0; i < 8; ++i) { lib[i] = mcp3008.readADC(i); }
+        uint32_t middle = micros();
+        mcp3008Fast.scan(fast);
+        uint32_t end = micros();
+        libTime += middle - start;
+        fastTime += end - middle;
+        for (uint8_t i = 0; i < 8; ++i) {
+            maxDiff = max(maxDiff, static_cast<uint16_t>(abs(static_cast<int16_t>(fast[i] - lib[i]))));
+        }
+    }
+    TIMSK2 = timerMask;
+
+    libMicros = static_cast<float>(libTime) / PHT_BENCH_SCANS;
+    fastMicros = static_cast<float>(fastTime) / PHT_BENCH_SCANS;
 }
 
 // Функции чтения и преобразования
@@ -107,6 +922,73 @@ bool parseBool() {
 }
 
 // Калибровка
+// Начать усреднение уровня level (0 - минимум, 1 - максимум), false - уже идёт
+bool phtBatchStart(uint8_t level, float reference, uint16_t duration) {
+    if (phtBatch.state == PHT_BATCH_RUNNING) { return false; }
+    if (phtBatch.state == PHT_BATCH_DONE || phtBatch.state == PHT_BATCH_FAILED) { phtBatch.levels = 0; }
+    phtBatch.state = PHT_BATCH_RUNNING;
+    phtBatch.level = level;
+    phtBatch.reference[level] = reference;
+    phtBatch.duration = duration;
+    phtBatch.samples = 0;
+    phtBatch.startMillis = millis();
+    memset(phtBatch.sum, 0, sizeof(phtBatch.sum));
+    return true;
+}
+// Шаг калибровки на каждый новый отсчёт фоторезисторов
+void phtBatchUpdate() {
+    if (phtBatch.state != PHT_BATCH_RUNNING) { return; }
+    uint32_t elapsed = millis() - phtBatch.startMillis;
+    if (elapsed < PHT_BATCH_SETTLE) { return; }
+
+    if (elapsed < PHT_BATCH_SETTLE + static_cast<uint32_t>(phtBatch.duration) || !phtBatch.samples) {
+        for (uint8_t i = 0; i < 8; ++i) { phtBatch.sum[i] += phtFiltered[i]; }
+        ++phtBatch.samples;
+        return;
+    }
+
+    // Уровень снят
+    for (uint8_t i = 0; i < 8; ++i) { phtBatch.mean[phtBatch.level][i] = phtBatch.sum[i] / phtBatch.samples; }
+    phtBatch.levels |= 1 << phtBatch.level;
+    phtBatch.state = PHT_BATCH_LEVEL_DONE;
+
+    if (phtBatch.levels == 0x03) {
+        Range ranges[8];
+        phtBatch.state = PHT_BATCH_DONE;
+        for (uint8_t i = 0; i < 8; ++i) {
+            if (!calcRange(phtBatch.mean[0][i] / 64.0f, phtBatch.mean[1][i] / 64.0f,
+                           phtBatch.reference[0], phtBatch.reference[1], &ranges[i].min, &ranges[i].max)) {
+                phtBatch.state = PHT_BATCH_FAILED;
+            }
+        }
+        if (phtBatch.state == PHT_BATCH_DONE) {
+            memcpy(phtCalibRange, ranges, sizeof(ranges));
+            compilePhtCalib();
+        }
+    }
+    printPhtBatch();
+}
+/* Строка состояния: PHTCAL;состояние;снятые уровни;отсчётов;эталоны (2);
+   средние АЦП минимума (8);средние АЦП максимума (8);диапазоны (8 пар) */
+void printPhtBatch() {
+    Serial.print(F("PHTCAL"));
+    Serial.print(SERIAL_SEP); Serial.print(phtBatch.state);
+    Serial.print(SERIAL_SEP); Serial.print(phtBatch.levels);
+    Serial.print(SERIAL_SEP); Serial.print(phtBatch.samples);
+    for (uint8_t level = 0; level < 2; ++level) {
+        Serial.print(SERIAL_SEP); Serial.print(phtBatch.reference[level]);
+    }
+    for (uint8_t level = 0; level < 2; ++level) {
+        for (uint8_t i = 0; i < 8; ++i) {
+            Serial.print(SERIAL_SEP); Serial.print(phtBatch.mean[level][i] / 64.0f);
+        }
+    }
+    for (uint8_t i = 0; i < 8; ++i) {
+        Serial.print(SERIAL_SEP); Serial.print(phtCalibRange[i].min);
+        Serial.print(SERIAL_SEP); Serial.print(phtCalibRange[i].max);
+    }
+    Serial.print('\n');
+}
 void calibrationPht() {
     float minAbsoluteValue, maxAbsoluteValue;
     do { Serial.print(F("Начало процедуры калибровки...\nВведите эталонное значение минимума: ")); }
@@ -130,7 +1012,7 @@ void calibrationPht() {
         if (timeCounter < millis()) {
             if (phase == 0) { Serial.print(F("Текущее значение минимума фоторезистора (")); }
             else { Serial.print(F("Текущее значение максимума фоторезистора (")); }
-            Serial.print(phtIndex + 1); Serial.print("): "); Serial.println(mcp3008.readADC(phtIndex + 1));
+            Serial.print(phtIndex + 1); Serial.print("): "); Serial.println(readPhtChannel(phtIndex));
             timeCounter = millis() + updateDelay;
         }
         /* Если пришла команда с консоли
@@ -151,7 +1033,7 @@ void calibrationPht() {
                             // Среднее из measureCount значений
                             phtRange.min = 0;
                             for (uint8_t i = 0; i < measureCount; ++i) {
-                                phtRange.min += mcp3008.readADC(phtIndex);
+                                phtRange.min += readPhtChannel(phtIndex);
                             }
                             phtRange.min /= measureCount;
 
@@ -172,7 +1054,7 @@ void calibrationPht() {
                             // Среднее из measureCount значений
                             phtRange.max = 0;
                             for (uint8_t i = 0; i < measureCount; ++i) {
-                                phtRange.max += mcp3008.readADC(phtIndex);
+                                phtRange.max += readPhtChannel(phtIndex);
                             }
                             phtRange.max /= measureCount;
 
@@ -244,20 +1126,59 @@ void calibrationPht() {
 }
 // Сохранение phtCalibRange в EEPROM
 void savePhtCalibRange() {
-    uint8_t data[sizeof(Range)*8];
-    memcpy(data, phtCalibRange, sizeof(Range)*8);
-
-    for(uint8_t i = EEPROM_PHT_ADDRESS; i < EEPROM_PHT_ADDRESS+sizeof(Range)*8; ++i) {
-        EEPROM.update(i, data[i]);
+    config.save(CONFIG_PHT_RANGE);
+}
+// Сохранение таблицы линеаризации фоторезисторов в EEPROM: узлы и признак
+void savePhtLut() {
+    config.save(CONFIG_PHT_LUT);
+}
+// Используется только неубывающая таблица
+void checkPhtLut() {
+    if (!phtCalib.useLut) { return; }
+    for (uint8_t j = 0; j < PHT_CALIB_LUT_SEGMENTS; ++j) {
+        if (phtCalib.lut[j + 1] < phtCalib.lut[j]) {
+            PhtCalib_resetLut(phtCalib);
+            return;
+        }
+    }
+}
+// Сохранение калибровки магнитометра в EEPROM
+void saveMgnCalibration() {
+    config.save(CONFIG_MGN_CALIB);
+}
+// Сохранение изменённых ячеек таблицы смещений гироскопа в EEPROM.
+// Таблица пишется целиком в следующую копию, EEPROM.update пропускает совпадающие байты
+void saveGyroBiasTable() {
+    if (gyroBiasDirty) { config.save(CONFIG_GYRO_TABLE); }
+    gyroBiasDirty = 0;
+    gyroBiasSaveMillis = millis();
+}
+// Ячейки с весом больше допустимого (чистая EEPROM - 0xFF) не используются
+void checkGyroBiasTable() {
+    for (uint8_t cell = 0; cell < GYRO_TABLE_SIZE; ++cell) {
+        if (gyroBiasTable[cell].weight > GYRO_TABLE_WEIGHT_MAX) { memset(&gyroBiasTable[cell], 0, sizeof(GyroBiasCell)); }
     }
 }
-// Загрузка phtCalibRange из EEPROM
-void loadPhtCalibRange() {
-    uint8_t data[sizeof(Range)*8];
-    for(uint8_t i = EEPROM_PHT_ADDRESS; i < EEPROM_PHT_ADDRESS+sizeof(Range)*8; ++i) {
-        data[i] = EEPROM.read(i);
+// Загрузка настроек из хранилища. Диапазоны фоторезисторов, которых там нет,
+// переносятся из адреса 0 прошлых прошивок, если там данные, а не чистая EEPROM
+void loadConfig() {
+    PhtCalib_resetLut(phtCalib);
+    config.begin();
+
+    if (!config.loaded(CONFIG_PHT_RANGE)) {
+        Range range[8];
+        EEPROM.get(EEPROM_PHT_ADDRESS, range);
+        bool valid = true;
+        for (uint8_t i = 0; i < 8; ++i) { valid = valid && isfinite(range[i].min) && isfinite(range[i].max); }
+        if (valid) {
+            memcpy(phtCalibRange, range, sizeof(range));
+            config.save(CONFIG_PHT_RANGE);
+        }
     }
-    memcpy(phtCalibRange, data, sizeof(Range)*8);
+
+    checkGyroBiasTable();
+    checkPhtLut();
+    compilePhtCalib();
 }
 bool calcRange(float minADC, float maxADC, float minValue, float maxValue, float *minRange, float *maxRange) {
     // Минимальный процент, на который был использован фоторезистор
@@ -282,12 +1203,33 @@ bool calcRange(float minADC, float maxADC, float minValue, float maxValue, float
 /* Список команд
 K1 - Проверка
 K10 - Начать калибровку фоторезисторов
+K11 - Начать калибровку магнитометра (вращать спутник до завершения)
+K12 - Вывести состояние и результат калибровки магнитометра
+K13 - Сбросить калибровку магнитометра (и в EEPROM)
+K14 - Вывести смещение гироскопа и качество последней оценки
+K15 - Вывести таблицу смещений гироскопа по температуре
+K16 - Очистить таблицу смещений гироскопа (и в EEPROM)
+K17 - Пакетная калибровка фоторезисторов: снять уровень (0 - минимум, 1 - максимум; эталонное значение; время (мс), 0 - 1000)
+K18 - Вывести состояние пакетной калибровки фоторезисторов (строка PHTCAL)
+K19 - Сбросить пакетную калибровку фоторезисторов
 K31 - Вывести давление и температуру
+K33 - Вывести отсчёты гироскопа из FIFO и статистику вибраций
+K34 - Настроить фильтр ориентации (частота (Гц), коэффициент beta; 0 - оставить прежнее)
+K35 - Вывести ориентацию (кватернион и углы Эйлера)
+K37 - Настроить фильтр барометра (вес IIR, alpha, beta; 0 - оставить прежнее)
+K41 - Настроить порог изменения фоторезисторов и сохранить в EEPROM (ед. АЦП: одно значение для всех каналов или 8; без параметров - вывести)
 K42 - Вывести значения фоторезисторов
-K43 - Вывести сырые значения фоторезисторов
+K43 - Вывести сырые и отфильтрованные значения фоторезисторов
+K44 - Сравнить быстрый скан фоторезисторов с библиотекой MCP3008 (время 8 каналов, расхождение)
+K45 - Настроить непрерывный опрос фоторезисторов по таймеру (период (мкс), 0 - выключить)
+K46 - Настроить обработку фоторезисторов (передискретизация 4^n: n 0-3; фильтр: 0 - нет, 1 - среднее, 2 - IIR; сдвиг)
+K47 - Вывести направление на Солнце по фоторезисторам
+K48 - Наведение панели на Солнце (панель 1-4, 0 - выключить)
+K49 - Настроить регулятор наведения и сохранить в EEPROM (Kp, Ki, Kd; отрицательное - оставить прежнее)
 K70 - Вывести калибровочные значение для фоторезисторов
 K71 - Ввести калибровочные значение для фоторезисторов (16 чисел float)
 K72 - Сохранить калибровочные значение для фоторезисторов в EEPROM
+K73 - Ввести таблицу линеаризации фоторезисторов (1 и 9 значений АЦП в точках 0, 128 ... 1024; 0 - выключить)
 */
 void serialRequest() {
     while(Serial.available()) {
@@ -303,13 +1245,33 @@ void serialRequest() {
             switch (request) {
                 case 1:  serialRequest_1();  break;
                 case 10: serialRequest_10(); break;
+                case 11: serialRequest_11(); break;
+                case 12: serialRequest_12(); break;
+                case 13: serialRequest_13(); break;
+                case 14: serialRequest_14(); break;
+                case 15: serialRequest_15(); break;
+                case 16: serialRequest_16(); break;
+                case 17: serialRequest_17(); break;
+                case 18: serialRequest_18(); break;
+                case 19: serialRequest_19(); break;
                 case 31: serialRequest_31(); break;
+                case 33: serialRequest_33(); break;
+                case 34: serialRequest_34(); break;
                 case 35: serialRequest_35(); break;
+                case 37: serialRequest_37(); break;
+                case 41: serialRequest_41(); break;
                 case 42: serialRequest_42(); break;
                 case 43: serialRequest_43(); break;
+                case 44: serialRequest_44(); break;
+                case 45: serialRequest_45(); break;
+                case 46: serialRequest_46(); break;
+                case 47: serialRequest_47(); break;
+                case 48: serialRequest_48(); break;
+                case 49: serialRequest_49(); break;
                 case 70: serialRequest_70(); break;
                 case 71: serialRequest_71(); break;
                 case 72: serialRequest_72(); break;
+                case 73: serialRequest_73(); break;
                 default: serialRequestIndefined(request);
             }
             while(Serial.available() && Serial.read() != '\n') {}
@@ -322,11 +1284,107 @@ void serialRequest_1() {
 }
 void serialRequest_10() {
     calibrationPht();
+    compilePhtCalib();
+}
+void serialRequest_11() {
+    mgnCalibStart();
+    Serial.print(F("Калибровка магнитометра запущена, вращайте спутник\n"));
+    Serial.print(F("OK\n"));
+}
+void serialRequest_12() {
+    // Состояние: 0 - не запускалась, 1 - идёт, 2 - завершена, 3 - ошибка
+    Serial.print(F("Состояние: "));
+    Serial.print(mgnFit.state);
+    Serial.print(F("\nОтсчёты, октанты: "));
+    Serial.print(mgnFit.samples); Serial.print(' '); Serial.println(mgnFit.octants, BIN);
+    Serial.print(F("Невязка, радиус: "));
+    Serial.print(mgnFit.residual, 4); Serial.print(' '); Serial.print(mgnFit.radius, 4);
+    Serial.print(F(" Гаус\nСмещение (X) (Y) (Z): "));
+    for (uint8_t i = 0; i < 3; ++i) { Serial.print(mgnCalib.bias[i], 4); Serial.print(' '); }
+    Serial.print(F("Гаус\nМатрица:\n"));
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t j = 0; j < 3; ++j) { Serial.print(mgnCalib.matrix[i][j], 4); Serial.print(' '); }
+        Serial.print('\n');
+    }
+    Serial.print(F("OK\n"));
+}
+void serialRequest_13() {
+    mgnCalib = {{0, 0, 0}, {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+    saveMgnCalibration();
+    mgnFit.state = MGN_CALIB_IDLE;
+    Serial.print(F("OK\n"));
+}
+void serialRequest_14() {
+    Serial.print(F("Смещение гироскопа (X) (Y) (Z): "));
+    for (uint8_t i = 0; i < 3; ++i) { Serial.print(gyroBias[i] * GYRO_SCALE, 3); Serial.print(' '); }
+    Serial.print(F("°/с\nТемпература: "));
+    Serial.print(temp);
+    Serial.print(F(" °C\nОкон принято, отброшено: "));
+    Serial.print(gyroBiasStats.accepted); Serial.print(' '); Serial.println(gyroBiasStats.rejected);
+    if (gyroBiasStats.accepted) {
+        Serial.print(F("Последняя оценка (X) (Y) (Z): "));
+        for (uint8_t i = 0; i < 3; ++i) { Serial.print(gyroBiasStats.estimate[i] * GYRO_SCALE, 3); Serial.print(' '); }
+        Serial.print(F("°/с\nСКО оценки (X) (Y) (Z): "));
+        for (uint8_t i = 0; i < 3; ++i) { Serial.print(gyroBiasStats.error[i], 4); Serial.print(' '); }
+        Serial.print(F("°/с\nТемпература оценки: "));
+        Serial.print(gyroBiasStats.temp);
+        Serial.print(F(" °C, прошло: "));
+        Serial.print((millis() - gyroBiasStats.millis) / 1000);
+        Serial.print(F(" с\n"));
+    }
+    Serial.print(F("OK\n"));
+}
+void serialRequest_15() {
+    // Температура ячейки (°C), вес, смещение (X) (Y) (Z) (°/с); пустые ячейки не выводятся
+    for (uint8_t cell = 0; cell < GYRO_TABLE_SIZE; ++cell) {
+        if (!gyroBiasTable[cell].weight) { continue; }
+        Serial.print(GYRO_TABLE_MIN + cell * GYRO_TABLE_STEP);
+        Serial.print(' '); Serial.print(gyroBiasTable[cell].weight);
+        for (uint8_t i = 0; i < 3; ++i) { Serial.print(' '); Serial.print(gyroBiasTable[cell].bias[i] / 16.0f * GYRO_SCALE, 3); }
+        Serial.print('\n');
+    }
+    Serial.print(F("OK\n"));
+}
+void serialRequest_16() {
+    memset(gyroBiasTable, 0, sizeof(gyroBiasTable));
+    gyroBiasDirty = (1UL << GYRO_TABLE_SIZE) - 1;
+    saveGyroBiasTable();
+    memset(gyroBias, 0, sizeof(gyroBias));
+    Serial.print(F("OK\n"));
+}
+void serialRequest_17() {
+    int32_t level = Serial.parseInt();
+    float reference = Serial.parseFloat();
+    int32_t duration = Serial.parseInt();
+    if (level < 0 || level > 1 || duration < 0 || duration > PHT_BATCH_TIME_MAX) {
+        Serial.print(F("Некорректные параметры команды\n"));
+        return;
+    }
+    if (!phtBatchStart(level, reference, duration ? duration : PHT_BATCH_TIME)) {
+        Serial.print(F("Калибровка уже идёт\n"));
+        return;
+    }
+    // Строка PHTCAL будет выведена, когда уровень будет снят
+    Serial.print(F("OK\n"));
+}
+void serialRequest_18() {
+    printPhtBatch();
+    Serial.print(F("OK\n"));
+}
+void serialRequest_19() {
+    memset(&phtBatch, 0, sizeof(phtBatch));
+    Serial.print(F("OK\n"));
 }
 void serialRequest_31() {
     Serial.print(F("Давление: "));
     Serial.print(press);
-    Serial.print(F(" Па\nТемпература: "));
+    Serial.print(F(" Па\nДавление после фильтра: "));
+    Serial.print(pressFiltered);
+    Serial.print(F(" Па\nВысота: "));
+    Serial.print(altitude);
+    Serial.print(F(" м\nВертикальная скорость: "));
+    Serial.print(verticalSpeed);
+    Serial.print(F(" м\\с\nТемпература: "));
     Serial.print(temp);
     Serial.print(F(" °C\nВектор ускорения (X) (Y) (Z): "));
     Serial.print(acl.x); Serial.print(' '); Serial.print(acl.y); Serial.print(' '); Serial.print(acl.z);
@@ -334,14 +1392,127 @@ void serialRequest_31() {
     Serial.print(mgn.x); Serial.print(' '); Serial.print(mgn.y); Serial.print(' '); Serial.print(mgn.z);
     Serial.print(F(" мГаус\nВектор угловой скорости (X) (Y) (Z): "));
     Serial.print(gyro.x); Serial.print(' '); Serial.print(gyro.y); Serial.print(' '); Serial.print(gyro.z);
-    Serial.print(F(" °\\с\n"));
+    Serial.print(F(" °\\с\nАзимут: "));
+    Serial.print(azimut);
+    Serial.print(F(" °\nВремя опроса IMU (последнее) (максимальное): "));
+    Serial.print(imuReadMicros); Serial.print(' '); Serial.print(imuReadMicrosMax);
+    Serial.print(F(" мкс\n"));
+    // Для акселерометра, магнитометра и барометра: отсчёты, пустые опросы, потерянные отсчёты
+    const SensorPoll *polls[3] = {&aclPoll, &mgnPoll, &baroPoll};
+    Serial.print(F("Опрос по готовности (отсчёты) (пустые) (потери):\n"));
+    for (uint8_t i = 0; i < 3; ++i) {
+        Serial.print(polls[i]->samples); Serial.print(' ');
+        Serial.print(polls[i]->misses); Serial.print(' ');
+        Serial.println(polls[i]->overruns);
+    }
     printMillisTime(millis());
     Serial.print(F("OK\n"));
 }
+void serialRequest_33() {
+    // Фактическая частота отсчётов и потери
+    Serial.print(F("Частота гироскопа: "));
+    Serial.print(gyroSampleCount * 1e6f / (micros() - gyroFifoStartMicros));
+    Serial.print(F(" Гц\nПереполнений FIFO: "));
+    Serial.println(gyroFifoOverruns);
+
+    // Отсчёты от старого к новому: время (мкс), угловая скорость (X) (Y) (Z) (°/с)
+    uint8_t count = min(gyroSampleCount, static_cast<uint32_t>(GYRO_RING_SIZE));
+    float mean[3] = {}, square[3] = {};
+    for (uint8_t i = 0; i < count; ++i) {
+        const GyroSample &sample = gyroRing[(gyroRingHead + GYRO_RING_SIZE - count + i) % GYRO_RING_SIZE];
+        float value[3] = {sample.x * GYRO_SCALE, sample.y * GYRO_SCALE, sample.z * GYRO_SCALE};
+        Serial.print(sample.time);
+        for (uint8_t q = 0; q < 3; ++q) {
+            Serial.print(' '); Serial.print(value[q]);
+            mean[q] += value[q];
+            square[q] += value[q]*value[q];
+        }
+        Serial.print('\n');
+    }
+    if (count) {
+        // Среднее - скорость вращения, СКО - вибрации
+        Serial.print(F("Средняя угловая скорость (X) (Y) (Z): "));
+        for (uint8_t q = 0; q < 3; ++q) { Serial.print(mean[q] / count); Serial.print(' '); }
+        Serial.print(F("°/с\nСКО (X) (Y) (Z): "));
+        for (uint8_t q = 0; q < 3; ++q) {
+            float m = mean[q] / count;
+            Serial.print(sqrt(max(square[q] / count - m*m, 0.0f))); Serial.print(' ');
+        }
+        Serial.print(F("°/с\n"));
+    }
+    Serial.print(F("OK\n"));
+}
+void serialRequest_34() {
+    float frequency = Serial.parseFloat();
+    float beta = Serial.parseFloat();
+    if (frequency < 0 || frequency > AHRS_FREQUENCY_MAX || beta < 0) {
+        Serial.print(F("Некорректные параметры команды\n"));
+        return;
+    }
+    if (frequency > 0) { ahrsFrequency = frequency; }
+    if (beta > 0) { ahrsBeta = beta; }
+    ahrs.setSettings(ahrsBeta);
+    ahrs.setFrequency(ahrsFrequency);
+
+    Serial.print(ahrsFrequency); Serial.print(' '); Serial.println(ahrsBeta, 4);
+    Serial.print(F("OK\n"));
+}
 void serialRequest_35() {
-    //Serial.print(F("Угол Эйлера (X) (Y) (Z): "));
-    //Serial.print(rotateAngle.x); Serial.print(' '); Serial.print(rotateAngle.y); Serial.print(' '); Serial.print(rotateAngle.z);
-    //Serial.print(F(" °\nOK\n"));
+    Serial.print(F("Кватернион (W) (X) (Y) (Z): "));
+    for (uint8_t i = 0; i < 4; ++i) { Serial.print(quaternion[i], 4); Serial.print(' '); }
+    Serial.print(F("\nУгол Эйлера (X) (Y) (Z): "));
+    Serial.print(rotateAngle.x); Serial.print(' '); Serial.print(rotateAngle.y); Serial.print(' '); Serial.print(rotateAngle.z);
+    Serial.print(F(" °\nЧастота фильтра: "));
+    Serial.print(ahrsFrequency);
+    Serial.print(F(" Гц, beta: "));
+    Serial.println(ahrsBeta, 4);
+    Serial.print(F("OK\n"));
+}
+void serialRequest_37() {
+    float iir = Serial.parseFloat();
+    float alpha = Serial.parseFloat();
+    float beta = Serial.parseFloat();
+    if (iir < 0 || iir > 1 || alpha < 0 || alpha > 1 || beta < 0 || beta > 1) {
+        Serial.print(F("Некорректные параметры команды\n"));
+        return;
+    }
+    if (iir > 0) { baro.iir = iir; }
+    if (alpha > 0) { baro.alpha = alpha; }
+    if (beta > 0) { baro.beta = beta; }
+
+    Serial.print(baro.iir, 3); Serial.print(' ');
+    Serial.print(baro.alpha, 3); Serial.print(' ');
+    Serial.println(baro.beta, 3);
+    Serial.print(F("OK\n"));
+}
+void serialRequest_41() {
+    float deadband[8];
+    uint8_t count = 0;
+    while (count < 8) {
+        while (Serial.peek() == ' ') { Serial.read(); }
+        if (!Serial.available() || Serial.peek() == '\n' || Serial.peek() == '\r') { break; }
+        deadband[count] = Serial.parseFloat();
+        if (deadband[count] < 0 || deadband[count] > 1023) {
+            Serial.print(F("Некорректные параметры команды\n"));
+            return;
+        }
+        ++count;
+    }
+    if (count != 0 && count != 1 && count != 8) {
+        Serial.print(F("Некорректные параметры команды\n"));
+        return;
+    }
+    if (count) {
+        for (uint8_t i = 0; i < 8; ++i) { phtDeadband[i] = lround(deadband[count == 1 ? 0 : i] * 64); }
+        config.save(CONFIG_PHT_DEADBAND);
+    }
+
+    Serial.print(F("Порог (ед. АЦП): "));
+    for (uint8_t i = 0; i < 8; ++i) { Serial.print(phtDeadband[i] / 64.0f); Serial.print(' '); }
+    Serial.print(F("\nИзменившиеся каналы, число изменений: "));
+    Serial.print(phtChangedMask, BIN); Serial.print(' ');
+    Serial.println(phtChangeSeq);
+    Serial.print(F("OK\n"));
 }
 void serialRequest_42() {
     for (uint8_t i = 0; i < 8; ++i) {
@@ -357,10 +1528,111 @@ void serialRequest_43() {
         Serial.print(F("Значение АЦП фоторезистора ("));
         Serial.print(i + 1);
         Serial.print(F("): "));
-        Serial.println(phtValues[i]);
+        Serial.print(phtValues[i]);
+        Serial.print(' ');
+        Serial.println(phtFiltered[i] / 64.0f, 2);
+    }
+    Serial.print(F("Номер отсчёта: "));
+    Serial.println(phtFilterSeq);
+    Serial.print(F("OK\n"));
+}
+void serialRequest_44() {
+    // мкс на скан библиотекой, мкс на быстрый скан, ускорение, расхождение (ед. АЦП)
+    float libMicros, fastMicros;
+    uint16_t maxDiff;
+    phtBench(libMicros, fastMicros, maxDiff);
+    Serial.print(libMicros);
+    Serial.print(' '); Serial.print(fastMicros);
+    Serial.print(' '); Serial.print(libMicros / fastMicros);
+    Serial.print(' '); Serial.println(maxDiff);
+    Serial.print(F("OK\n"));
+}
+void serialRequest_45() {
+    int32_t period = Serial.parseInt();
+    if (period < 0 || period > PHT_SCAN_PERIOD_MAX) {
+        Serial.print(F("Некорректные параметры команды\n"));
+        return;
+    }
+    setPhtScanPeriod(period);
+    Serial.print(phtScanPeriod);
+    Serial.print(F(" мкс\n"));
+
+    if (phtScanPeriod) {
+        // Проверка: число сканов за 100 мс
+        noInterrupts(); uint16_t count = phtScanCount; interrupts();
+        delay(100);
+        noInterrupts(); count = phtScanCount - count; interrupts();
+        Serial.print(F("Сканов за 100 мс: "));
+        Serial.println(count);
+    }
+    Serial.print(F("OK\n"));
+}
+void serialRequest_46() {
+    PhtFilterSettings settings;
+    settings.oversampling = Serial.parseInt();
+    settings.mode = Serial.parseInt();
+    settings.shift = Serial.parseInt();
+    if (!setPhtFilter(settings)) {
+        Serial.print(F("Некорректные параметры команды\n"));
+        return;
+    }
+    // Сканов на отсчёт, фильтр, сдвиг, период прореженных отсчётов (мс)
+    uint8_t scans = 1 << 2 * phtFilter.oversampling;
+    Serial.print(scans); Serial.print(' ');
+    Serial.print(phtFilter.mode); Serial.print(' ');
+    Serial.print(phtFilter.shift); Serial.print(' ');
+    Serial.println(phtScanPeriod ? scans * phtScanPeriod / 1000.0f : scans * phtTimeInterval);
+    Serial.print(F("OK\n"));
+}
+void serialRequest_47() {
+    Serial.print(F("Солнце (X) (Y) (Z): "));
+    Serial.print(sunVector.x, 3); Serial.print(' ');
+    Serial.print(sunVector.y, 3); Serial.print(' ');
+    Serial.print(sunVector.z, 3);
+    Serial.print(F("\nАзимут, высота: "));
+    Serial.print(atan2(sunVector.y, sunVector.x) * RAD_TO_DEG); Serial.print(' ');
+    Serial.print(asin(constrain(sunVector.z, -1.0f, 1.0f)) * RAD_TO_DEG);
+    Serial.print(F(" °\nУверенность, освещённость: "));
+    Serial.print(sunConfidence, 3); Serial.print(' ');
+    Serial.println(sunIntensity);
+    Serial.print(F("Номер отсчёта: "));
+    Serial.println(sunSeq);
+    Serial.print(F("OK\n"));
+}
+void serialRequest_48() {
+    int32_t panel = Serial.parseInt();
+    if (panel < 0 || panel > 4) {
+        Serial.print(F("Некорректные параметры команды\n"));
+        return;
+    }
+    setSunTrack(panel ? panel - 1 : 0xFF);
+    if (sunTrackMode == SUN_TRACK_OFF) { Serial.print(F("Наведение выключено\n")); }
+    else {
+        Serial.print(F("Наведение панели "));
+        Serial.print(sunTrackPanel + 1);
+        Serial.print(F(", ошибка: "));
+        Serial.print(sunTrackError * RAD_TO_DEG);
+        Serial.print(F(" °, команда: "));
+        Serial.println(sunTrack.output, 3);
     }
     Serial.print(F("OK\n"));
 }
+void serialRequest_49() {
+    float gain[3];
+    for (uint8_t i = 0; i < 3; ++i) {
+        gain[i] = Serial.available() ? Serial.parseFloat() : -1;
+    }
+    if (gain[0] >= 0) { sunTrackGains.kp = gain[0]; }
+    if (gain[1] >= 0) { sunTrackGains.ki = gain[1]; }
+    if (gain[2] >= 0) { sunTrackGains.kd = gain[2]; }
+    sunTrack.integral = 0;
+    if (gain[0] >= 0 || gain[1] >= 0 || gain[2] >= 0) { config.save(CONFIG_SUN_TRACK); }
+
+    Serial.print(sunTrackGains.kp, 3); Serial.print(' ');
+    Serial.print(sunTrackGains.ki, 3); Serial.print(' ');
+    Serial.println(sunTrackGains.kd, 3);
+    Serial.print(F("OK\n"));
+}
 void serialRequest_70() {
     for (uint8_t i = 0; i < 8; ++i) {
         Serial.print(F("Диапазон измерений фоторезистора ("));
@@ -370,7 +1642,12 @@ void serialRequest_70() {
         Serial.print(' ');
         Serial.println(phtCalibRange[i].max);
     }
-    Serial.print(F("OK\n"));
+    Serial.print(F("Таблица линеаризации (АЦП): "));
+    if (!phtCalib.useLut) { Serial.print(F("выключена")); }
+    for (uint8_t j = 0; phtCalib.useLut && j <= PHT_CALIB_LUT_SEGMENTS; ++j) {
+        Serial.print(phtCalib.lut[j] / 64.0f); Serial.print(' ');
+    }
+    Serial.print(F("\nOK\n"));
 }
 void serialRequest_71() {
     Range tempPhtCalibRange[8] = {};
@@ -385,6 +1662,7 @@ void serialRequest_71() {
         phtCalibRange[i].min = tempPhtCalibRange[i].min;
         phtCalibRange[i].max = tempPhtCalibRange[i].max;
     }
+    compilePhtCalib();
 
     Serial.print(F("OK\n"));
 }
@@ -392,6 +1670,30 @@ void serialRequest_72() {
     savePhtCalibRange();
     Serial.print(F("OK\n"));
 }
+void serialRequest_73() {
+    // 1 и 9 значений АЦП в точках 0, 128 ... 1024 или 0 - выключить
+    int32_t enable = Serial.parseInt();
+    if (enable == 1) {
+        uint16_t lut[PHT_CALIB_LUT_SEGMENTS + 1];
+        for (uint8_t j = 0; j <= PHT_CALIB_LUT_SEGMENTS; ++j) {
+            float value = Serial.parseFloat();
+            if (value < 0 || value > 1024 || (j && value * 64 < lut[j - 1])) {
+                Serial.print(F("Некорректные параметры команды\n"));
+                return;
+            }
+            lut[j] = min(lround(value * 64), 65535L);
+        }
+        memcpy(phtCalib.lut, lut, sizeof(lut));
+        phtCalib.useLut = true;
+    }
+    else if (enable == 0) { PhtCalib_resetLut(phtCalib); }
+    else {
+        Serial.print(F("Некорректные параметры команды\n"));
+        return;
+    }
+    savePhtLut();
+    Serial.print(F("OK\n"));
+}
 void printMillisTime(uint32_t time) {
     Serial.print(F("Время с момента старта МК: "));
 
@@ -436,33 +1738,91 @@ void serialRequestToManyParam() {
 }
 // Запросы по I2C
 void onReceiveI2C(int count) {
-    while(count) {
-        lastRequestI2C = Wire.read();
-        // lastRequestI2C - номер команды
-        --count;
+    if (count < 1) { return; }
+    // Первый байт - номер команды, за ним - параметры
+    lastRequestI2C = Wire.read();
+    --count;
+    // Запуск калибровки магнитометра, ответа не требует
+    if (lastRequestI2C == 11) {
+        mgnCalibStartRequest = true;
+        lastRequestI2C = 0;
     }
+    // Настройка обработки фоторезисторов: передискретизация, фильтр, сдвиг
+    else if (lastRequestI2C == 45) {
+        if (count >= 3) {
+            phtFilterRequest.oversampling = Wire.read();
+            phtFilterRequest.mode = Wire.read();
+            phtFilterRequest.shift = Wire.read();
+            count -= 3;
+            phtFilterRequestPending = true;
+        }
+        lastRequestI2C = 0;
+    }
+    while(count) { Wire.read(); --count; }
 }
 void onRequestI2C() {
     switch (lastRequestI2C) {
-    case 31: { // Отправка данных IMU часть 1
-        uint8_t data[24];
+    case 31: { // Отправка данных IMU часть 1, номер и момент отсчёта
+        uint8_t data[30];
         memcpy(data, &press, 4);
         memcpy(data+4, &temp, 4);
         memcpy(data+8, &gyro.x, 4);
         memcpy(data+12, &gyro.y, 4);
         memcpy(data+16, &gyro.z, 4);
         memcpy(data+20, &acl.x, 4);
-        for (uint8_t i = 0; i < 24; ++i) { Wire.write(data[i]); }
+        memcpy(data+24, &imuSeq, 2);
+        memcpy(data+26, &imuSampleMicros, 4);
+        for (uint8_t i = 0; i < 30; ++i) { Wire.write(data[i]); }
         break;
     }
-    case 32: { // Отправка данных IMU часть 2
-        uint8_t data[20];
+    case 32: { // Отправка данных IMU часть 2, номер отсчёта - для проверки, что части от одного
+        uint8_t data[22];
         memcpy(data+0, &acl.y, 4);
         memcpy(data+4, &acl.z, 4);
         memcpy(data+8, &mgn.x, 4);
         memcpy(data+12, &mgn.y, 4);
         memcpy(data+16, &mgn.z, 4);
-        for (uint8_t i = 0; i < 20; ++i) { Wire.write(data[i]); }
+        memcpy(data+20, &imuSeq, 2);
+        for (uint8_t i = 0; i < 22; ++i) { Wire.write(data[i]); }
+        break;
+    }
+    case 12: { // Отправка состояния калибровки магнитометра
+        uint8_t data[24];
+        data[0] = mgnFit.state;
+        data[1] = mgnFit.octants;
+        memcpy(data+2, &mgnFit.samples, 2);
+        memcpy(data+4, &mgnFit.residual, 4);
+        memcpy(data+8, &mgnFit.radius, 4);
+        memcpy(data+12, mgnCalib.bias, 12);
+        for (uint8_t i = 0; i < 24; ++i) { Wire.write(data[i]); }
+        break;
+    }
+    case 35: { // Отправка ориентации: кватернион и углы Эйлера
+        uint8_t data[28];
+        memcpy(data, quaternion, 16);
+        memcpy(data+16, &rotateAngle.x, 4);
+        memcpy(data+20, &rotateAngle.y, 4);
+        memcpy(data+24, &rotateAngle.z, 4);
+        for (uint8_t i = 0; i < 28; ++i) { Wire.write(data[i]); }
+        break;
+    }
+    case 37: { // Отправка данных барометра: сырые и отфильтрованные, номер и момент отсчёта
+        uint8_t data[26];
+        memcpy(data, &press, 4);
+        memcpy(data+4, &temp, 4);
+        memcpy(data+8, &pressFiltered, 4);
+        memcpy(data+12, &altitude, 4);
+        memcpy(data+16, &verticalSpeed, 4);
+        memcpy(data+20, &baroSeq, 2);
+        memcpy(data+22, &baroSampleMicros, 4);
+        for (uint8_t i = 0; i < 26; ++i) { Wire.write(data[i]); }
+        break;
+    }
+    case 39: { // Отправка текущего micros() для привязки часов БК
+        uint32_t now = micros();
+        uint8_t data[4];
+        memcpy(data, &now, 4);
+        for (uint8_t i = 0; i < 4; ++i) { Wire.write(data[i]); }
         break;
     }
     case 43: { // Отправка данных с АЦП
@@ -471,6 +1831,42 @@ void onRequestI2C() {
         for (uint8_t i = 0; i < 16; ++i) { Wire.write(data[i]); }
         break;
     }
+    case 44: { // Отправка отфильтрованных значений фоторезисторов, номера отсчёта и настроек
+        uint8_t data[21];
+        memcpy(data, phtFiltered, 16);
+        memcpy(data+16, &phtFilterSeq, 2);
+        data[18] = phtFilter.oversampling;
+        data[19] = phtFilter.mode;
+        data[20] = phtFilter.shift;
+        for (uint8_t i = 0; i < 21; ++i) { Wire.write(data[i]); }
+        break;
+    }
+    case 46: { // Отправка направления на Солнце, уверенности и номера отсчёта фоторезисторов
+        uint8_t data[18];
+        memcpy(data, &sunVector.x, 4);
+        memcpy(data+4, &sunVector.y, 4);
+        memcpy(data+8, &sunVector.z, 4);
+        memcpy(data+12, &sunConfidence, 4);
+        memcpy(data+16, &sunSeq, 2);
+        for (uint8_t i = 0; i < 18; ++i) { Wire.write(data[i]); }
+        break;
+    }
+    case 47: { // Отправка состояния фоторезисторов: изменившиеся каналы (маска сбрасывается), число изменений, номер отсчёта
+        uint8_t data[5];
+        data[0] = phtChangedMask;
+        memcpy(data+1, &phtChangeSeq, 2);
+        memcpy(data+3, &phtFilterSeq, 2);
+        phtChangedMask = 0;
+        for (uint8_t i = 0; i < 5; ++i) { Wire.write(data[i]); }
+        break;
+    }
+    case 71: { // Отправка таблицы линеаризации фоторезисторов: признак и узлы
+        uint8_t data[1 + sizeof(phtCalib.lut)];
+        data[0] = phtCalib.useLut;
+        memcpy(data+1, phtCalib.lut, sizeof(phtCalib.lut));
+        for (uint8_t i = 0; i < sizeof(data); ++i) { Wire.write(data[i]); }
+        break;
+    }
     case 70: { // Отправка диапазона измерений фоторезисторов
         uint8_t data[4];
         for (uint8_t i = 0; i < 8; ++i) {
@@ -491,24 +1887,57 @@ void setup() {
     Serial.print(F("BUSOS is ready...\n"));
 
     setupIMU();
+    setupAhrs();
+    setupSunSensor();
+    mcp3008Fast.begin();
+    setPhtScanPeriod(PHT_SCAN_PERIOD_DEFAULT);
+    loadConfig();
     
     // Инициализация I2C
     Wire.begin(I2C_BUSOS);
+    // Wire.begin() тоже возвращает 100 кГц, быстрый режим для чтения датчиков
+    Wire.setClock(I2C_CLOCK);
     Wire.onRequest(onRequestI2C);
     Wire.onReceive(onReceiveI2C);
 
-    uint32_t imuTimeMark = imuTimeInterval + millis();
     uint32_t phtTimeMark = phtTimeInterval + millis();
+    uint32_t ahrsTimeMark = micros();
+    uint32_t sunTrackTimeMark = millis();
 
     while(true) {
-        if (imuTimeMark < millis()) {
-            updateIMUData();
-            imuTimeMark = millis() + imuTimeInterval;
+        // Датчики читаются, когда у них готов новый отсчёт
+        updateIMUData();
+        if ((int32_t)(micros() - ahrsTimeMark) >= 0) {
+            updateAhrs();
+            ahrsTimeMark += static_cast<uint32_t>(1e6f / ahrsFrequency);
+            if ((int32_t)(micros() - ahrsTimeMark) >= 0) { ahrsTimeMark = micros(); }
         }
-        if (phtTimeMark < millis()) {
-            updatePhtValues();
+        // Без непрерывного опроса сканы идут из цикла
+        if (!phtScanPeriod && phtTimeMark < millis()) {
+            scanPhtValues();
             phtTimeMark = millis() + phtTimeInterval;
         }
+        if (phtSampleReady) {
+            phtSampleReady = false;
+            updatePhtValues();
+            updatePhtChanges();
+            updateSunVector();
+            phtBatchUpdate();
+        }
+        // Регулятор наведения с постоянным периодом
+        if (sunTrackMode != SUN_TRACK_OFF && millis() - sunTrackTimeMark >= SUN_TRACK_PERIOD) {
+            sunTrackTimeMark += SUN_TRACK_PERIOD;
+            if (millis() - sunTrackTimeMark >= SUN_TRACK_PERIOD) { sunTrackTimeMark = millis(); }
+            updateSunTrack();
+        }
+        if (mgnCalibStartRequest) {
+            mgnCalibStartRequest = false;
+            mgnCalibStart();
+        }
+        if (phtFilterRequestPending) {
+            phtFilterRequestPending = false;
+            setPhtFilter(phtFilterRequest);
+        }
         if (Serial.available()) {
             serialRequest();
         }
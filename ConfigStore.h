@@ -0,0 +1,149 @@
+#ifndef __CONFIG_STORE_H__
+#define __CONFIG_STORE_H__
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+/* Хранилище настроек в EEPROM: записи с ключом, версией и CRC.
+   - запись занимает slots ячеек подряд, сохранение идёт в следующую ячейку
+     по кругу (копия при записи): износ делится на число ячеек, а если питание
+     пропало во время записи, остаётся предыдущая копия
+   - ячейка: ключ, версия, номер сохранения, данные, CRC-16/CCITT по всему этому
+   - при загрузке берётся ячейка с верной CRC, тем же ключом и версией
+     и самым новым номером. Чистая EEPROM (0xFF) и данные в другом формате
+     проверку не проходят, переменная остаётся со значением по умолчанию
+   - begin() копирует данные прямо в переменные скетча, дальше они читаются
+     из RAM, EEPROM трогает только save()
+   Ячейки идут по порядку записей в таблице, адреса не хранятся, а считаются:
+   адрес записи зависит от размеров и числа копий всех записей перед ней.
+   Поэтому новые записи добавляются только в конец. Изменение размера или
+   числа копий записи сдвигает все следующие: они не пройдут проверку и
+   вернутся к значениям по умолчанию. При изменении структуры данных
+   увеличивается версия. Размер записи - до 255 байт (проверяется при сборке).
+   Общий для БУСОС, БК и СЭП */
+
+#define CONFIG_STORE_OVERHEAD 5 // Ключ, версия, номер, CRC
+#define CONFIG_STORE_SLOTS_MAX 8
+
+struct ConfigEntry {
+    uint8_t key;
+    uint8_t version;
+    uint8_t slots; // 1..CONFIG_STORE_SLOTS_MAX
+    uint8_t size;  // Байт данных, до 255
+    void *data;    // Переменная в RAM
+};
+// Размер данных записи, больше 255 байт - ошибка сборки
+template <size_t SIZE>
+struct ConfigEntrySize {
+    static_assert(SIZE > 0 && SIZE <= 255, "ConfigStore: запись больше 255 байт");
+    static const uint8_t value = SIZE;
+};
+#define CONFIG_SIZE(size) ConfigEntrySize<(size)>::value
+#define CONFIG_ENTRY(key, version, slots, variable) { key, version, slots, CONFIG_SIZE(sizeof(variable)), &(variable) }
+
+inline uint16_t ConfigStore_crc16(uint16_t crc, uint8_t byte) {
+    crc ^= static_cast<uint16_t>(byte) << 8;
+    for (uint8_t i = 0; i < 8; ++i) {
+        crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+template <uint8_t N>
+class ConfigStore {
+public:
+    ConfigStore(const ConfigEntry *entries, uint16_t address) : _entries(entries), _address(address) {}
+
+    // Загрузка всех записей, бит i результата - запись i загружена
+    uint32_t begin() {
+        uint32_t loaded = 0;
+        for (uint8_t i = 0; i < N; ++i) {
+            const ConfigEntry &entry = _entries[i];
+            _slot[i] = 0xFF;
+            _seq[i] = 0;
+            for (uint8_t slot = 0; slot < entry.slots; ++slot) {
+                uint8_t seq;
+                if (!checkSlot(entry, slotAddress(i, slot), seq)) { continue; }
+                // Номер растёт по модулю 256, ячеек не больше 8 - новее та, что впереди
+                if (_slot[i] == 0xFF || static_cast<int8_t>(seq - _seq[i]) > 0) {
+                    _slot[i] = slot;
+                    _seq[i] = seq;
+                }
+            }
+            if (_slot[i] == 0xFF) { continue; }
+
+            uint16_t address = slotAddress(i, _slot[i]) + 3;
+            uint8_t *data = static_cast<uint8_t *>(entry.data);
+            for (uint8_t j = 0; j < entry.size; ++j) { data[j] = EEPROM.read(address + j); }
+            loaded |= 1UL << i;
+        }
+        return loaded;
+    }
+
+    // Есть ли сохранённая копия записи
+    bool loaded(uint8_t key) const {
+        uint8_t i = find(key);
+        return i < N && _slot[i] != 0xFF;
+    }
+
+    // Сохранение переменной записи в следующую ячейку
+    bool save(uint8_t key) {
+        uint8_t i = find(key);
+        if (i >= N) { return false; }
+        const ConfigEntry &entry = _entries[i];
+        uint8_t slot = _slot[i] == 0xFF ? 0 : (_slot[i] + 1) % entry.slots;
+        uint8_t seq = _seq[i] + 1;
+        uint16_t address = slotAddress(i, slot);
+
+        // Недописанная ячейка не пройдёт проверку CRC, останется предыдущая копия
+        const uint8_t header[3] = { entry.key, entry.version, seq };
+        uint16_t crc = 0xFFFF;
+        for (uint8_t j = 0; j < 3; ++j) {
+            EEPROM.update(address++, header[j]);
+            crc = ConfigStore_crc16(crc, header[j]);
+        }
+        const uint8_t *data = static_cast<const uint8_t *>(entry.data);
+        for (uint8_t j = 0; j < entry.size; ++j) {
+            EEPROM.update(address++, data[j]);
+            crc = ConfigStore_crc16(crc, data[j]);
+        }
+        EEPROM.update(address++, crc >> 8);
+        EEPROM.update(address, crc & 0xFF);
+
+        _slot[i] = slot;
+        _seq[i] = seq;
+        return true;
+    }
+
+    // Первый адрес после хранилища
+    uint16_t end() const { return slotAddress(N - 1, _entries[N - 1].slots); }
+
+private:
+    const ConfigEntry *_entries;
+    uint16_t _address;
+    uint8_t _slot[N]; // Ячейка с последней копией, 0xFF - нет
+    uint8_t _seq[N];
+
+    uint8_t find(uint8_t key) const {
+        uint8_t i = 0;
+        while (i < N && _entries[i].key != key) { ++i; }
+        return i;
+    }
+    uint16_t slotAddress(uint8_t index, uint8_t slot) const {
+        uint16_t address = _address;
+        for (uint8_t i = 0; i < index; ++i) {
+            address += _entries[i].slots * (_entries[i].size + CONFIG_STORE_OVERHEAD);
+        }
+        return address + slot * (_entries[index].size + CONFIG_STORE_OVERHEAD);
+    }
+    bool checkSlot(const ConfigEntry &entry, uint16_t address, uint8_t &seq) const {
+        if (EEPROM.read(address) != entry.key || EEPROM.read(address + 1) != entry.version) { return false; }
+        seq = EEPROM.read(address + 2);
+        uint16_t crc = 0xFFFF;
+        for (uint16_t j = 0; j < 3U + entry.size; ++j) { crc = ConfigStore_crc16(crc, EEPROM.read(address + j)); }
+        address += 3 + entry.size;
+        return crc == (static_cast<uint16_t>(EEPROM.read(address)) << 8 | EEPROM.read(address + 1));
+    }
+};
+
+#endif // __CONFIG_STORE_H__
@@ -1,11 +1,32 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include <string.h>
+#include "PulseScan.h"
 
 #define ADC_BUFFER_SIZE 1024   // halfWord (uint16_t)
 #define STAMP_BUFFER_SIZE 1024 // halfWord (uint16_t)
 
-// Cyrcle adc buffer
-volatile uint16_t adcBuffer[ADC_BUFFER_SIZE];
+/* Pulse-height histogram: peak of every detected pulse (12 bit) goes to bin peak >> (12 - log2(bins)).
+   Two buffers: the active one is filled by the DMA callbacks, the latched one is read over I2C.
+   Latch swaps them in one store, so every pulse lands in exactly one snapshot.
+   I2C interrupts have lower priority than DMA and never split a scan.
+   I2C commands (one byte written by master, then read):
+   - 0x00: detection count since last read, 4 bytes (also after every other read)
+   - 0x01: latch histogram, read: bins (2), latch number (2), pulses (4), time (4, ms)
+   - 0x10 | n: 2^n bins, n = 6..10, histogram is cleared
+   - 0x80 | k: chunk k of the latched histogram, HIST_CHUNK_BINS bins as uint16 (saturated) */
+#define HIST_BINS_LOG2_MIN 6
+#define HIST_BINS_LOG2_MAX 10
+#define HIST_BINS_LOG2_DEFAULT 8
+#define HIST_CHUNK_BINS 16
+
+#define I2C_CMD_COUNT      0x00
+#define I2C_CMD_HIST_LATCH 0x01
+#define I2C_CMD_HIST_BINS  0x10
+#define I2C_CMD_HIST_CHUNK 0x80
+
+// Cyrcle adc buffer, word aligned for the packed scan
+volatile uint16_t adcBuffer[ADC_BUFFER_SIZE] __attribute__((aligned(4)));
 
 ADC_HandleTypeDef hadc1;
 DMA_HandleTypeDef hdma_adc1;
@@ -20,6 +41,16 @@ static void MX_I2C1_Init(void);
 volatile uint32_t detectionCount = 0;
 uint32_t detectionCountBuf = 0;
 uint8_t reqI2C = 0;
+uint8_t txI2C[HIST_CHUNK_BINS * 2];
+
+uint32_t histogram[2][1 << HIST_BINS_LOG2_MAX];
+volatile uint8_t histActive = 0;
+volatile uint8_t histBinsLog2 = HIST_BINS_LOG2_DEFAULT;
+uint16_t histLatchCount = 0;
+uint32_t histPulses = 0;       // pulses in the active histogram
+uint32_t histLatchedPulses = 0;
+uint32_t histStartTick = 0;
+uint32_t histLatchedTime = 0;  // ms
 
 int main() {
 	// System clock and HAL init
@@ -30,6 +61,9 @@ int main() {
 	MX_DMA_Init();
 	MX_ADC1_Init();
 	MX_I2C1_Init();
+	// I2C must not preempt the DMA callbacks (histogram latch)
+	HAL_NVIC_SetPriority(I2C1_EV_IRQn, 3, 0);
+	HAL_NVIC_SetPriority(I2C1_ER_IRQn, 3, 0);
 
 	HAL_Delay(2000);
 	HAL_ADC_Start_DMA(&hadc1, (uint32_t*) adcBuffer, ADC_BUFFER_SIZE);
@@ -45,34 +79,102 @@ int main() {
 	}
 }
 
+// Count pulses in adcBuffer[begin, end) and histogram their peaks
+static void scanPulses(uint16_t begin, uint16_t end) {
+	uint32_t *hist = histogram[histActive];
+	const uint8_t shift = 12 - histBinsLog2;
+	// DMA is filling the other half, this one is stable until the next callback
+#if PULSE_SCAN_PACKED
+	uint32_t count = scanPulsesPacked(const_cast<const uint16_t*>(adcBuffer) + begin, end - begin, hist, shift);
+#else
+	uint32_t count = scanPulsesScalar(adcBuffer + begin, end - begin, hist, shift);
+#endif
+	detectionCount += count;
+	histPulses += count;
+}
+
 extern "C" {
 void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) {
 	// buffer is half full
-	for (uint16_t i = 0; i < ADC_BUFFER_SIZE/2; ++i) {
-		if (adcBuffer[i] > 600) {
-			// while next value is lower than previos
-			while (adcBuffer[i] > adcBuffer[i+1] && i < ADC_BUFFER_SIZE/2) { ++i; }
-			++detectionCount;
-		}
-	}
+	scanPulses(0, ADC_BUFFER_SIZE/2);
 }}
 extern "C" {
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
 	// buffer is full
-	for (uint16_t i = ADC_BUFFER_SIZE/2; i < ADC_BUFFER_SIZE; ++i) {
-		if (adcBuffer[i] > 600) {
-			// while next value is lower than previos
-			while (adcBuffer[i] > adcBuffer[i+1] && i+2 < ADC_BUFFER_SIZE) { ++i; }
-			++detectionCount;
+	scanPulses(ADC_BUFFER_SIZE/2, ADC_BUFFER_SIZE);
+}}
+
+// Swap histograms: the cleared one becomes active
+static void histLatch() {
+	uint8_t next = histActive ^ 1;
+	memset(histogram[next], 0, sizeof(histogram[next]));
+	uint32_t now = HAL_GetTick();
+	__disable_irq();
+	histActive = next;
+	histLatchedPulses = histPulses;
+	histPulses = 0;
+	__enable_irq();
+	histLatchedTime = now - histStartTick;
+	histStartTick = now;
+	++histLatchCount;
+}
+static void histSetBins(uint8_t binsLog2) {
+	if (binsLog2 < HIST_BINS_LOG2_MIN || binsLog2 > HIST_BINS_LOG2_MAX) { return; }
+	__disable_irq();
+	memset(histogram, 0, sizeof(histogram));
+	histBinsLog2 = binsLog2;
+	histPulses = 0;
+	histLatchedPulses = 0;
+	__enable_irq();
+	histStartTick = HAL_GetTick();
+	histLatchedTime = 0;
+}
+// Response to the last command, copied to txI2C
+static uint16_t prepareResponse() {
+	if (reqI2C & I2C_CMD_HIST_CHUNK) {
+		const uint32_t *hist = histogram[histActive ^ 1];
+		uint16_t first = (reqI2C & 0x7F) * HIST_CHUNK_BINS;
+		for (uint16_t j = 0; j < HIST_CHUNK_BINS; ++j) {
+			uint32_t value = first + j < (1U << histBinsLog2) ? hist[first + j] : 0;
+			uint16_t bin = value > 0xFFFF ? 0xFFFF : value;
+			memcpy(txI2C + 2*j, &bin, 2);
 		}
+		return HIST_CHUNK_BINS * 2;
 	}
-}}
+	if (reqI2C == I2C_CMD_HIST_LATCH) {
+		uint16_t bins = 1U << histBinsLog2;
+		memcpy(txI2C, &bins, 2);
+		memcpy(txI2C+2, &histLatchCount, 2);
+		memcpy(txI2C+4, &histLatchedPulses, 4);
+		memcpy(txI2C+8, &histLatchedTime, 4);
+		return 12;
+	}
+	__disable_irq();
+	detectionCountBuf = detectionCount;
+	detectionCount = 0;
+	__enable_irq();
+	memcpy(txI2C, &detectionCountBuf, 4);
+	return 4;
+}
 
 extern "C" {
 void HAL_I2C_SlaveTxCpltCallback(I2C_HandleTypeDef *I2cHandle)  {}}
 
 extern "C" {
-void HAL_I2C_SlaveRxCpltCallback(I2C_HandleTypeDef *I2cHandle) {}}
+void HAL_I2C_SlaveRxCpltCallback(I2C_HandleTypeDef *I2cHandle) {
+	// commands that change state run once, when the byte is received
+	if (reqI2C == I2C_CMD_HIST_LATCH) { histLatch(); }
+	else if ((reqI2C & 0xF0) == I2C_CMD_HIST_BINS) {
+		histSetBins(reqI2C & 0x0F);
+		reqI2C = I2C_CMD_COUNT;
+	}
+}}
+
+extern "C" {
+void HAL_I2C_ListenCpltCallback(I2C_HandleTypeDef *hi2c) {
+	// listen mode ends with every STOP, wait for the next transfer
+	HAL_I2C_EnableListen_IT(hi2c);
+}}
 
 // If we receive own address
 void HAL_I2C_AddrCallback(I2C_HandleTypeDef *hi2c, uint8_t TransferDirection, uint16_t AddrMatchCode) {
@@ -80,9 +182,9 @@ void HAL_I2C_AddrCallback(I2C_HandleTypeDef *hi2c, uint8_t TransferDirection, ui
 		HAL_I2C_Slave_Seq_Receive_IT(&hi2c1, &reqI2C, 1, I2C_NEXT_FRAME);
 	}
 	else { // Receive from master
-		detectionCountBuf = detectionCount;
-		detectionCount = 0;
-		HAL_I2C_Slave_Seq_Transmit_IT(&hi2c1, (uint8_t*)&detectionCountBuf, 4, I2C_NEXT_FRAME);
+		uint16_t size = prepareResponse();
+		reqI2C = I2C_CMD_COUNT;
+		HAL_I2C_Slave_Seq_Transmit_IT(&hi2c1, txI2C, size, I2C_NEXT_FRAME);
 	}
 }
 
@@ -0,0 +1,151 @@
+#ifndef __GOST4401_FAST_H__
+#define __GOST4401_FAST_H__
+
+#include <Arduino.h>
+#include <GOST4401_81.h>
+
+/* Быстрый расчёт стандартной атмосферы ГОСТ 4401-81.
+   Интерфейс и диапазоны совпадают с GOST4401_getAltitude/getPressure/getTemperature
+   из Troyka-IMU, вне диапазона возвращается NAN.
+   - номер слоя запоминается между вызовами: соседние отсчёты датчика лежат
+     в том же слое, поиск начинается с него
+   - константы слоёв (log2 Ps, показатель Bm·R/G и обратные величины) посчитаны
+     заранее, в вызове нет ни одного деления
+   - pow/log10 заменены на log2/exp2: показатель float берётся из битов,
+     мантисса приближается полиномом
+   Погрешность полиномов: log2 - 6e-7, (2^x-1)/x при |x| <= 0.45 - 2e-9,
+   2^x на [0, 1) - 1e-7 (относительная). Перевод геопотенциальной высоты
+   в геометрическую рядом до u^3 (u = H/E <= 0.008) - не хуже 0.3 мм.
+   Итог по сравнению с расчётом в double: высота - до 0.015 м,
+   давление - до 5e-6 относительно, температура - до 1e-4 K
+   (ошибка определяется округлением float; проверка - host/gost_sweep.cpp).
+   В отличие от библиотеки, getPressure и getTemperature выбирают слой по высоте
+   (в библиотеке условие поиска слоя никогда не выполняется, и всегда берётся
+   последний слой) */
+
+// Константы слоя
+struct GOST4401_FastLayer {
+    float alt;      // Геопотенциальная высота начала слоя, м
+    float press;    // Давление на начале слоя, Па
+    float temp;     // Температура на начале слоя, K
+    float grad;     // Градиент температуры, K/м
+    float log2Ps;   // log2(press)
+    float k;        // grad·R/G (0 - изотермический слой)
+    float invK;     // G/(grad·R)
+    float scale;    // temp/grad; для изотермического слоя R·temp·ln2/G
+    float invScale; // 1/scale
+};
+
+static const GOST4401_FastLayer GOST4401_FAST_TABLE[] = {
+    {    0.0f, 101325.00f, 288.15f, -0.0065f, 1.662863065e+01f, -1.902631026e-01f, -5.255879813e+00f, -4.433076923e+04f, -2.255769564e-05f },
+    { 11000.0f,  22632.04f, 216.65f,  0.0f,    1.446607901e+01f,  0.0f,               0.0f,              4.395672949e+03f,  2.274964520e-04f },
+    { 20000.0f,   5474.87f, 216.65f,  0.0010f, 1.241860899e+01f,  2.927124655e-02f,  3.416321878e+01f,  2.166500000e+05f,  4.615739672e-06f },
+    { 32000.0f,   868.0146f, 228.65f, 0.0028f, 9.761575499e+00f,  8.195949035e-02f,  1.220114957e+01f,  8.166071429e+04f,  1.224579051e-05f },
+    { 47000.0f,   110.9056f, 270.65f, 0.0f,    6.793188404e+00f,  0.0f,               0.0f,              5.491294178e+03f,  1.821064338e-04f },
+    { 51000.0f,   6.69384f,  270.65f, -0.0028f, 2.742834067e+00f, -8.195949035e-02f, -1.220114957e+01f, -9.666071429e+04f, -1.034546462e-05f }
+};
+#define GOST4401_FAST_LAYERS 5 // Последняя запись - только граница
+
+#define GOST4401_FAST_INV_E (1.0f / GOST4401_E)
+
+// log2(x) для x > 0: показатель из битов float, мантисса в [0.75, 1.5)
+inline float GOST4401_fastLog2(float x) {
+    union { float f; uint32_t u; } v = { x };
+    int16_t e = static_cast<int16_t>((v.u >> 23) & 0xFF) - 127;
+    v.u = (v.u & 0x007FFFFFUL) | 0x3F800000UL;
+    if (v.f >= 1.5f) { v.f *= 0.5f; ++e; }
+    float t = v.f - 1.0f; // [-0.25, 0.5)
+    float p = -2.406199969e-01f + t * 1.172318392e-01f;
+    p = 2.981740361e-01f + t * p;
+    p = -3.617303950e-01f + t * p;
+    p = 4.806416178e-01f + t * p;
+    p = -7.213247771e-01f + t * p;
+    p = 1.442696188e+00f + t * p;
+    return e + t * p;
+}
+// 2^x - 1 при |x| <= 0.45
+inline float GOST4401_fastExp2m1(float x) {
+    float p = 1.337995882e-03f + x * 1.544372129e-04f;
+    p = 9.618098577e-03f + x * p;
+    p = 5.550375616e-02f + x * p;
+    p = 2.402265073e-01f + x * p;
+    p = 6.931471845e-01f + x * p;
+    return x * p;
+}
+// 2^x для x в диапазоне давлений таблицы: целая часть - в показатель float
+inline float GOST4401_fastExp2(float x) {
+    int16_t n = static_cast<int16_t>(x);
+    if (x < n) { --n; }
+    float f = x - n; // [0, 1)
+    float p = 8.949590423e-03f + f * 1.893754058e-03f;
+    p = 5.586033708e-02f + f * p;
+    p = 2.401418182e-01f + f * p;
+    p = 6.931544897e-01f + f * p;
+    p = 9.999998984e-01f + f * p;
+    union { float f; uint32_t u; } v = { p };
+    v.u += static_cast<uint32_t>(static_cast<int32_t>(n)) << 23;
+    return v.f;
+}
+
+// Номер слоя, найденный в прошлый раз (общий для всех функций)
+static uint8_t GOST4401_fastLayer = 0;
+
+// Слой по давлению: press[idx] >= p > press[idx + 1]
+inline uint8_t GOST4401_fastLayerByPressure(float pressurePa) {
+    uint8_t idx = GOST4401_fastLayer;
+    while (pressurePa > GOST4401_FAST_TABLE[idx].press) { --idx; }
+    while (pressurePa <= GOST4401_FAST_TABLE[idx + 1].press) { ++idx; }
+    return GOST4401_fastLayer = idx;
+}
+// Слой по геопотенциальной высоте: alt[idx] <= h < alt[idx + 1]
+inline uint8_t GOST4401_fastLayerByAltitude(float geopotH) {
+    uint8_t idx = GOST4401_fastLayer;
+    while (geopotH < GOST4401_FAST_TABLE[idx].alt) { --idx; }
+    while (geopotH >= GOST4401_FAST_TABLE[idx + 1].alt) { ++idx; }
+    return GOST4401_fastLayer = idx;
+}
+// Геометрическая высота -> геопотенциальная: H·E/(E + H)
+inline float GOST4401_fastGeopotential(float altitude) {
+    float u = altitude * GOST4401_FAST_INV_E;
+    return altitude * (1.0f - u * (1.0f - u * (1.0f - u)));
+}
+
+/* Геометрическая высота (м) по давлению (Па) */
+inline float GOST4401Fast_getAltitude(float pressurePa) {
+    // Нижняя граница - по float из таблицы: 6.69384f больше 6.69384, и поиск слоя ушёл бы за таблицу
+    if ((pressurePa <= GOST4401_FAST_TABLE[GOST4401_FAST_LAYERS].press) || (pressurePa > GOST4401_MAX_PRESSURE)) { return NAN; }
+    const GOST4401_FastLayer &layer = GOST4401_FAST_TABLE[GOST4401_fastLayerByPressure(pressurePa)];
+
+    float delta = layer.log2Ps - GOST4401_fastLog2(pressurePa); // log2(Ps/p)
+    float geopotH = layer.k != 0.0f
+        ? layer.scale * GOST4401_fastExp2m1(layer.k * delta) // Tm·((Ps/p)^k - 1)/Bm
+        : layer.scale * delta;                               // R·Tm·ln(Ps/p)/G
+    geopotH += layer.alt;
+
+    // Геопотенциальная -> геометрическая: H·E/(E - H)
+    float u = geopotH * GOST4401_FAST_INV_E;
+    return geopotH * (1.0f + u * (1.0f + u * (1.0f + u)));
+}
+
+/* Давление (Па) по геометрической высоте (м) */
+inline float GOST4401Fast_getPressure(float altitude) {
+    float geopotH = GOST4401_fastGeopotential(altitude);
+    if ((geopotH < GOST4401_MIN_GPALT) || (geopotH >= GOST4401_MAX_GPALT)) { return NAN; }
+    const GOST4401_FastLayer &layer = GOST4401_FAST_TABLE[GOST4401_fastLayerByAltitude(geopotH)];
+
+    float h = geopotH - layer.alt;
+    float log2P = layer.k != 0.0f
+        ? layer.log2Ps - layer.invK * GOST4401_fastLog2(1.0f + layer.invScale * h) // T/Tm = 1 + Bm·h/Tm
+        : layer.log2Ps - layer.invScale * h;
+    return GOST4401_fastExp2(log2P);
+}
+
+/* Температура (K) по геометрической высоте (м) */
+inline float GOST4401Fast_getTemperature(float altitude) {
+    float geopotH = GOST4401_fastGeopotential(altitude);
+    if ((geopotH < GOST4401_MIN_GPALT) || (geopotH >= GOST4401_MAX_GPALT)) { return NAN; }
+    const GOST4401_FastLayer &layer = GOST4401_FAST_TABLE[GOST4401_fastLayerByAltitude(geopotH)];
+    return layer.temp + layer.grad * (geopotH - layer.alt);
+}
+
+#endif // __GOST4401_FAST_H__
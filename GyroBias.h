@@ -0,0 +1,130 @@
+#ifndef __GYRO_BIAS_H__
+#define __GYRO_BIAS_H__
+
+#include <Arduino.h>
+
+/* Смещение нуля гироскопа, общее для БУСОС и проверки на ПК
+   (host/gyro_bias_test.cpp).
+   Пока спутник неподвижен, среднее по окну даёт смещение при текущей
+   температуре барометра; оценки копятся в таблице по температуре, таблица
+   хранится в EEPROM. К отсчётам вычитается значение, интерполированное по
+   таблице при каждом чтении температуры. Сохранение и статистика - на
+   стороне БУСОС */
+
+#define GYRO_TABLE_MIN          (-40) // °C, температура первой ячейки
+#define GYRO_TABLE_STEP         5     // °C
+#define GYRO_TABLE_SIZE         24    // -40 .. +75 °C
+#define GYRO_TABLE_WEIGHT_MAX   16    // Новая оценка меняет ячейку не меньше чем на 1/16
+#define GYRO_STILL_CYCLES       200   // Окно неподвижности, опросов IMU (2 с)
+#define GYRO_STILL_STD          0.5f  // °/с, допустимый разброс средних за опрос
+#define GYRO_STILL_ACL          0.5f  // м/с², допустимое отклонение |acl| от g
+#define GYRO_STILL_MGN          0.0015f // Гаусс, изменение среднего поля от прошлого окна
+#define GYRO_BIAS_MAX           15.0f // °/с, большее среднее - вращение, а не смещение
+
+// Таблица смещений гироскопа: смещение в 1/16 единицы АЦП, вес - число оценок (до GYRO_TABLE_WEIGHT_MAX)
+struct GyroBiasCell {
+    int16_t bias[3];
+    uint8_t weight;
+};
+// Окно неподвижности: средние за опрос относительно первого отсчёта окна (единицы АЦП)
+struct GyroStillWindow {
+    uint8_t  cycles;
+    bool     hasField;         // Прошлое окно было неподвижным, его поле - в lastField
+    float    ref[3], sum[3], sumSq[3];
+    float    field[3];         // Сумма поля за окно
+    float    lastField[3];     // Среднее поле прошлого окна
+};
+enum GyroStillResult : uint8_t { GYRO_STILL_COLLECTING, GYRO_STILL_ACCEPTED, GYRO_STILL_REJECTED };
+
+// Смещение (единицы АЦП) по таблице для температуры (°C): между ближайшими
+// заполненными ячейками, вне их - по крайней. false - таблица пуста, bias не меняется
+inline bool gyroBiasInterpolate(const GyroBiasCell *table, float temperature, float bias[3]) {
+    float position = (temperature - GYRO_TABLE_MIN) / GYRO_TABLE_STEP;
+    int8_t below = -1, above = -1;
+    for (uint8_t i = 0; i < GYRO_TABLE_SIZE; ++i) {
+        if (!table[i].weight) { continue; }
+        if (i <= position) { below = i; }
+        else if (above < 0) { above = i; }
+    }
+    if (below < 0 && above < 0) { return false; }
+    if (below < 0) { below = above; }
+    if (above < 0) { above = below; }
+
+    float k = above == below ? 0 : (position - below) / (above - below);
+    for (uint8_t i = 0; i < 3; ++i) {
+        bias[i] = (table[below].bias[i] + k * (table[above].bias[i] - table[below].bias[i])) / 16.0f;
+    }
+    return true;
+}
+
+/* Очередной опрос IMU: rawMean - среднее гироскопа за опрос (единицы АЦП),
+   aclError - отклонение |acl| от g (м/с²), field - поле (Гаусс), scale - °/с
+   на единицу АЦП. В конце окна - ACCEPTED с оценкой смещения (единицы АЦП)
+   и её СКО (°/с) или REJECTED. Движение обрывает окно: REJECTED, если оно
+   было начато.
+   Ровное медленное вращение гироскоп от смещения не отличает, его выдаёт
+   поворот поля. Между половинами одного окна он за шумом магнитометра
+   (0.5 °/с при горизонтальном поле 0.2 Гс - 1.7 мГс), поэтому поле окна
+   сравнивается с полем прошлого неподвижного окна: вдвое больше поворот,
+   меньше шум. Первое окно после движения только запоминает поле */
+inline uint8_t gyroStillAdd(GyroStillWindow &window, const float rawMean[3], float aclError, const float field[3],
+                            float scale, float estimate[3], float error[3]) {
+    // Ускорение, отличное от g, - движение: окно начинается заново
+    if (fabs(aclError) > GYRO_STILL_ACL) {
+        bool started = window.cycles;
+        window.cycles = 0;
+        window.hasField = false;
+        return started ? GYRO_STILL_REJECTED : GYRO_STILL_COLLECTING;
+    }
+    if (!window.cycles) {
+        memcpy(window.ref, rawMean, sizeof(window.ref));
+        memset(window.sum, 0, sizeof(window.sum));
+        memset(window.sumSq, 0, sizeof(window.sumSq));
+        memset(window.field, 0, sizeof(window.field));
+    }
+    for (uint8_t i = 0; i < 3; ++i) {
+        float d = rawMean[i] - window.ref[i];
+        window.sum[i] += d;
+        window.sumSq[i] += d * d;
+        window.field[i] += field[i];
+    }
+    if (++window.cycles < GYRO_STILL_CYCLES) { return GYRO_STILL_COLLECTING; }
+    window.cycles = 0;
+
+    // Неподвижность: малый разброс гироскопа, среднее похоже на смещение, поле не повернулось
+    for (uint8_t i = 0; i < 3; ++i) {
+        float mean = window.sum[i] / GYRO_STILL_CYCLES;
+        float variance = max(window.sumSq[i] / GYRO_STILL_CYCLES - mean * mean, 0.0f);
+        estimate[i] = window.ref[i] + mean;
+        error[i] = sqrt(variance / GYRO_STILL_CYCLES) * scale;
+        if (sqrt(variance) * scale > GYRO_STILL_STD || fabs(estimate[i] * scale) > GYRO_BIAS_MAX) {
+            window.hasField = false;
+            return GYRO_STILL_REJECTED;
+        }
+    }
+    float mgnShift = 0;
+    for (uint8_t i = 0; i < 3; ++i) {
+        float mean = window.field[i] / GYRO_STILL_CYCLES;
+        mgnShift += (mean - window.lastField[i]) * (mean - window.lastField[i]);
+        window.lastField[i] = mean;
+    }
+    if (!window.hasField) {
+        window.hasField = true;
+        return GYRO_STILL_COLLECTING;
+    }
+    return mgnShift > GYRO_STILL_MGN * GYRO_STILL_MGN ? GYRO_STILL_REJECTED : GYRO_STILL_ACCEPTED;
+}
+
+// Оценка (единицы АЦП) - в ближайшую по температуре ячейку, возвращает её номер
+inline uint8_t gyroBiasLearn(GyroBiasCell *table, float temperature, const float estimate[3]) {
+    int16_t cell = round((temperature - GYRO_TABLE_MIN) / GYRO_TABLE_STEP);
+    cell = constrain(cell, 0, GYRO_TABLE_SIZE - 1);
+    GyroBiasCell &entry = table[cell];
+    if (entry.weight < GYRO_TABLE_WEIGHT_MAX) { ++entry.weight; }
+    for (uint8_t i = 0; i < 3; ++i) {
+        entry.bias[i] += static_cast<int16_t>(round((estimate[i] * 16 - entry.bias[i]) / entry.weight));
+    }
+    return cell;
+}
+
+#endif // __GYRO_BIAS_H__
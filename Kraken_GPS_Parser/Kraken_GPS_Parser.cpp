@@ -0,0 +1,198 @@
+#include "Kraken_GPS_Parser.h"
+
+namespace Kraken {
+// Временное хранение данных и состояний автомата для парсера
+uint8_t gpsTitleBuf[5];
+int8_t parserState = -1;
+int8_t gpsElemType = 0;
+uint16_t gpsLat_m = 0;
+uint32_t gpsLat_l = 0;
+uint16_t gpsLon_m = 0;
+uint32_t gpsLon_l = 0;
+uint32_t gpsH_m = 0;
+uint32_t gpsH_l = 0;
+uint32_t gpsTime_m = 0;
+uint32_t gpsTime_l = 0;
+// Количество цифр дробных частей: без него "5545.01234" читался как 5545.1234
+uint8_t gpsLat_d = 0;
+uint8_t gpsLon_d = 0;
+uint8_t gpsH_d = 0;
+uint8_t gpsTime_d = 0;
+uint8_t gpsVector_buf = 0;
+uint8_t gpsStlCount_buf = 0;
+uint8_t gpsXurSum = 0;
+uint8_t gpsCtlSumBuf = 0;
+// Данные публикуются только для GGA с двумя шестнадцатеричными цифрами после '*':
+// иначе "$\r" в шуме совпадал по пустой сумме и обнулял координаты
+uint8_t gpsCtlSumDigits = 0;
+bool gpsTitleValid = false;
+
+// Полученные значения
+float gpsH = 0;
+double gpsLat = 0;
+double gpsLon = 0;
+float gpsTime = 0;
+uint8_t gpsVector = 0;
+uint8_t gpsStlCount = 0;
+bool gpsReady = false;
+
+void parseNMEA(unsigned char s) { parseNMEA(&s, 1); }
+
+// Очередная цифра дробной части, цифры после девятой не помещаются в uint32_t и отбрасываются
+static inline void addDigit(uint32_t &value, uint8_t &digits, uint8_t c) {
+	if (digits >= 9) { return; }
+	value = value*10 + c-'0';
+	++digits;
+}
+
+void parseNMEA(uint8_t *gpsBuffer, uint16_t size) {
+	for (uint16_t i = 0; i < size; ++i) {
+		if (gpsBuffer[i] == '$') { // Начало нового пакета
+			parserState = 0;
+			gpsElemType = 0;
+			gpsLat_m = 0; gpsLat_l = 0;
+			gpsLon_m = 0; gpsLon_l = 0;
+			gpsH_m = 0; gpsH_l = 0;
+			gpsTime_m = 0; gpsTime_l = 0;
+			gpsLat_d = 0; gpsLon_d = 0; gpsH_d = 0; gpsTime_d = 0;
+			gpsVector_buf = 0;
+			gpsCtlSumBuf = 0;
+			gpsCtlSumDigits = 0;
+			gpsXurSum = 0;
+			gpsStlCount_buf = 0;
+			// Заголовок прошлого пакета не должен дополнять заголовок нового
+			gpsTitleBuf[0] = gpsTitleBuf[1] = gpsTitleBuf[2] = gpsTitleBuf[3] = gpsTitleBuf[4] = 0;
+			gpsTitleValid = false;
+			continue;
+		}
+
+		if (parserState == -1) { continue; }
+
+		// Конец пакета
+		if (gpsBuffer[i] == '\r') {
+			bool checked = parserState == -2 && gpsCtlSumDigits == 2 && gpsTitleValid;
+			parserState = -1;
+			if (checked && gpsCtlSumBuf == gpsXurSum) { // Если контрольная сумма совпала
+				// Обновление данных
+				gpsLat = addToDuoble(gpsLat_m, gpsLat_l, gpsLat_d);
+				gpsLon = addToDuoble(gpsLon_m, gpsLon_l, gpsLon_d);
+				gpsH = addToDuoble(gpsH_m, gpsH_l, gpsH_d);
+				gpsTime = addToDuoble(gpsTime_m, gpsTime_l, gpsTime_d);
+				gpsVector = gpsVector_buf;
+				gpsStlCount = gpsStlCount_buf;
+				// Если gpsReady == true, то GPS 'поймал' стуники
+				if (gpsLat != 0.0 && gpsLon != 0.0) { gpsReady = true; }
+			}
+			continue;
+		}
+
+		if (parserState == -2) { // Если сейчас передаётся контрольная сумма
+			if (gpsCtlSumDigits < 2 && gpsBuffer[i] >= 'A' && gpsBuffer[i] <= 'F') {
+				// Вычитаем 7 из-за семи символов между цифрами и буквами в ASCII
+				gpsCtlSumBuf = gpsCtlSumBuf*16 + gpsBuffer[i]-'0'-7;
+			}
+			else if (gpsCtlSumDigits < 2 && gpsBuffer[i] >= '0' && gpsBuffer[i] <= '9') {
+				gpsCtlSumBuf = gpsCtlSumBuf*16 + gpsBuffer[i]-'0';
+			}
+			else { parserState = -1; continue; } // Не шестнадцатеричная сумма - пакет отбрасывается
+			++gpsCtlSumDigits;
+			continue;
+		}
+
+		// Начало контрольной суммы с GPS
+		if (gpsBuffer[i] == '*') { parserState = -2; continue; }
+
+		// Вычисление контрольной суммы
+		gpsXurSum ^= gpsBuffer[i];
+
+		if (parserState == 0) { // Ожидание нужных заголовков
+			if (gpsBuffer[i] == ',') {
+				if (gpsTitleBuf[0] == 'G' && gpsTitleBuf[1] == 'P' && gpsTitleBuf[2] == 'G' && gpsTitleBuf[3] == 'G' && gpsTitleBuf[4] == 'A') {
+					parserState = 1;
+					gpsTitleValid = true;
+					continue;
+				}
+				if (gpsTitleBuf[0] == 'G' && gpsTitleBuf[1] == 'N' && gpsTitleBuf[2] == 'G' && gpsTitleBuf[3] == 'G' && gpsTitleBuf[4] == 'A') {
+					parserState = 1;
+					gpsTitleValid = true;
+					continue;
+				}
+				parserState = -1;
+				continue;
+			}
+			// Обновление послдених пяти символов
+			gpsTitleBuf[0] = gpsTitleBuf[1];
+			gpsTitleBuf[1] = gpsTitleBuf[2];
+			gpsTitleBuf[2] = gpsTitleBuf[3];
+			gpsTitleBuf[3] = gpsTitleBuf[4];
+			gpsTitleBuf[4] = gpsBuffer[i];
+			continue;
+		}
+
+		if (parserState == 1) { // Парсинг нужного сообщение
+			if (gpsBuffer[i] == ',' || gpsBuffer[i] == '.') {
+				// Если пришла точка или запятая, но переходим к следующему значению
+				if (gpsBuffer[i] == ',') {
+					if (gpsElemType == 0 || gpsElemType == 2 || gpsElemType == 5 ||
+					gpsElemType == 10 || gpsElemType == 12 || gpsElemType == 15) { gpsElemType++; }
+				}
+				gpsElemType++;
+				continue;
+			}
+			// (gpsElemType) - номер текущего значения
+			if (gpsElemType == 0) { gpsTime_m = gpsTime_m*10 + gpsBuffer[i]-'0'; continue; }
+			if (gpsElemType == 1) { addDigit(gpsTime_l, gpsTime_d, gpsBuffer[i]); continue; }
+			if (gpsElemType == 2) { gpsLat_m = gpsLat_m*10 + gpsBuffer[i]-'0'; continue; }
+			if (gpsElemType == 3) { addDigit(gpsLat_l, gpsLat_d, gpsBuffer[i]); continue; }
+			if (gpsElemType == 4) {
+				gpsVector_buf = (gpsVector_buf&0b11) | 0b10;
+				if (gpsBuffer[i] == 'S') { gpsVector_buf = gpsVector_buf&0b01; }
+				continue;
+			}
+			if (gpsElemType == 5) { gpsLon_m = gpsLon_m*10 + gpsBuffer[i]-'0'; continue; }
+			if (gpsElemType == 6) { addDigit(gpsLon_l, gpsLon_d, gpsBuffer[i]); continue; }
+			if (gpsElemType == 7) {
+				gpsVector_buf = (gpsVector_buf&0b11) | 0b01;
+				if (gpsBuffer[i] == 'W') { gpsVector_buf = gpsVector_buf&0b10; }
+				continue;
+			}
+			if (gpsElemType == 9) { gpsStlCount_buf = gpsStlCount_buf*10 + gpsBuffer[i]-'0'; continue; }
+			if (gpsElemType == 12) { gpsH_m = gpsH_m*10 + gpsBuffer[i]-'0'; continue; }
+			if (gpsElemType == 13) { addDigit(gpsH_l, gpsH_d, gpsBuffer[i]); continue; }
+		}
+	}
+}
+
+double addToDuoble(uint32_t m, uint32_t l, uint8_t digits) {
+	double q = l;
+	while (digits--) { q /= 10; }
+	return m + q;
+}
+
+float getLat() {
+	// gpsLat = GGMM.MM
+	int16_t GG__ = gpsLat/100;
+	float minutes = gpsLat - GG__*100;
+	if (!(gpsVector & 0b10)) {
+		return -GG__ - minutes/60;
+	}
+	return GG__ + minutes/60;
+}
+
+float getLon() {
+	// gpsLat = GGGMM.MM
+	int16_t GGG__ = gpsLon/100;
+	float minutes = gpsLon - GGG__*100;
+	//return minutes;
+	if (!(gpsVector & 0b01)) {
+		return -GGG__ - minutes/60;
+	}
+	return GGG__ + minutes/60;
+}
+
+float getTime() { return gpsTime; }
+
+float getAltitude() { return gpsH; }
+
+float getStlCount() { return gpsStlCount; }
+}
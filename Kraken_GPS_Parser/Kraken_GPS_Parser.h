@@ -0,0 +1,58 @@
+#ifndef KRAKEN_GNS_PARSER
+#define KRAKEN_GNS_PARSER
+
+#include <stdint.h>
+
+namespace Kraken {
+// Полученные значения
+// GGMM.MM
+extern double gpsLat;
+// GGGMM.MM
+extern double gpsLon;
+// MM.MM - метры
+extern float gpsH;
+// HHMMSS.SS
+extern float gpsTime;
+// Направление широты и долготы
+extern uint8_t gpsVector;
+// Были ли хоть раз получены ккординаты, true = да
+extern bool gpsReady;
+// Количество 'пойманных' спутников
+extern uint8_t gpsStlCount;
+// Время последнего пакета: ЧЧММСС, дробная часть и количество её цифр.
+// Это переменные автомата, они верны сразу после '\r', которым пакет опубликован
+extern uint32_t gpsTime_m;
+extern uint32_t gpsTime_l;
+extern uint8_t gpsTime_d;
+
+/* Сложение целой и дробной частей вместе.
+   digits - количество цифр дробной части l (с ведущими нулями) */
+double addToDuoble(uint32_t m, uint32_t l, uint8_t digits);
+
+/* NMEA парсер основанный на конечном автомате.
+   gpsBuffer - указатель на буфер, size - его размер  */
+void parseNMEA(uint8_t* gpsBuffer, uint16_t size);
+
+/* NMEA парсер основанный на конечном автомате.
+   Можно посимвольно отправлять данные в парсер  */
+void parseNMEA(unsigned char s);
+
+/* Возврат широту в формате GG.GG
+   Если южная, то значение будет отрицательным */
+float getLat();
+
+/* Возврат долготу в формате GGG.GG
+   Если западная, то значение будет отрицательным */
+float getLon();
+
+/* Время в формате ЧЧММСС.СС */
+float getTime();
+
+/* Высота в метрах */
+float getAltitude();
+
+/* Количество 'пойманных' спутникоа */
+float getStlCount();
+}
+
+#endif // KRAKEN_GNS_PARSER
\ No newline at end of file
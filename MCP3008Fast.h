@@ -0,0 +1,121 @@
+#ifndef __MCP3008_FAST_H__
+#define __MCP3008_FAST_H__
+
+#include <Arduino.h>
+
+/* Быстрое чтение MCP3008 на тех же выводах, что и у библиотеки MCP3008.
+   Выводы аппаратного SPI (11-13) заняты, поэтому SPI формируется прямой
+   записью в регистры портов вместо digitalWrite/digitalRead:
+   - на ATmega328P/168 адреса портов известны при компиляции, каждый фронт -
+     одна команда sbi/cbi
+   - на остальных платах регистры и маски выводов находятся в begin()
+   Режим SPI 0: MCP3008 меняет DOUT по спаду CLK, бит читается при высоком CLK.
+   CLK около 1.5 МГц (не больше 3.6 МГц при 5 В), время выборки растянуто на
+   MCP3008_FAST_SAMPLE_US, чтобы вход успевал зарядиться через делитель
+   фоторезистора. Один канал - около 16 мкс, 8 каналов - около 130 мкс */
+
+// Дополнительное время выборки, мкс (без него выборка - 1.5 такта CLK, ~1 мкс)
+#ifndef MCP3008_FAST_SAMPLE_US
+#define MCP3008_FAST_SAMPLE_US 2
+#endif
+
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || defined(__AVR_ATmega168__)
+#define MCP3008_FAST_FIXED_PORTS
+#endif
+
+template <uint8_t CLK, uint8_t DIN, uint8_t DOUT, uint8_t CS>
+class MCP3008Fast {
+public:
+    void begin() {
+        pinMode(CS, OUTPUT);
+        pinMode(CLK, OUTPUT);
+        pinMode(DIN, OUTPUT);
+        pinMode(DOUT, INPUT);
+#ifndef MCP3008_FAST_FIXED_PORTS
+        _clkPort = portOutputRegister(digitalPinToPort(CLK));
+        _dinPort = portOutputRegister(digitalPinToPort(DIN));
+        _csPort = portOutputRegister(digitalPinToPort(CS));
+        _doutPin = portInputRegister(digitalPinToPort(DOUT));
+        _clkMask = digitalPinToBitMask(CLK);
+        _dinMask = digitalPinToBitMask(DIN);
+        _csMask = digitalPinToBitMask(CS);
+        _doutMask = digitalPinToBitMask(DOUT);
+#endif
+        csHigh();
+        clkLow();
+    }
+
+    // Одно преобразование, канал 0-7 (несимметричный вход)
+    uint16_t read(uint8_t channel) {
+        uint8_t command = 0x18 | (channel & 0x07); // Старт, несимметричный вход, D2..D0
+        csLow();
+        for (uint8_t i = 0; i < 5; ++i) {
+            if (command & 0x10) { dinHigh(); } else { dinLow(); }
+            clkHigh();
+            command <<= 1;
+            clkLow();
+        }
+        // Такт 6: конец выборки по спаду, выборка длится, пока CLK высокий
+        clkHigh();
+        delayMicroseconds(MCP3008_FAST_SAMPLE_US);
+        clkLow();
+        // Такт 7: нулевой бит
+        clkHigh();
+        clkLow();
+        // Такты 8-17: B9..B0
+        uint16_t value = 0;
+        for (uint8_t i = 0; i < 10; ++i) {
+            clkHigh();
+            value <<= 1;
+            if (doutRead()) { value |= 1; }
+            clkLow();
+        }
+        csHigh();
+        return value;
+    }
+
+    // Все 8 каналов по порядку в values[0..7]
+    void scan(uint16_t *values) {
+        for (uint8_t channel = 0; channel < 8; ++channel) {
+            values[channel] = read(channel);
+        }
+    }
+
+private:
+#ifdef MCP3008_FAST_FIXED_PORTS
+    // Адреса PORTx (PINx = PORTx - 2): выводы 0-7 - порт D, 8-13 - B, 14-19 - C
+    static constexpr uint8_t portAddress(uint8_t pin) { return pin < 8 ? 0x2B : (pin < 14 ? 0x25 : 0x28); }
+    static constexpr uint8_t bitMask(uint8_t pin) { return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14)); }
+    static inline __attribute__((always_inline)) void high(uint8_t pin) {
+        *reinterpret_cast<volatile uint8_t *>(portAddress(pin)) |= bitMask(pin);
+    }
+    static inline __attribute__((always_inline)) void low(uint8_t pin) {
+        *reinterpret_cast<volatile uint8_t *>(portAddress(pin)) &= ~bitMask(pin);
+    }
+
+    // CLK высокий не меньше 3 тактов МК (tHI >= 125 нс)
+    inline __attribute__((always_inline)) void clkHigh() { high(CLK); __asm__ __volatile__ ("nop"); }
+    inline __attribute__((always_inline)) void clkLow() { low(CLK); }
+    inline __attribute__((always_inline)) void dinHigh() { high(DIN); }
+    inline __attribute__((always_inline)) void dinLow() { low(DIN); }
+    // CS высокий между преобразованиями не меньше 270 нс
+    inline __attribute__((always_inline)) void csHigh() { high(CS); __builtin_avr_delay_cycles(4); }
+    inline __attribute__((always_inline)) void csLow() { low(CS); }
+    inline __attribute__((always_inline)) bool doutRead() {
+        return *reinterpret_cast<volatile uint8_t *>(portAddress(DOUT) - 2) & bitMask(DOUT);
+    }
+#else
+    volatile uint8_t *_clkPort, *_dinPort, *_csPort, *_doutPin;
+    uint8_t _clkMask, _dinMask, _csMask, _doutMask;
+
+    inline void clkHigh() { *_clkPort |= _clkMask; }
+    inline void clkLow() { *_clkPort &= ~_clkMask; }
+    inline void dinHigh() { *_dinPort |= _dinMask; }
+    inline void dinLow() { *_dinPort &= ~_dinMask; }
+    inline void csHigh() { *_csPort |= _csMask; }
+    inline void csLow() { *_csPort &= ~_csMask; }
+    inline bool doutRead() { return *_doutPin & _doutMask; }
+#endif
+};
+
+#endif // __MCP3008_FAST_H__
@@ -0,0 +1,273 @@
+#ifndef __MADGWICK_FIXED_H__
+#define __MADGWICK_FIXED_H__
+
+#include <Arduino.h>
+#include <MadgwickAHRS.h>
+
+/* Фильтр Madgwick в целых числах для 8-битных AVR.
+   Интерфейс совпадает с Madgwick из Troyka-IMU. Шаг фильтра (градиент,
+   интегрирование, нормировка кватерниона) идёт в целых; float остаётся на входе
+   (нормировка векторов датчиков и перевод в Q13), на выходе (readQuaternion, углы)
+   и в перенормировке после большого отклонения:
+   - кватернион хранится в Q30, чтобы малые приращения за шаг не терялись
+   - градиентный шаг считается в Q13. _mul умножает до сдвига, поэтому произведение
+     помещается в int32, только если произведение самих значений меньше 32 (2^31 в Q26).
+     Компоненты q и нормированных векторов не больше 1, невязки f - не больше 2
+     (разность единичных векторов), множители при невязках (2q..8q, 4bx·q) - не больше 8
+   - приращение от гироскопа: q (Q14) * ω·dt/2 (Q20) < 2^31 при |ω·dt/2| <= 0.12 рад,
+     при диапазоне 250 °/с это частота не ниже 20 Гц
+   - коэффициент beta/частота ограничен 0.49: градиент (Q12) * beta·dt (Q20) < 2^31
+   Нормировки: входные векторы - быстрым обратным корнем по float,
+   градиент - целочисленным обратным корнем (таблица + 2 итерации Ньютона).
+   Точность по сравнению с float - host/madgwick_test.cpp */
+class MadgwickFixed {
+public:
+    void begin() {
+        reset();
+        setSettings();
+    }
+    void reset() {
+        _q[0] = Q30_ONE;
+        _q[1] = _q[2] = _q[3] = 0;
+    }
+    void setSettings(float beta = BETA_DEFAULT, float zeta = ZETA_DEFAULT) {
+        _beta = beta;
+        _zeta = zeta;
+        _updateGains();
+    }
+    void setFrequency(float frequency) {
+        _frequency = frequency;
+        _updateGains();
+    }
+    void readQuaternion(float& q0, float& q1, float& q2, float& q3) {
+        q0 = _q[0] * (1.0f / Q30_ONE);
+        q1 = _q[1] * (1.0f / Q30_ONE);
+        q2 = _q[2] * (1.0f / Q30_ONE);
+        q3 = _q[3] * (1.0f / Q30_ONE);
+    }
+    // Сколько раз ω·dt/2 упиралось в ограничение
+    uint16_t saturations() const { return _saturations; }
+
+    void update(float gx, float gy, float gz, float ax, float ay, float az,
+                float mx, float my, float mz) {
+        int32_t a[3], m[3];
+        if (!_normalize(ax, ay, az, a)) { _integrate(gx, gy, gz, nullptr); return; }
+        if (!_normalize(mx, my, mz, m)) { _integrate(gx, gy, gz, _gradientImu(a)); return; }
+
+        int32_t q0 = _q[0] >> (30 - GRAD_BITS), q1 = _q[1] >> (30 - GRAD_BITS), q2 = _q[2] >> (30 - GRAD_BITS), q3 = _q[3] >> (30 - GRAD_BITS);
+        int32_t _2q0 = 2*q0, _2q1 = 2*q1, _2q2 = 2*q2, _2q3 = 2*q3;
+        int32_t _2q0mx = _mul(_2q0, m[0]), _2q0my = _mul(_2q0, m[1]);
+        int32_t _2q0mz = _mul(_2q0, m[2]), _2q1mx = _mul(_2q1, m[0]);
+        int32_t _2q0q2 = _mul(_2q0, q2), _2q2q3 = _mul(_2q2, q3);
+        int32_t q0q0 = _mul(q0, q0), q0q1 = _mul(q0, q1), q0q2 = _mul(q0, q2), q0q3 = _mul(q0, q3);
+        int32_t q1q1 = _mul(q1, q1), q1q2 = _mul(q1, q2), q1q3 = _mul(q1, q3);
+        int32_t q2q2 = _mul(q2, q2), q2q3 = _mul(q2, q3), q3q3 = _mul(q3, q3);
+
+        // Направление магнитного поля Земли
+        int32_t hx = _mul(m[0], q0q0) - _mul(_2q0my, q3) + _mul(_2q0mz, q2) + _mul(m[0], q1q1)
+                   + _mul(_mul(_2q1, m[1]), q2) + _mul(_mul(_2q1, m[2]), q3) - _mul(m[0], q2q2) - _mul(m[0], q3q3);
+        int32_t hy = _mul(_2q0mx, q3) + _mul(m[1], q0q0) - _mul(_2q0mz, q1) + _mul(_2q1mx, q2) - _mul(m[1], q1q1)
+                   + _mul(m[1], q2q2) + _mul(_mul(_2q2, m[2]), q3) - _mul(m[1], q3q3);
+        int32_t _2bx = _sqrt((hx*hx + hy*hy) >> (2*GRAD_BITS - 24)) << (GRAD_BITS - 12);
+        int32_t _2bz = -_mul(_2q0mx, q2) + _mul(_2q0my, q1) + _mul(m[2], q0q0) + _mul(_2q1mx, q3)
+                     - _mul(m[2], q1q1) + _mul(_mul(_2q2, m[1]), q3) - _mul(m[2], q2q2) + _mul(m[2], q3q3);
+        int32_t _4bx = 2*_2bx, _4bz = 2*_2bz;
+
+        // Невязки модели
+        int32_t f1 = 2*q1q3 - _2q0q2 - a[0];
+        int32_t f2 = 2*q0q1 + _2q2q3 - a[1];
+        int32_t f3 = GRAD_ONE - 2*q1q1 - 2*q2q2 - a[2];
+        int32_t f4 = _mul(_2bx, GRAD_ONE/2 - q2q2 - q3q3) + _mul(_2bz, q1q3 - q0q2) - m[0];
+        int32_t f5 = _mul(_2bx, q1q2 - q0q3) + _mul(_2bz, q0q1 + q2q3) - m[1];
+        int32_t f6 = _mul(_2bx, q0q2 + q1q3) + _mul(_2bz, GRAD_ONE/2 - q1q1 - q2q2) - m[2];
+
+        // Градиентный шаг
+        int32_t s[4];
+        s[0] = -_mul(_2q2, f1) + _mul(_2q1, f2) - _mul(_mul(_2bz, q2), f4)
+             + _mul(-_mul(_2bx, q3) + _mul(_2bz, q1), f5) + _mul(_mul(_2bx, q2), f6);
+        s[1] = _mul(_2q3, f1) + _mul(_2q0, f2) - _mul(4*q1, f3) + _mul(_mul(_2bz, q3), f4)
+             + _mul(_mul(_2bx, q2) + _mul(_2bz, q0), f5) + _mul(_mul(_2bx, q3) - _mul(_4bz, q1), f6);
+        s[2] = -_mul(_2q0, f1) + _mul(_2q3, f2) - _mul(4*q2, f3) + _mul(-_mul(_4bx, q2) - _mul(_2bz, q0), f4)
+             + _mul(_mul(_2bx, q1) + _mul(_2bz, q3), f5) + _mul(_mul(_2bx, q0) - _mul(_4bz, q2), f6);
+        s[3] = _mul(_2q1, f1) + _mul(_2q2, f2) + _mul(-_mul(_4bx, q3) + _mul(_2bz, q1), f4)
+             + _mul(-_mul(_2bx, q0) + _mul(_2bz, q2), f5) + _mul(_mul(_2bx, q1), f6);
+        _integrate(gx, gy, gz, _normalizeStep(s));
+    }
+    void update(float gx, float gy, float gz, float ax, float ay, float az) {
+        int32_t a[3];
+        if (!_normalize(ax, ay, az, a)) { _integrate(gx, gy, gz, nullptr); return; }
+        _integrate(gx, gy, gz, _gradientImu(a));
+    }
+    float getYawRad() {
+        float q0, q1, q2, q3;
+        readQuaternion(q0, q1, q2, q3);
+        return atan2(2 * q1 * q2 - 2 * q0 * q3, 2 * q0 * q0 + 2 * q1 * q1 - 1);
+    }
+    float getPitchRad() {
+        float q0, q1, q2, q3;
+        readQuaternion(q0, q1, q2, q3);
+        return atan2(2 * q2 * q3 - 2 * q0 * q1, 2 * q0 * q0 + 2 * q3 * q3 - 1);
+    }
+    float getRollRad() {
+        float q0, q1, q2, q3;
+        readQuaternion(q0, q1, q2, q3);
+        return -1 * atan2(2.0f * (q0 * q2 - q1 * q3), 1.0f - 2.0f * (q2 * q2 + q1 * q1));
+    }
+    float getYawDeg() { return getYawRad() * RAD_TO_DEG; }
+    float getPitchDeg() { return getPitchRad() * RAD_TO_DEG; }
+    float getRollDeg() { return getRollRad() * RAD_TO_DEG; }
+
+private:
+    static constexpr int32_t Q30_ONE = 1L << 30;
+    static constexpr uint8_t GRAD_BITS = 13;
+    static constexpr int32_t GRAD_ONE = 1L << GRAD_BITS;
+    static constexpr int32_t H_MAX = 0.12f * (1L << 20);
+
+    // Произведение двух чисел Q13 с округлением (отбрасывание смещало бы градиент)
+    static int32_t _mul(int32_t a, int32_t b) { return (a * b + (1L << (GRAD_BITS - 1))) >> GRAD_BITS; }
+
+    // Быстрый обратный корень для float (две итерации Ньютона)
+    static float _invSqrt(float x) {
+        union { float f; int32_t i; } u;
+        u.f = x;
+        u.i = 0x5F3759DF - (u.i >> 1);
+        float half = 0.5f * x;
+        u.f *= 1.5f - half * u.f * u.f;
+        u.f *= 1.5f - half * u.f * u.f;
+        return u.f;
+    }
+    // Нормировка входного вектора в Q13, false - нулевой вектор
+    static bool _normalize(float x, float y, float z, int32_t *v) {
+        float norm = x*x + y*y + z*z;
+        if (norm == 0.0f) { return false; }
+        float scale = _invSqrt(norm) * GRAD_ONE;
+        v[0] = x * scale;
+        v[1] = y * scale;
+        v[2] = z * scale;
+        return true;
+    }
+    /* Обратный корень в целых: x - Q24, результат - Q14, 1/sqrt(x) = результат * 2^exp.
+       x приводится к [0.25, 1) сдвигами на 2 бита, начальное приближение - по таблице
+       значений в серединах 24 отрезков, затем 2 итерации Ньютона */
+    static int32_t _invSqrtQ24(uint32_t x, int8_t &exp) {
+        static const uint16_t TABLE[24] = {
+            31790, 30070, 28602, 27330, 26214, 25225, 24339, 23541, 22817, 22155, 21548, 20988,
+            20470, 19988, 19539, 19119, 18725, 18354, 18004, 17674, 17361, 17064, 16782, 16514
+        };
+        exp = 0;
+        if (!x) { return 0; }
+        while (x >= (1UL << 24)) { x >>= 2; --exp; }
+        while (x < (1UL << 22)) { x <<= 2; ++exp; }
+
+        int32_t y = TABLE[(x >> 19) - 8];
+        int32_t x14 = x >> 10;
+        for (uint8_t i = 0; i < 2; ++i) {
+            int32_t xy2 = (x14 * ((y * y) >> 14)) >> 14;
+            y = (y * (3 * (1L << 14) - xy2)) >> 15;
+        }
+        return y;
+    }
+    // Корень из Q24, результат - Q12
+    static int32_t _sqrt(uint32_t x) {
+        int8_t exp;
+        int32_t y = _invSqrtQ24(x, exp);
+        // sqrt(x) = x' * y / 2^exp, где x' = x * 4^exp
+        uint32_t x12 = (exp >= 0 ? x << (2*exp) : x >> (-2*exp)) >> 12;
+        int32_t root = (static_cast<int32_t>(x12) * y) >> 14;
+        return exp >= 0 ? root >> exp : root << -exp;
+    }
+    // Градиентный шаг без магнитометра, a - Q13
+    int32_t *_gradientImu(const int32_t *a) {
+        int32_t q0 = _q[0] >> (30 - GRAD_BITS), q1 = _q[1] >> (30 - GRAD_BITS), q2 = _q[2] >> (30 - GRAD_BITS), q3 = _q[3] >> (30 - GRAD_BITS);
+        int32_t _2q0 = 2*q0, _2q1 = 2*q1, _2q2 = 2*q2, _2q3 = 2*q3;
+        int32_t _4q0 = 4*q0, _4q1 = 4*q1, _4q2 = 4*q2, _8q1 = 8*q1, _8q2 = 8*q2;
+        int32_t q0q0 = _mul(q0, q0), q1q1 = _mul(q1, q1), q2q2 = _mul(q2, q2), q3q3 = _mul(q3, q3);
+
+        static int32_t s[4];
+        s[0] = _mul(_4q0, q2q2) + _mul(_2q2, a[0]) + _mul(_4q0, q1q1) - _mul(_2q1, a[1]);
+        s[1] = _mul(_4q1, q3q3) - _mul(_2q3, a[0]) + _mul(4*q0q0, q1) - _mul(_2q0, a[1]) - _4q1
+             + _mul(_8q1, q1q1) + _mul(_8q1, q2q2) + _mul(_4q1, a[2]);
+        s[2] = _mul(4*q0q0, q2) + _mul(_2q0, a[0]) + _mul(_4q2, q3q3) - _mul(_2q3, a[1]) - _4q2
+             + _mul(_8q2, q1q1) + _mul(_8q2, q2q2) + _mul(_4q2, a[2]);
+        s[3] = _mul(4*q1q1, q3) - _mul(_2q1, a[0]) + _mul(4*q2q2, q3) - _mul(_2q2, a[1]);
+        return _normalizeStep(s);
+    }
+    // Нормировка градиента до единичной длины в Q12, nullptr - нулевой градиент
+    static int32_t *_normalizeStep(int32_t *s) {
+        uint32_t maxAbs = 0;
+        for (uint8_t i = 0; i < 4; ++i) { maxAbs = max(maxAbs, static_cast<uint32_t>(abs(s[i]))); }
+        if (!maxAbs) { return nullptr; }
+
+        // Длина вектора не важна: приводим максимум к [2^12, 2^13), чтобы сумма квадратов поместилась
+        int8_t shift = 0;
+        while (maxAbs >= (1UL << 13)) { maxAbs >>= 1; ++shift; }
+        while (maxAbs < (1UL << 12)) { maxAbs <<= 1; --shift; }
+        uint32_t norm = 0;
+        for (uint8_t i = 0; i < 4; ++i) {
+            s[i] = shift >= 0 ? s[i] >> shift : s[i] * (1L << -shift); // Сдвиг отрицательного влево не определён
+            norm += s[i] * s[i];
+        }
+
+        int8_t exp;
+        int32_t y = _invSqrtQ24(norm, exp);
+        for (uint8_t i = 0; i < 4; ++i) {
+            // 1/|s| = y * 2^exp, exp <= 0 при сумме квадратов не меньше 2^24
+            s[i] = (s[i] * y) >> (14 - exp);
+        }
+        return s;
+    }
+    // Интегрирование производной кватерниона и нормировка, s - нормированный градиент или nullptr
+    void _integrate(float gx, float gy, float gz, const int32_t *s) {
+        int32_t h[3] = {static_cast<int32_t>(gx * _halfDt), static_cast<int32_t>(gy * _halfDt),
+                        static_cast<int32_t>(gz * _halfDt)};
+        for (uint8_t i = 0; i < 3; ++i) {
+            if (h[i] > H_MAX)  { h[i] = H_MAX;  ++_saturations; }
+            if (h[i] < -H_MAX) { h[i] = -H_MAX; ++_saturations; }
+        }
+
+        // Q14 * Q20 = Q34, каждое слагаемое сразу приводится к Q30
+        int32_t q0 = _q[0] >> 16, q1 = _q[1] >> 16, q2 = _q[2] >> 16, q3 = _q[3] >> 16;
+        int32_t dq[4];
+        dq[0] = -((q1 * h[0]) >> 4) - ((q2 * h[1]) >> 4) - ((q3 * h[2]) >> 4);
+        dq[1] =  ((q0 * h[0]) >> 4) + ((q2 * h[2]) >> 4) - ((q3 * h[1]) >> 4);
+        dq[2] =  ((q0 * h[1]) >> 4) - ((q1 * h[2]) >> 4) + ((q3 * h[0]) >> 4);
+        dq[3] =  ((q0 * h[2]) >> 4) + ((q1 * h[1]) >> 4) - ((q2 * h[0]) >> 4);
+        for (uint8_t i = 0; i < 4; ++i) {
+            // Q12 * Q20 = Q32 -> Q30
+            if (s) { dq[i] -= (s[i] * _betaDt) >> 2; }
+            _q[i] += dq[i];
+        }
+
+        // Нормировка: |q|² = 1 + e, множитель 1 - e/2 (ошибка второго порядка убирается на следующем шаге)
+        int32_t norm = 0;
+        for (uint8_t i = 0; i < 4; ++i) {
+            int32_t q15 = _q[i] >> 15;
+            norm += q15 * q15;
+        }
+        int32_t correction = -((norm - Q30_ONE) >> 1);
+        if (abs(correction) < (1L << 22)) {
+            for (uint8_t i = 0; i < 4; ++i) { _q[i] += ((_q[i] >> 15) * (correction >> 7)) >> 8; }
+        }
+        else { // Большое отклонение (после сброса или ограничения) - через float
+            float q[4];
+            readQuaternion(q[0], q[1], q[2], q[3]);
+            float scale = _invSqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]) * Q30_ONE;
+            for (uint8_t i = 0; i < 4; ++i) { _q[i] = q[i] * scale; }
+        }
+    }
+    void _updateGains() {
+        if (_frequency <= 0) { return; }
+        _halfDt = 0.5f / _frequency * (1L << 20);
+        _betaDt = min(_beta / _frequency, 0.49f) * (1L << 20);
+    }
+
+    float _beta = BETA_DEFAULT;
+    float _zeta = ZETA_DEFAULT;
+    float _frequency = 100;
+    float _halfDt = 0.5f / 100 * (1L << 20); // dt/2 в Q20
+    int32_t _betaDt = BETA_DEFAULT / 100 * (1L << 20);
+    int32_t _q[4] = {Q30_ONE, 0, 0, 0};
+    uint16_t _saturations = 0;
+};
+
+#endif // __MADGWICK_FIXED_H__
@@ -0,0 +1,207 @@
+#ifndef __MGN_CALIB_H__
+#define __MGN_CALIB_H__
+
+#include <Arduino.h>
+
+/* Калибровка магнитометра, общая для БУСОС и проверки на ПК
+   (host/mgn_calib_test.cpp).
+   Спутник вращают, отсчёты копятся в нормальные уравнения эллипсоида
+   x'Ax + 2v'x = 1 (9 неизвестных, 54 float), сами отсчёты не хранятся.
+   Решение - разложение Холецкого, затем центр (hard-iron) и симметричная
+   матрица, переводящая эллипсоид в сферу (soft-iron).
+   Время калибровки и сохранение результата - на стороне БУСОС */
+
+#define MGN_CALIB_SAMPLES      300    // Отсчётов для решения
+#define MGN_CALIB_STEP         0.03f  // Гаусс, минимальное расстояние между принятыми отсчётами
+#define MGN_CALIB_OCTANT       30     // Отсчётов в каждом октанте: при одностороннем покрытии
+                                      // решение уходит на единицы процентов
+#define MGN_CALIB_MAX_RESIDUAL 0.1f   // Допустимая RMS невязка (x-c)'M(x-c) - 1
+
+// Калибровка: mgn = matrix·(сырое - bias)
+struct MgnCalibration {
+    float bias[3];
+    float matrix[3][3];
+};
+// Состояние калибровки
+enum MgnCalibState : uint8_t { MGN_CALIB_IDLE, MGN_CALIB_RUNNING, MGN_CALIB_DONE, MGN_CALIB_FAILED };
+struct MgnCalibFit {
+    uint8_t  state;        // MgnCalibState
+    uint8_t  octants;      // Битовая маска октантов, в которых были отсчёты
+    uint8_t  octantSamples[8];
+    uint16_t samples;      // Отсчётов в уравнениях (с последней смены начала)
+    uint32_t startMillis;
+    float    residual;     // RMS невязки последнего решения
+    float    radius;       // Средний радиус эллипсоида (Гаусс)
+    float    last[3];      // Последний принятый отсчёт
+    float    lo[3], hi[3]; // Границы по осям, середина - грубая оценка центра
+    float    origin[3];    // Начало координат уравнений (около центра): при смещении
+                           // больше поля float иначе теряет точность
+    float    ata[45];      // D'D, нижний треугольник по строкам
+    float    atb[9];       // D'·1
+};
+
+// Применение калибровки к вектору v (Гаусс) на месте
+inline void mgnCalibApply(const MgnCalibration &calib, float v[3]) {
+    float r[3] = {v[0] - calib.bias[0], v[1] - calib.bias[1], v[2] - calib.bias[2]};
+    for (uint8_t i = 0; i < 3; ++i) {
+        v[i] = calib.matrix[i][0]*r[0] + calib.matrix[i][1]*r[1] + calib.matrix[i][2]*r[2];
+    }
+}
+
+/* Новый отсчёт (Гаусс, без калибровки): близкие к предыдущему пропускаются.
+   true - отсчётов достаточно и в каждом октанте не меньше MGN_CALIB_OCTANT, можно решать */
+inline bool mgnCalibAdd(MgnCalibFit &fit, const float raw[3]) {
+    float v[3] = {raw[0], raw[1], raw[2]};
+    bool first = !fit.octants;
+    if (!first) {
+        float dist = 0;
+        for (uint8_t i = 0; i < 3; ++i) { dist += (v[i] - fit.last[i]) * (v[i] - fit.last[i]); }
+        if (dist < MGN_CALIB_STEP * MGN_CALIB_STEP) { return false; }
+    }
+    uint8_t octant = 0;
+    bool recenter = false;
+    for (uint8_t i = 0; i < 3; ++i) {
+        if (first || v[i] < fit.lo[i]) { fit.lo[i] = v[i]; }
+        if (first || v[i] > fit.hi[i]) { fit.hi[i] = v[i]; }
+        float mid = (fit.lo[i] + fit.hi[i]) / 2;
+        if (v[i] > mid) { octant |= 1 << i; }
+        fit.last[i] = v[i];
+        // Уравнения x'Ax + 2v'x = 1 не описывают эллипсоид через начало координат,
+        // поэтому начало держится около середины диапазона
+        if (first || fabs(mid - fit.origin[i]) > (fit.hi[i] - fit.lo[i]) / 4) { recenter = true; }
+    }
+    // Смена начала сбрасывает накопленное, пока вращение не покажет весь диапазон,
+    // октанты считаются заново: решение только по отсчётам со всех сторон
+    if (recenter) {
+        for (uint8_t i = 0; i < 3; ++i) { fit.origin[i] = (fit.lo[i] + fit.hi[i]) / 2; }
+        memset(fit.ata, 0, sizeof(fit.ata));
+        memset(fit.atb, 0, sizeof(fit.atb));
+        fit.samples = 0;
+        fit.octants = 0;
+        memset(fit.octantSamples, 0, sizeof(fit.octantSamples));
+    }
+    fit.octants |= 1 << octant;
+    if (fit.octantSamples[octant] < 0xFF) { ++fit.octantSamples[octant]; }
+
+    // Строка D: x², y², z², 2yz, 2xz, 2xy, 2x, 2y, 2z
+    for (uint8_t i = 0; i < 3; ++i) { v[i] -= fit.origin[i]; }
+    float d[9] = {v[0]*v[0], v[1]*v[1], v[2]*v[2], 2*v[1]*v[2], 2*v[0]*v[2], 2*v[0]*v[1], 2*v[0], 2*v[1], 2*v[2]};
+    uint8_t k = 0;
+    for (uint8_t i = 0; i < 9; ++i) {
+        for (uint8_t j = 0; j <= i; ++j) { fit.ata[k++] += d[i] * d[j]; }
+        fit.atb[i] += d[i];
+    }
+    ++fit.samples;
+    if (fit.samples < MGN_CALIB_SAMPLES) { return false; }
+    for (uint8_t i = 0; i < 8; ++i) {
+        if (fit.octantSamples[i] < MGN_CALIB_OCTANT) { return false; }
+    }
+    return true;
+}
+
+// Собственные числа и векторы (по столбцам) симметричной матрицы 3x3 методом Якоби
+inline void jacobiEigen3(float a[3][3], float v[3][3]) {
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t j = 0; j < 3; ++j) { v[i][j] = i == j; }
+    }
+    for (uint8_t sweep = 0; sweep < 10; ++sweep) {
+        float off = fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+        if (off < 1e-9f * (fabs(a[0][0]) + fabs(a[1][1]) + fabs(a[2][2]))) { return; }
+        for (uint8_t p = 0; p < 2; ++p) {
+            for (uint8_t q = p + 1; q < 3; ++q) {
+                if (a[p][q] == 0) { continue; }
+                // Поворот в плоскости (p, q), обнуляющий a[p][q]
+                float theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+                float t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta*theta + 1));
+                float c = 1 / sqrt(t*t + 1), s = t * c;
+                for (uint8_t k = 0; k < 3; ++k) {
+                    float akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c*akp - s*akq;
+                    a[k][q] = s*akp + c*akq;
+                }
+                for (uint8_t k = 0; k < 3; ++k) {
+                    float apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c*apk - s*aqk;
+                    a[q][k] = s*apk + c*aqk;
+                    float vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c*vkp - s*vkq;
+                    v[k][q] = s*vkp + c*vkq;
+                }
+            }
+        }
+    }
+}
+
+/* Решение нормальных уравнений и пересчёт в центр и матрицу (в calib).
+   Уравнения в fit портятся. Возвращает false и не меняет calib, если отсчёты
+   не задают эллипсоид или невязка велика */
+inline bool mgnCalibSolve(MgnCalibFit &fit, MgnCalibration &calib) {
+    // Холецкий: ata = L·L' на месте
+    float *L = fit.ata;
+    for (uint8_t i = 0; i < 9; ++i) {
+        for (uint8_t j = 0; j <= i; ++j) {
+            float sum = L[i*(i+1)/2 + j];
+            for (uint8_t k = 0; k < j; ++k) { sum -= L[i*(i+1)/2 + k] * L[j*(j+1)/2 + k]; }
+            if (i == j) {
+                if (sum <= 0) { return false; }
+                L[i*(i+1)/2 + i] = sqrt(sum);
+            }
+            else { L[i*(i+1)/2 + j] = sum / L[j*(j+1)/2 + j]; }
+        }
+    }
+    // L·y = b, затем L'·θ = y; θ'b = y'y
+    float *x = fit.atb, yy = 0;
+    for (uint8_t i = 0; i < 9; ++i) {
+        for (uint8_t k = 0; k < i; ++k) { x[i] -= L[i*(i+1)/2 + k] * x[k]; }
+        x[i] /= L[i*(i+1)/2 + i];
+        yy += x[i] * x[i];
+    }
+    for (int8_t i = 8; i >= 0; --i) {
+        for (uint8_t k = i + 1; k < 9; ++k) { x[i] -= L[k*(k+1)/2 + i] * x[k]; }
+        x[i] /= L[i*(i+1)/2 + i];
+    }
+
+    float A[3][3] = {{x[0], x[5], x[4]}, {x[5], x[1], x[3]}, {x[4], x[3], x[2]}};
+    // Центр c = -A⁻¹v через присоединённую матрицу
+    float adj[3][3];
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t j = 0; j < 3; ++j) {
+            uint8_t i1 = (j + 1) % 3, i2 = (j + 2) % 3, j1 = (i + 1) % 3, j2 = (i + 2) % 3;
+            adj[i][j] = A[i1][j1]*A[i2][j2] - A[i1][j2]*A[i2][j1];
+        }
+    }
+    float det = A[0][0]*adj[0][0] + A[0][1]*adj[1][0] + A[0][2]*adj[2][0];
+    if (det == 0) { return false; }
+    float c[3], vc = 0;
+    for (uint8_t i = 0; i < 3; ++i) {
+        c[i] = -(adj[i][0]*x[6] + adj[i][1]*x[7] + adj[i][2]*x[8]) / det;
+        vc += x[6+i] * c[i];
+    }
+    // (x-c)'M(x-c) = 1, M = A/(1 - v'c)
+    float scale = 1 - vc;
+    if (scale <= 0) { return false; }
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t j = 0; j < 3; ++j) { A[i][j] /= scale; }
+    }
+    float V[3][3];
+    jacobiEigen3(A, V);
+    if (A[0][0] <= 0 || A[1][1] <= 0 || A[2][2] <= 0) { return false; }
+
+    // Сумма квадратов невязок D·θ - 1: N - θ'b
+    fit.residual = sqrt(max(fit.samples - yy, 0.0f) / fit.samples) / scale;
+    if (fit.residual > MGN_CALIB_MAX_RESIDUAL) { return false; }
+
+    // W = V·diag(√λ)·V'·r: эллипсоид в сферу со средним радиусом r
+    fit.radius = pow(A[0][0] * A[1][1] * A[2][2], -1.0f / 6);
+    float w[3] = {static_cast<float>(sqrt(A[0][0])) * fit.radius, static_cast<float>(sqrt(A[1][1])) * fit.radius,
+                  static_cast<float>(sqrt(A[2][2])) * fit.radius};
+    for (uint8_t i = 0; i < 3; ++i) {
+        calib.bias[i] = c[i] + fit.origin[i];
+        for (uint8_t j = 0; j < 3; ++j) {
+            calib.matrix[i][j] = V[i][0]*w[0]*V[j][0] + V[i][1]*w[1]*V[j][1] + V[i][2]*w[2]*V[j][2];
+        }
+    }
+    return true;
+}
+
+#endif // __MGN_CALIB_H__
@@ -0,0 +1,90 @@
+#ifndef __PHT_CALIB_H__
+#define __PHT_CALIB_H__
+
+#include <Arduino.h>
+
+/* Калибровка фоторезисторов в целых числах.
+   Диапазон [min, max] (значения при 0 и 1023 ед. АЦП, как в map()) при загрузке
+   калибровки переводится в усиление и смещение канала, после этого пересчёт
+   8 каналов - один цикл умножения и сдвига без деления и без ветвлений.
+   - вход: 1/64 единицы АЦП (отфильтрованные значения БУСОС, сырые 10 бит - << 6)
+   - выход: 1/256 единицы калибровки (Q8)
+   - усиление хранится с наибольшей точностью, помещающейся в int16_t:
+     gain·2^-shift единиц Q8 на единицу входа, относительная ошибка < 6e-5
+   - необязательная кусочно-линейная таблица (8 отрезков) выпрямляет характеристику
+     фоторезистора до перевода в единицы калибровки. Таблица общая для всех
+     каналов: фоторезисторы и делители одинаковые, каналы отличаются диапазоном
+   Один и тот же расчёт на БУСОС, БК и на приёмнике, проверка на ПК - host/pht_calib_test.cpp */
+
+#define PHT_CALIB_FULL_SCALE   (1023L * 64) // Вход при 1023 ед. АЦП
+#define PHT_CALIB_LUT_SEGMENTS 8
+#define PHT_CALIB_LUT_SHIFT    13           // Узлы таблицы через 65536 / 8 единиц входа
+
+struct PhtCalibChannel {
+    int32_t offset; // Значение при нулевом входе, Q8
+    int16_t gain;
+    uint8_t shift;  // 1..30
+};
+struct PhtCalib {
+    PhtCalibChannel channel[8];
+    // Выпрямленный вход в узлах x = j·8192 (1/64 единицы АЦП)
+    uint16_t lut[PHT_CALIB_LUT_SEGMENTS + 1];
+    bool useLut;
+};
+
+/* Усиление и смещение канала по диапазону. false - диапазон не конечный
+   или не помещается в Q8: канал тогда выдаёт единицы АЦП (диапазон 0..1023),
+   одинаково на БУСОС, БК и приёмнике */
+inline bool PhtCalib_compileChannel(PhtCalibChannel &channel, float min, float max) {
+    float slope = (max - min) * (256.0f / PHT_CALIB_FULL_SCALE); // Q8 на единицу входа
+    // offset + gain·x должно помещаться в int32_t: |min| + |max - min| < 8·10^6,
+    // усиление при shift = 1 - в int16_t: |max - min| < 4·10^6
+    if (!isfinite(min) || !isfinite(max) || fabs(min) + fabs(max - min) > 8.0e6f || fabs(slope * 2) > 32767.0f) {
+        PhtCalib_compileChannel(channel, 0, 1023);
+        return false;
+    }
+    channel.shift = 1;
+
+    // Наибольший сдвиг, при котором |gain| <= 32767
+    float scaled = slope * 2;
+    while (channel.shift < 30 && fabs(scaled) < 16383.0f) {
+        scaled *= 2;
+        ++channel.shift;
+    }
+    channel.gain = static_cast<int16_t>(lround(scaled));
+    channel.offset = lround(min * 256.0f);
+    return true;
+}
+
+// Таблица без исправления: выход равен входу
+inline void PhtCalib_resetLut(PhtCalib &calib) {
+    for (uint8_t j = 0; j < PHT_CALIB_LUT_SEGMENTS; ++j) { calib.lut[j] = static_cast<uint16_t>(j) << PHT_CALIB_LUT_SHIFT; }
+    calib.lut[PHT_CALIB_LUT_SEGMENTS] = 0xFFFF;
+    calib.useLut = false;
+}
+
+// Линейная интерполяция по таблице
+inline uint16_t PhtCalib_lookup(const uint16_t *lut, uint16_t x) {
+    uint8_t j = x >> PHT_CALIB_LUT_SHIFT;
+    uint16_t frac = x & ((1U << PHT_CALIB_LUT_SHIFT) - 1);
+    int32_t delta = static_cast<int32_t>(lut[j + 1]) - lut[j];
+    return static_cast<uint16_t>(lut[j] + ((delta * frac) >> PHT_CALIB_LUT_SHIFT));
+}
+
+/* Пересчёт 8 каналов: in - 1/64 единицы АЦП, out - Q8.
+   |gain·x| < 2^31, округление - через сдвиг на shift - 1 */
+inline void PhtCalib_apply(const PhtCalib &calib, const uint16_t *in, int32_t *out) {
+    uint16_t x[8];
+    if (calib.useLut) {
+        for (uint8_t i = 0; i < 8; ++i) { x[i] = PhtCalib_lookup(calib.lut, in[i]); }
+    }
+    else { memcpy(x, in, sizeof(x)); }
+
+    for (uint8_t i = 0; i < 8; ++i) {
+        const PhtCalibChannel &channel = calib.channel[i];
+        int32_t product = static_cast<int32_t>(channel.gain) * x[i];
+        out[i] = channel.offset + (((product >> (channel.shift - 1)) + 1) >> 1);
+    }
+}
+
+#endif // __PHT_CALIB_H__
@@ -0,0 +1,83 @@
+#ifndef __PULSE_SCAN_H__
+#define __PULSE_SCAN_H__
+
+#include <stdint.h>
+#include <string.h>
+
+/* Detector pulse scan, shared by the detector firmware and the host bench
+   (host/pulse_scan_bench.cpp).
+   A pulse starts at a sample above DETECTION_THRESHOLD; its peak goes to
+   hist[peak >> shift] and the walk continues down the tail, so the pulse is
+   counted once. Each half buffer is scanned on its own.
+   The packed scan tests a sample pair with one add and one mask: the bias
+   0x8000 - (threshold + 1) added to each halfword sets its top bit exactly when
+   the sample is above threshold. ADC samples are 12-bit, so no halfword carries
+   into the next. This is the GE result of __SSUB16 with the packed threshold
+   read by __SEL, without relying on the GE flags surviving between two separate
+   intrinsics, and it is the same code on every core and on the host (the bench
+   checks it against emulated __SSUB16/__SEL for all 12-bit pairs).
+   PULSE_SCAN_PACKED selects the scan used by the firmware, 0 - scalar reference */
+#define DETECTION_THRESHOLD 600
+#define PULSE_SCAN_SAMPLE_MAX 4095 // 12-bit ADC
+
+#ifndef PULSE_SCAN_PACKED
+#define PULSE_SCAN_PACKED 1
+#endif
+
+// Peak walk from buf[i] above threshold: rise to the peak, then walk down the tail
+// so the pulse is counted once. Returns the last index of the pulse
+static inline uint16_t walkPulse(const uint16_t *buf, uint16_t i, uint16_t size, uint32_t *hist, uint8_t shift) {
+	while (i+1 < size && buf[i+1] >= buf[i]) { ++i; }
+	++hist[buf[i] >> shift];
+	while (i+1 < size && buf[i+1] < buf[i]) { ++i; }
+	return i;
+}
+
+// Reference scan, every sample read from the volatile buffer
+static uint32_t scanPulsesScalar(const volatile uint16_t *buf, uint16_t size, uint32_t *hist, uint8_t shift) {
+	uint32_t count = 0;
+	for (uint16_t i = 0; i < size; ++i) {
+		if (buf[i] > DETECTION_THRESHOLD) {
+			while (i+1 < size && buf[i+1] >= buf[i]) { ++i; }
+			++hist[buf[i] >> shift];
+			while (i+1 < size && buf[i+1] < buf[i]) { ++i; }
+			++count;
+		}
+	}
+	return count;
+}
+
+// Non-zero if a sample of the pair is above threshold (bias2 = packed 0x8000 - (threshold + 1))
+static_assert(PULSE_SCAN_SAMPLE_MAX + 0x8000 - (DETECTION_THRESHOLD + 1) <= 0xFFFF, "pairAbove: halfword carry");
+static inline uint32_t pairAbove(uint32_t pair, uint32_t bias2) {
+	return (pair + bias2) & 0x80008000UL;
+}
+static inline uint32_t loadPair(const uint16_t *p) {
+	uint32_t pair;
+	memcpy(&pair, p, 4);
+	return pair;
+}
+
+// Same result as scanPulsesScalar, buf word aligned
+static uint32_t scanPulsesPacked(const uint16_t *buf, uint16_t size, uint32_t *hist, uint8_t shift) {
+	const uint32_t bias2 = (0x8000 - (DETECTION_THRESHOLD + 1)) * 0x00010001UL;
+	uint32_t count = 0;
+	uint16_t i = 0;
+	while (i < size) {
+		// skip 8, then 2 quiet samples at a time, pairs start at even index
+		if (!(i & 1)) {
+			while (i+8 <= size && !(pairAbove(loadPair(buf+i), bias2) | pairAbove(loadPair(buf+i+2), bias2)
+			                      | pairAbove(loadPair(buf+i+4), bias2) | pairAbove(loadPair(buf+i+6), bias2))) { i += 8; }
+			while (i+2 <= size && !pairAbove(loadPair(buf+i), bias2)) { i += 2; }
+			if (i >= size) { break; }
+		}
+		if (buf[i] > DETECTION_THRESHOLD) {
+			i = walkPulse(buf, i, size, hist, shift);
+			++count;
+		}
+		++i;
+	}
+	return count;
+}
+
+#endif // __PULSE_SCAN_H__
@@ -1,5 +1,6 @@
 #include <GOST4401_81.h>
 #include <SoftwareSerial.h>
+#include "PhtCalib.h"
 
 #include <nRF24L01.h>
 #include <RF24_config.h>
@@ -11,7 +12,7 @@
 #define NRF_RETRIES_COUNT 3
 #define NRF_AUTO_ACK      1
 #define RX_PACKET_SIZE    32
-#define TX_PACKET_SIZE    20
+#define TX_PACKET_SIZE    32
 #define NRF_ADDRESS_TX    0xAAE10CF1F1
 #define NRF_ADDRESS_RX    0xAAE10CF1F0
 
@@ -26,6 +27,7 @@
 #define FLG_PHT_READED_P_1    0x04
 #define FLG_PHT_READED_P_2    0x08
 #define FLG_PHT_READED_P_3    0x10
+#define FLG_PHT_READED_P_4    0x20
 uint8_t FLAGS = FLG_HUMAN_UI|FLG_PRINT_DATA_ALWAYS;
 
 struct Vector {
@@ -44,18 +46,37 @@ RF24 nrf24(10, 9);
 uint8_t stlCount = 0;
 // Координаты
 float gpsLatitude = 0,  gpsLongitude = 0, gpsAltitude = 0, gpsTime = 0;
+uint8_t gpsFence = 0xFF; // Номер геозоны, 255 - вне зон
 // Напряжения
 float mainVoltage = 0, batteryVoltage = 0, solarVoltage = 0;
 float press = 0, temp = 0;
 // Вектора
 Vector gyro, acl, mgn;
+// Ориентация: кватернион (W X Y Z) и углы Эйлера (°): x - крен, y - тангаж, z - рыскание
+float quaternion[4] = {1, 0, 0, 0};
+Vector rotateAngle;
 // Освещённость
 uint16_t phtValues[8] = {};
 Range phtCalibRange[8];
+PhtCalib phtCalib; // Диапазоны в целых числах и таблица линеаризации, как на БУСОС
+// Направление на Солнце по фоторезисторам (в осях спутника) и уверенность 0..1
+Vector sunVector;
+float sunConfidence = 0;
 // Количество частиц
 uint32_t detectionCount = 0;
+// Часть спектра детектора: номер фиксации, число каналов, первый канал, 8 каналов, время набора (мс)
+// и число импульсов (приходит с первой частью, 0xFFFFFF - не меньше)
+uint16_t detHistSeq = 0, detHistBins = 0, detHistFirst = 0;
+uint16_t detHistValues[8] = {};
+uint32_t detHistTime = 0, detHistPulses = 0;
 // Последнее время обновления данных
 uint32_t lastImuMillis = 0, lastGpsMillis = 0, lastPhtMillis = 0, lastTimeDetectorSynch;
+uint32_t lastAttitudeMillis = 0;
+// Привязка millis() BC к UTC (мс от полуночи)
+bool     timeSyncReceived = false;
+uint32_t timeSyncMillis = 0, timeSyncUtc = 0;
+float    timeSyncDrift = 0;
+int32_t  timeSyncResidual = 0;
 
 // Настройка радиомодуля
 void setupNrf() {
@@ -110,7 +131,7 @@ float parseFloat(const uint8_t *data, int32_t minValue, int32_t maxValue, int32_
 uint16_t calcCRC16(const uint16_t *data, uint8_t count) {
     uint16_t CRC = 0;
     for (uint8_t i = 0; i < count; ++i) {
-        CRC = CRC + *data*44111;  //все данные 16-битные
+        CRC = CRC + data[i]*44111;  //все данные 16-битные
         CRC = CRC ^ (CRC >> 8);
     }
     return CRC;
@@ -161,6 +182,28 @@ bool readDetectorData(const uint8_t *data) {
 
     return true;
 }
+bool readDetectorHist(const uint8_t *data) {
+    uint16_t cCRC = calcCRC16(reinterpret_cast<const uint16_t*>(data), 15);
+    uint16_t rCRC = (data[31]<<8) | data[30];
+    if (cCRC != rCRC) { return false; }
+
+    if (data[0] != 0x48 || data[1] != 0xFF || data[2] != 0xFF) { return false; }
+
+    uint16_t time;
+    memcpy(&detHistSeq,   data+3, 2);
+    memcpy(&detHistBins,  data+5, 2);
+    memcpy(&detHistFirst, data+7, 2);
+    memcpy(detHistValues, data+9, 16);
+    memcpy(&time,         data+25, 2);
+    detHistTime = time * 100UL;
+    if (detHistFirst == 0) {
+        detHistPulses = 0;
+        memcpy(&detHistPulses, data+27, 3);
+    }
+
+    if (FLAGS&FLG_PRINT_DATA_ALWAYS) { printDetectorHist(); }
+    return true;
+}
 bool readGpsData(const uint8_t *data) {
     uint16_t cCRC = calcCRC16(reinterpret_cast<const uint16_t*>(data), 15);
     uint16_t rCRC = (data[31]<<8) | data[30];
@@ -174,6 +217,7 @@ bool readGpsData(const uint8_t *data) {
     memcpy(&gpsLongitude, data+7, 4);
     memcpy(&gpsAltitude,  data+11, 4);
     memcpy(&gpsTime,     data+21, 4);
+    gpsFence = data[15];
     memcpy(&lastGpsMillis, data+26, 4);
 
     if (FLAGS&FLG_PRINT_DATA_ALWAYS) { printGpsData(); }
@@ -220,7 +264,20 @@ bool readCalibCoef(const uint8_t *data) {
         memcpy(&phtCalibRange[7].max, data+15, 4);
         FLAGS |= FLG_PHT_READED_P_3;
         break;
+    }
+    case 0x04: {
+        // Таблица линеаризации: признак и узлы
+        for (uint8_t i = 4 + sizeof(phtCalib.lut); i < 27; ++i) {
+            if (data[i] != 0xFF) { return false; }
+        }
+        phtCalib.useLut = data[3] == 1;
+        memcpy(phtCalib.lut, data+4, sizeof(phtCalib.lut));
+        FLAGS |= FLG_PHT_READED_P_4;
+        break;
     }};
+    for (uint8_t i = 0; i < 8; ++i) {
+        PhtCalib_compileChannel(phtCalib.channel[i], phtCalibRange[i].min, phtCalibRange[i].max);
+    }
     return true;
 }
 bool readPthData(const uint8_t *data) {
@@ -231,17 +288,80 @@ bool readPthData(const uint8_t *data) {
     if (data[0] != 0x2B || data[1] != 0xFF || data[2] != 0xFF) {
         return false;
     }
-    for (uint8_t i = 19; i < 26; ++i) {
-        if (data[i] != 0xFF) { return false; }
-    }
 
     memcpy(phtValues, data+3, 16);
+    // Направление на Солнце в 1/16384, уверенность в 1/255
+    int16_t sun[3];
+    memcpy(sun, data+19, 6);
+    sunVector.x = sun[0] / 16384.0f;
+    sunVector.y = sun[1] / 16384.0f;
+    sunVector.z = sun[2] / 16384.0f;
+    sunConfidence = data[25] / 255.0f;
     memcpy(&lastPhtMillis, data+26, 4);
 
     if (FLAGS&FLG_PRINT_DATA_ALWAYS) { printGpsData(); }
     return true;
 }
 
+bool readTimeSyncData(const uint8_t *data) {
+    uint16_t cCRC = calcCRC16(reinterpret_cast<const uint16_t*>(data), 15);
+    uint16_t rCRC = (data[31]<<8) | data[30];
+    if (cCRC != rCRC) { return false; }
+
+    if (data[0] != 0x54 || data[1] != 0xFF || data[2] != 0xFF || !data[19]) { return false; }
+
+    memcpy(&timeSyncMillis,   data+3, 4);
+    memcpy(&timeSyncUtc,      data+7, 4);
+    memcpy(&timeSyncDrift,    data+11, 4);
+    memcpy(&timeSyncResidual, data+15, 4);
+    timeSyncReceived = true;
+    return true;
+}
+bool readAttitudeData(const uint8_t *data) {
+    uint16_t cCRC = calcCRC16(reinterpret_cast<const uint16_t*>(data), 15);
+    uint16_t rCRC = (data[31]<<8) | data[30];
+    if (cCRC != rCRC) { return false; }
+
+    if (data[0] != 0x23 || data[1] != 0xFF || data[2] != 0xFF || data[25] != 0xFF) { return false; }
+
+    int16_t angle[3];
+    memcpy(quaternion, data+3, 16);
+    memcpy(angle, data+19, 6);
+    rotateAngle.x = angle[0] / 100.0f;
+    rotateAngle.y = angle[1] / 100.0f;
+    rotateAngle.z = angle[2] / 100.0f;
+    memcpy(&lastAttitudeMillis, data+26, 4);
+
+    if (FLAGS&FLG_PRINT_DATA_ALWAYS) { printAttitudeData(); }
+    return true;
+}
+// Перевод метки millis() BC в UTC (мс от полуночи) по последнему пакету привязки
+uint32_t millisToUtc(uint32_t ms) {
+    int32_t delta = ms - timeSyncMillis;
+    int32_t utc = timeSyncUtc + delta + (int32_t)(delta * timeSyncDrift);
+    if (utc < 0) { utc += 86400000L; }
+    return (uint32_t)utc % 86400000UL;
+}
+// Печать UTC для метки millis() BC
+void printUtcTime(uint32_t time) {
+    Serial.print(F("UTC: "));
+    if (!timeSyncReceived) { Serial.print(F("нет привязки\n")); return; }
+    uint32_t utc = millisToUtc(time);
+    uint8_t part[3];
+    part[0] = utc / 3600000UL;
+    part[1] = utc / 60000UL % 60;
+    part[2] = utc / 1000 % 60;
+    for (uint8_t i = 0; i < 3; ++i) {
+        if (part[i] < 10) { Serial.print('0'); }
+        Serial.print(part[i]);
+        Serial.print(i < 2 ? ':' : '.');
+    }
+    uint16_t ms = utc % 1000;
+    if (ms < 100) { Serial.print('0'); }
+    if (ms < 10) { Serial.print('0'); }
+    Serial.println(ms);
+}
+
 // Печать данных
 void printDetectorData() {
     if (FLAGS&FLG_HUMAN_UI) {
@@ -249,6 +369,7 @@ void printDetectorData() {
         Serial.println(detectionCount);
         Serial.print(F("lastTimeDetectorSynch: "));
         Serial.println(lastTimeDetectorSynch);
+        printUtcTime(lastTimeDetectorSynch);
         Serial.print(F("mainVoltage: "));
         Serial.println(mainVoltage);
         Serial.print(F("batteryVoltage: "));
@@ -267,7 +388,46 @@ void printDetectorData() {
         Serial.print(SERIAL_SEP);
         Serial.print(batteryVoltage);
         Serial.print(SERIAL_SEP);
-        Serial.println(solarVoltage);
+        Serial.print(solarVoltage);
+        Serial.print(SERIAL_SEP);
+        Serial.println(timeSyncReceived ? millisToUtc(lastTimeDetectorSynch) : 0);
+    }
+}
+void printDetectorHist() {
+    if (FLAGS&FLG_HUMAN_UI) {
+        Serial.print(F("Спектр детектора, фиксация "));
+        Serial.print(detHistSeq);
+        Serial.print(F(", каналы "));
+        Serial.print(detHistFirst);
+        Serial.print('-');
+        Serial.print(detHistFirst + 7);
+        Serial.print(F(" из "));
+        Serial.print(detHistBins);
+        Serial.print(F(", набор "));
+        Serial.print(detHistTime / 1000.0f, 1);
+        Serial.print(F(" с, импульсов "));
+        Serial.print(detHistPulses);
+        Serial.print(F(": "));
+        for (uint8_t i = 0; i < 8; ++i) { Serial.print(detHistValues[i]); Serial.print(' '); }
+        Serial.print('\n');
+    }
+    else {
+        Serial.print(5);
+        Serial.print(SERIAL_SEP);
+        Serial.print(detHistSeq);
+        Serial.print(SERIAL_SEP);
+        Serial.print(detHistBins);
+        Serial.print(SERIAL_SEP);
+        Serial.print(detHistFirst);
+        Serial.print(SERIAL_SEP);
+        Serial.print(detHistTime);
+        for (uint8_t i = 0; i < 8; ++i) {
+            Serial.print(SERIAL_SEP);
+            Serial.print(detHistValues[i]);
+        }
+        Serial.print(SERIAL_SEP);
+        Serial.print(detHistPulses);
+        Serial.print('\n');
     }
 }
 void printImuData() {
@@ -284,6 +444,7 @@ void printImuData() {
         Serial.print(gyro.x); Serial.print(' '); Serial.print(gyro.y); Serial.print(' '); Serial.print(gyro.z);
         Serial.print(F(" °\\с\n"));
         printMillisTime(lastImuMillis);
+        printUtcTime(lastImuMillis);
     }
     else {
         Serial.print(1);
@@ -310,6 +471,37 @@ void printImuData() {
         Serial.print(gyro.z);
         Serial.print(SERIAL_SEP);
         Serial.print(lastImuMillis);
+        Serial.print(SERIAL_SEP);
+        Serial.print(timeSyncReceived ? millisToUtc(lastImuMillis) : 0);
+        Serial.print('\n');
+    }
+}
+void printAttitudeData() {
+    if (FLAGS&FLG_HUMAN_UI) {
+        Serial.print(F("Кватернион (W) (X) (Y) (Z): "));
+        for (uint8_t i = 0; i < 4; ++i) { Serial.print(quaternion[i], 4); Serial.print(' '); }
+        Serial.print(F("\nУгол Эйлера (X) (Y) (Z): "));
+        Serial.print(rotateAngle.x); Serial.print(' '); Serial.print(rotateAngle.y); Serial.print(' '); Serial.print(rotateAngle.z);
+        Serial.print(F(" °\n"));
+        printMillisTime(lastAttitudeMillis);
+        printUtcTime(lastAttitudeMillis);
+    }
+    else {
+        Serial.print(4);
+        Serial.print(SERIAL_SEP);
+        for (uint8_t i = 0; i < 4; ++i) {
+            Serial.print(quaternion[i], 4);
+            Serial.print(SERIAL_SEP);
+        }
+        Serial.print(rotateAngle.x);
+        Serial.print(SERIAL_SEP);
+        Serial.print(rotateAngle.y);
+        Serial.print(SERIAL_SEP);
+        Serial.print(rotateAngle.z);
+        Serial.print(SERIAL_SEP);
+        Serial.print(lastAttitudeMillis);
+        Serial.print(SERIAL_SEP);
+        Serial.print(timeSyncReceived ? millisToUtc(lastAttitudeMillis) : 0);
         Serial.print('\n');
     }
 }
@@ -323,7 +515,11 @@ void printGpsData() {
         Serial.print(gpsAltitude);
         Serial.print(F(" м\\с\nВремя (ччммсс): "));
         Serial.println(gpsTime);
+        Serial.print(F("Геозона: "));
+        if (gpsFence == 0xFF) { Serial.println(F("нет")); }
+        else { Serial.println(gpsFence); }
         printMillisTime(lastGpsMillis);
+        printUtcTime(lastGpsMillis);
     }
     else {
         Serial.print(2);
@@ -336,18 +532,33 @@ void printGpsData() {
         Serial.print(gpsTime);
         Serial.print(SERIAL_SEP);
         Serial.print(lastGpsMillis);
+        Serial.print(SERIAL_SEP);
+        Serial.print(timeSyncReceived ? millisToUtc(lastGpsMillis) : 0);
+        Serial.print(SERIAL_SEP);
+        Serial.print(gpsFence);
         Serial.print('\n');
     }
 }
 void printPhtData() {
     if (FLAGS&FLG_HUMAN_UI) {
+        uint16_t input[8];
+        int32_t values[8];
+        for (uint8_t i = 0; i < 8; ++i) { input[i] = phtValues[i] << 6; }
+        PhtCalib_apply(phtCalib, input, values);
         for (uint8_t i = 0; i < 8; ++i) {
             Serial.print(F("Значение фоторезистора ("));
             Serial.print(i + 1);
             Serial.print(F("): "));
-            Serial.println(map(phtValues[i], 0, 1023, phtCalibRange[i].min, phtCalibRange[i].max));
+            Serial.println(values[i] / 256.0);
         }
+        Serial.print(F("Солнце (X) (Y) (Z): "));
+        Serial.print(sunVector.x, 3); Serial.print(' ');
+        Serial.print(sunVector.y, 3); Serial.print(' ');
+        Serial.print(sunVector.z, 3);
+        Serial.print(F(", уверенность: "));
+        Serial.println(sunConfidence, 2);
         printMillisTime(lastPhtMillis);
+        printUtcTime(lastPhtMillis);
     }
     else {
         Serial.print(3);
@@ -357,6 +568,16 @@ void printPhtData() {
             Serial.print(SERIAL_SEP);
         }
         Serial.print(lastImuMillis);
+        Serial.print(SERIAL_SEP);
+        Serial.print(timeSyncReceived ? millisToUtc(lastPhtMillis) : 0);
+        Serial.print(SERIAL_SEP);
+        Serial.print(sunVector.x, 4);
+        Serial.print(SERIAL_SEP);
+        Serial.print(sunVector.y, 4);
+        Serial.print(SERIAL_SEP);
+        Serial.print(sunVector.z, 4);
+        Serial.print(SERIAL_SEP);
+        Serial.print(sunConfidence, 2);
         Serial.print('\n');
     }
 }
@@ -382,12 +603,15 @@ void serialRequest() {
 
             switch (request) {
                 case 1:  serialRequest_1();  break;
+                case 11: serialRequest_11(); break;
                 case 30: serialRequest_30(); break;
                 case 31: serialRequest_31(); break;
+                case 35: serialRequest_35(); break;
                 case 36: serialRequest_36(); break;
                 case 42: serialRequest_42(); break;
                 case 43: serialRequest_43(); break;
                 case 70: serialRequest_70(); break;
+                case 71: serialRequest_71(); break;
                 default: serialRequestIndefined(request);
             }
         }
@@ -416,6 +640,11 @@ void serialRequest_31() {
     Serial.print(F("OK\n"));
     while(Serial.available() && Serial.read() != '\n') {}
 }
+void serialRequest_35() {
+    printAttitudeData();
+    Serial.print(F("OK\n"));
+    while(Serial.available() && Serial.read() != '\n') {}
+}
 void serialRequest_36() {
     printGpsData();
     Serial.print(F("OK\n"));
@@ -445,8 +674,68 @@ void serialRequest_70() {
         Serial.print(' ');
         Serial.println(phtCalibRange[i].max);
     }
-    Serial.print(F("OK\n"));
+    Serial.print(F("Таблица линеаризации (АЦП): "));
+    if (!phtCalib.useLut) { Serial.print(F("выключена")); }
+    for (uint8_t j = 0; phtCalib.useLut && j <= PHT_CALIB_LUT_SEGMENTS; ++j) {
+        Serial.print(phtCalib.lut[j] / 64.0f); Serial.print(' ');
+    }
+    Serial.print(F("\nOK\n"));
+    while(Serial.available() && Serial.read() != '\n') {}
+}
+void serialRequest_11() {
+    // Запуск калибровки магнитометра: спутник нужно вращать, пока она идёт
+    uint8_t data[TX_PACKET_SIZE];
+    for (uint8_t i = 0; i < TX_PACKET_SIZE; ++i) { data[i] = 0xFF; }
+    data[0] = 11;
     while(Serial.available() && Serial.read() != '\n') {}
+
+    if (nrf24SendData(data)) { Serial.print(F("OK\n")); }
+    else { Serial.print(F("Нет ответа\n")); }
+}
+/* Загрузка геозон на спутник: K71 <операция> <номер зоны> <параметры...>
+   K71 0 0                              - удалить все зоны
+   K71 1 <n> <тип> <делитель> a b c d   - геометрия зоны (0 - круг, 1 - прямоугольник,
+                                          2 - многоугольник, 3 - только высота)
+   K71 2 <n> <мин. высота> <макс. высота>
+   K71 3 0 <номер вершины> <широта> <долгота> - одна вершина многоугольника
+   K71 4 <n>                            - применить зоны с 0 по n (незаданные пропускаются)
+   Координаты - целые в 1e-7 градуса, радиус и высоты - в метрах.
+   Пакет с контрольной суммой, как пакеты со спутника */
+void serialRequest_71() {
+    uint8_t data[TX_PACKET_SIZE];
+    for (uint8_t i = 0; i < TX_PACKET_SIZE; ++i) { data[i] = 0; }
+    data[0] = 71;
+
+    uint8_t op = Serial.parseInt();
+    uint8_t index = Serial.parseInt();
+    data[1] = (op & 0x0F) | (index << 4);
+    int32_t value = 0;
+    switch (op) {
+    case 1:
+        data[2] = Serial.parseInt();
+        data[3] = Serial.parseInt();
+        for (uint8_t i = 0; i < 4; ++i) {
+            value = Serial.parseInt();
+            memcpy(data+4+i*4, &value, 4);
+        }
+        break;
+    case 2:
+        value = Serial.parseInt(); memcpy(data+2, &value, 4);
+        value = Serial.parseInt(); memcpy(data+6, &value, 4);
+        break;
+    case 3:
+        data[2] = Serial.parseInt();
+        data[3] = 1;
+        value = Serial.parseInt(); memcpy(data+4, &value, 4);
+        value = Serial.parseInt(); memcpy(data+8, &value, 4);
+        break;
+    }
+    uint16_t CRC = calcCRC16(reinterpret_cast<const uint16_t*>(data), 15);
+    memcpy(data+30, &CRC, 2);
+    while(Serial.available() && Serial.read() != '\n') {}
+
+    if (nrf24SendData(data)) { Serial.print(F("OK\n")); }
+    else { Serial.print(F("Нет ответа\n")); }
 }
 void printMillisTime(uint32_t time) {
     Serial.print(F("Время: "));
@@ -501,10 +790,13 @@ void nrf24Request() {
     switch(data[0]) {
     case 1: Nrf24Ok(data); break;
     case 31: readImuData(data); break;
+    case 35: readAttitudeData(data); break;
     case 36: readGpsData(data); break;
     case 86: readDetectorData(data); break;
+    case 72: readDetectorHist(data); break;
     case 43: readPthData(data); break;
     case 70: readCalibCoef(data); break;
+    case 84: readTimeSyncData(data); break;
     };
 }
 
@@ -520,7 +812,8 @@ void setup() {
         // Запрашиваем калибровачные значения фоторезисторов, пока их не получим
         // Если не получем ждём ещё calibCoefRequestInterval до следующего запроса
         if (phtCRReqTimeMark < millis() && calibCoefRequestInterval > MIN_INTERVAL_VALUE
-             && (!(FLAGS&FLG_PHT_READED_P_1) || !(FLAGS&FLG_PHT_READED_P_2) || !(FLAGS&FLG_PHT_READED_P_3))) {
+             && (!(FLAGS&FLG_PHT_READED_P_1) || !(FLAGS&FLG_PHT_READED_P_2) || !(FLAGS&FLG_PHT_READED_P_3)
+                 || !(FLAGS&FLG_PHT_READED_P_4))) {
             requestUpdatePthCR();
             phtCRReqTimeMark = millis() + calibCoefRequestInterval;
         }
@@ -0,0 +1,41 @@
+#ifndef __SUN_TRACK_H__
+#define __SUN_TRACK_H__
+
+#include <Arduino.h>
+
+/* Регулятор наведения на Солнце, общий для БУСОС и модели на ПК
+   (host/sun_track_sim.cpp).
+   ПИД по ошибке азимута Солнца относительно нормали целевой панели,
+   демпфирование - по скорости гироскопа Z (а не по производной ошибки,
+   которая шумит и запаздывает на фильтр фоторезисторов).
+   Интеграл копится, только пока выход не в насыщении или ошибка выводит
+   из него, и ограничен SUN_TRACK_I_MAX. Команда -1..1 */
+
+#define SUN_TRACK_PERIOD 20   // мс, период регулятора
+#define SUN_TRACK_KP     6.0f  // на рад
+#define SUN_TRACK_KI     0.2f  // на рад·с
+#define SUN_TRACK_KD     14.0f // на рад/с (модель: 90° - успокоение ~7 с, перерегулирование ~2.5°)
+#define SUN_TRACK_I_MAX  0.3f
+#define SUN_TRACK_DEADBAND 0.03f // Команда меньше - моторы стоят
+
+struct SunTrackGains {
+    float kp, ki, kd;
+};
+struct SunTrackState {
+    float integral; // Вклад интеграла в команду
+    float output;   // Последняя команда -1..1
+};
+
+/* Шаг регулятора: ошибка (рад), скорость (рад/с), период (с) -> команда -1..1 */
+inline float sunTrackStep(SunTrackState &state, const SunTrackGains &gains, float error, float rate, float dt) {
+    float pd = gains.kp * error - gains.kd * rate;
+    float integral = constrain(state.integral + gains.ki * error * dt, -SUN_TRACK_I_MAX, SUN_TRACK_I_MAX);
+    float output = pd + integral;
+    // Антинасыщение: интеграл не растёт, пока выход упирается в предел в ту же сторону
+    if (fabs(output) < 1.0f || output * error < 0) { state.integral = integral; }
+    output = constrain(pd + state.integral, -1.0f, 1.0f);
+    if (fabs(output) < SUN_TRACK_DEADBAND) { output = 0; }
+    return state.output = output;
+}
+
+#endif // __SUN_TRACK_H__
@@ -0,0 +1,24 @@
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+
+/* Минимальная замена Arduino.h для сборки заголовков спутника на ПК:
+   только то, что используют MadgwickFixed.h, GOST4401_Fast.h, SunTrack.h,
+   MgnCalib.h, GyroBias.h, PhtCalib.h и Troyka-IMU */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::abs;
+using std::isfinite;
+using std::max;
+using std::min;
+
+#endif // __HOST_ARDUINO_H__
@@ -0,0 +1,194 @@
+/* Проверка GOST4401_Fast.h на ПК.
+   Высота по давлению, давление и температура по высоте сравниваются с расчётом
+   в double по таблице библиотеки (ag_table) на всём диапазоне:
+   - давления с постоянным шагом log(p) и высоты с шагом ALT_STEP_M
+   - границы слоёв и диапазона: табличное значение и соседние float с обеих сторон
+   Каждое значение считается с кэшем слоя, начинающимся с каждого слоя, -
+   результат не должен зависеть от кэша. NAN должен быть ровно там, где значение
+   вне диапазона таблицы. Для высоты выводится и расхождение с самой библиотекой.
+   Затем выводится время одного вызова (нс) быстрого расчёта и библиотеки на тех же
+   входах - это время на ПК, такты AVR видны только на БУСОС. В сборке с санитайзерами
+   (HOST_NO_TIMING) время не мерится.
+   Ненулевой код возврата - ошибка больше указанной в GOST4401_Fast.h */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "Arduino.h"
+#include <GOST4401_81.h>
+#include "../GOST4401_Fast.h"
+
+#define PRESSURE_STEPS  200000
+#define ALT_STEP_M      0.25
+#define ALT_MARGIN_M    100   // Проход по высоте с запасом за границы диапазона
+#define BOUNDARY_ULPS   4     // Соседних float с каждой стороны границы
+#define TIMING_ROUNDS   20    // Проходов по входам для замера времени, берётся лучший
+
+// Допуски из комментария GOST4401_Fast.h
+#define MAX_ALT_ERROR_M      0.015
+#define MAX_PRESS_REL_ERROR  5e-6
+#define MAX_TEMP_ERROR_K     1e-4
+
+/* Расчёт в double. Слой выбирается так же, как в библиотеке и быстром расчёте:
+   по давлению press[idx] >= p > press[idx + 1], по высоте alt[idx] <= h < alt[idx + 1] */
+static double referenceAltitude(float pressurePa) {
+    int idx = -1;
+    for (int i = 0; i < GOST4401_LUT_RECORDS - 1; ++i) {
+        if (pressurePa <= ag_table[i].press && pressurePa > ag_table[i + 1].press) { idx = i; break; }
+    }
+    if (idx < 0) { return NAN; }
+    const GOST4401_RECORD &layer = ag_table[idx];
+    double ratio = static_cast<double>(layer.press) / pressurePa;
+    double geopotH = layer.t_grad != 0.0f
+        ? layer.temp * (pow(ratio, layer.t_grad * GOST4401_R / GOST4401_G) - 1) / layer.t_grad
+        : GOST4401_R * layer.temp / GOST4401_G * log(ratio);
+    geopotH += layer.alt;
+    return geopotH * GOST4401_E / (GOST4401_E - geopotH);
+}
+static int referenceLayerByAltitude(float altitude, double &geopotH) {
+    geopotH = altitude * static_cast<double>(GOST4401_E) / (GOST4401_E + static_cast<double>(altitude));
+    for (int i = 0; i < GOST4401_LUT_RECORDS - 1; ++i) {
+        if (geopotH >= ag_table[i].alt && geopotH < ag_table[i + 1].alt) { return i; }
+    }
+    return -1;
+}
+static double referencePressure(float altitude) {
+    double geopotH;
+    int idx = referenceLayerByAltitude(altitude, geopotH);
+    if (idx < 0) { return NAN; }
+    const GOST4401_RECORD &layer = ag_table[idx];
+    double h = geopotH - layer.alt;
+    return layer.t_grad != 0.0f
+        ? layer.press * pow(1 + layer.t_grad * h / layer.temp, -GOST4401_G / (layer.t_grad * GOST4401_R))
+        : layer.press * exp(-GOST4401_G * h / (GOST4401_R * layer.temp));
+}
+static double referenceTemperature(float altitude) {
+    double geopotH;
+    int idx = referenceLayerByAltitude(altitude, geopotH);
+    if (idx < 0) { return NAN; }
+    return ag_table[idx].temp + ag_table[idx].t_grad * (geopotH - ag_table[idx].alt);
+}
+
+struct Check {
+    const char *name;
+    double tolerance;
+    bool relative;
+    double maxError = 0, worstInput = 0;
+    uint32_t count = 0, nanErrors = 0, cacheErrors = 0;
+
+    Check(const char *name, double tolerance, bool relative)
+        : name(name), tolerance(tolerance), relative(relative) {}
+
+    // Значение при кэше, начинающемся с каждого слоя; все должны совпадать
+    template <typename Fast>
+    void run(Fast fast, float input, double reference) {
+        float value = 0;
+        for (uint8_t start = 0; start < GOST4401_FAST_LAYERS; ++start) {
+            GOST4401_fastLayer = start;
+            float v = fast(input);
+            if (start == 0) { value = v; }
+            else if (!(v == value || (std::isnan(v) && std::isnan(value)))) { ++cacheErrors; }
+        }
+        ++count;
+        if (std::isnan(reference) || std::isnan(value)) {
+            if (std::isnan(reference) != std::isnan(value)) { ++nanErrors; }
+            return;
+        }
+        double error = fabs(value - reference);
+        if (relative) { error /= fabs(reference); }
+        if (error > maxError) { maxError = error; worstInput = input; }
+    }
+    bool ok() const { return maxError <= tolerance && !nanErrors && !cacheErrors; }
+    void print() const {
+        printf("%-12s %7u values: max error %.3g at %.9g (limit %.3g), NAN mismatches %u, cache mismatches %u%s\n",
+               name, count, maxError, worstInput, tolerance, nanErrors, cacheErrors, ok() ? "" : "  FAIL");
+    }
+};
+
+#ifndef HOST_NO_TIMING
+typedef std::chrono::steady_clock Clock;
+// Результаты замера времени, чтобы компилятор не выбросил вызовы
+static volatile float timingSink;
+
+// Время одного вызова (нс) на всех входах, лучшее из TIMING_ROUNDS проходов
+static double timeCalls(float (*calc)(float), const std::vector<float> &inputs) {
+    double best = 1e12;
+    for (uint8_t round = 0; round < TIMING_ROUNDS; ++round) {
+        float sum = 0;
+        Clock::time_point t0 = Clock::now();
+        for (float input : inputs) { sum += calc(input); }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / inputs.size();
+        if (ns < best) { best = ns; }
+        timingSink = sum;
+    }
+    return best;
+}
+#endif
+
+// Значение и BOUNDARY_ULPS соседних float с каждой стороны
+static std::vector<float> around(float value) {
+    std::vector<float> values(1, value);
+    float below = value, above = value;
+    for (uint8_t i = 0; i < BOUNDARY_ULPS; ++i) {
+        below = nextafterf(below, -INFINITY);
+        above = nextafterf(above, INFINITY);
+        values.push_back(below);
+        values.push_back(above);
+    }
+    return values;
+}
+
+int main() {
+    Check altitude("altitude", MAX_ALT_ERROR_M, false);
+    Check pressure("pressure", MAX_PRESS_REL_ERROR, true);
+    Check temperature("temperature", MAX_TEMP_ERROR_K, false);
+    double libraryDiff = 0;
+
+    // Давления: шаг log(p) от верхней границы таблицы до нижней, затем границы слоёв
+    std::vector<float> pressures;
+    for (uint32_t step = 0; step <= PRESSURE_STEPS; ++step) {
+        double p = GOST4401_MAX_PRESSURE * pow(GOST4401_MIN_PRESSURE / GOST4401_MAX_PRESSURE,
+                                               static_cast<double>(step) / PRESSURE_STEPS);
+        pressures.push_back(static_cast<float>(p));
+    }
+    for (uint8_t i = 0; i < GOST4401_LUT_RECORDS; ++i) {
+        std::vector<float> values = around(ag_table[i].press);
+        pressures.insert(pressures.end(), values.begin(), values.end());
+    }
+    for (float p : pressures) {
+        altitude.run(GOST4401Fast_getAltitude, p, referenceAltitude(p));
+        float lib = GOST4401_getAltitude(p), fast = GOST4401Fast_getAltitude(p);
+        if (!std::isnan(lib) && !std::isnan(fast)) { libraryDiff = std::max(libraryDiff, static_cast<double>(fabs(fast - lib))); }
+    }
+
+    // Высоты: с шагом ALT_STEP_M и геометрические высоты границ слоёв
+    std::vector<float> altitudes;
+    for (double h = -ALT_MARGIN_M; h <= GOST4401_MAX_GPALT + 500 + ALT_MARGIN_M; h += ALT_STEP_M) {
+        altitudes.push_back(static_cast<float>(h));
+    }
+    for (uint8_t i = 0; i < GOST4401_LUT_RECORDS; ++i) {
+        double geopotH = ag_table[i].alt;
+        std::vector<float> values = around(static_cast<float>(geopotH * GOST4401_E / (GOST4401_E - geopotH)));
+        altitudes.insert(altitudes.end(), values.begin(), values.end());
+    }
+    for (float h : altitudes) {
+        pressure.run(GOST4401Fast_getPressure, h, referencePressure(h));
+        temperature.run(GOST4401Fast_getTemperature, h, referenceTemperature(h));
+    }
+
+    altitude.print();
+    printf("altitude     library (float pow/log10) vs fast: max diff %.3g m\n", libraryDiff);
+    pressure.print();
+    temperature.print();
+#ifndef HOST_NO_TIMING
+    // Кэш слоя работает как на спутнике: входы идут подряд
+    printf("timing       altitude: fast %.1f ns/call, library %.1f ns/call\n",
+           timeCalls(GOST4401Fast_getAltitude, pressures), timeCalls(GOST4401_getAltitude, pressures));
+    printf("timing       pressure: fast %.1f ns/call, library %.1f ns/call\n",
+           timeCalls(GOST4401Fast_getPressure, altitudes), timeCalls(GOST4401_getPressure, altitudes));
+    printf("timing       temperature: fast %.1f ns/call, library %.1f ns/call\n",
+           timeCalls(GOST4401Fast_getTemperature, altitudes), timeCalls(GOST4401_getTemperature, altitudes));
+#endif
+    return altitude.ok() && pressure.ok() && temperature.ok() ? 0 : 1;
+}
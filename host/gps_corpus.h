@@ -0,0 +1,92 @@
+#ifndef __GPS_CORPUS_H__
+#define __GPS_CORPUS_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+/* Синтетический корпус NMEA для проверки Kraken::parseNMEA на ПК.
+   Генератор детерминированный (mt19937 с заданным зерном), поэтому стенд
+   и фаззер получают одни и те же байты при каждом запуске */
+
+enum GpsCorpusKind : uint8_t {
+    CORPUS_VALID_GP,     // Верный $GPGGA
+    CORPUS_VALID_GN,     // Верный $GNGGA
+    CORPUS_OTHER_TALKER, // GGA от GL, GA, BD, GB, GQ и $GPRMC - должны отбрасываться
+    CORPUS_BAD_CRC,      // Верный GGA с испорченной контрольной суммой
+    CORPUS_TRUNCATED,    // GGA, оборванный на случайном символе
+    CORPUS_NOISE,        // Случайные байты
+    CORPUS_KINDS
+};
+
+// Значения, которые парсер должен опубликовать для верного сообщения
+struct GpsCorpusExpected {
+    double time, lat, lon, alt;
+    uint8_t stlCount;
+    uint8_t vector;
+};
+
+class GpsCorpus {
+public:
+    explicit GpsCorpus(uint32_t seed) : _rng(seed) {}
+
+    uint32_t random(uint32_t n) { return _rng() % n; }
+    uint32_t random(uint32_t from, uint32_t to) { return from + random(to - from); }
+
+    /* Одно сообщение корпуса типа kind, ожидаемые значения - в expected.
+       Дробные части генерируются с ведущими нулями */
+    std::string sentence(uint8_t kind, GpsCorpusExpected &expected) {
+        static const char *talkers[] = {"GP", "GN", "GL", "GA", "BD", "GB", "GQ"};
+        std::string out;
+
+        if (kind == CORPUS_NOISE) {
+            uint32_t length = random(1, 80);
+            for (uint32_t i = 0; i < length; ++i) { out += static_cast<char>(random(256)); }
+            return out;
+        }
+
+        uint32_t time = random(24)*10000 + random(60)*100 + random(60);
+        uint32_t timeFrac = random(100);
+        uint32_t lat = random(90)*100 + random(60);
+        uint32_t latFrac = random(100000);
+        uint32_t lon = random(180)*100 + random(60);
+        uint32_t lonFrac = random(100000);
+        uint32_t stlCount = random(25);
+        uint32_t alt = random(40000);
+        uint32_t altFrac = random(10);
+        bool south = random(2), west = random(2);
+
+        const char *talker = talkers[kind == CORPUS_VALID_GN ? 1 : 0];
+        const char *type = "GGA";
+        if (kind == CORPUS_OTHER_TALKER) {
+            uint32_t index = random(2, 8);
+            if (index == 7) { type = "RMC"; }
+            else { talker = talkers[index]; }
+        }
+
+        char buf[128];
+        int length = snprintf(buf, sizeof(buf), "$%s%s,%06u.%02u,%04u.%05u,%c,%05u.%05u,%c,1,%02u,0.9,%u.%u,M,0.0,M,,*",
+                              talker, type, time, timeFrac, lat, latFrac, south ? 'S' : 'N',
+                              lon, lonFrac, west ? 'W' : 'E', stlCount, alt, altFrac);
+        uint8_t crc = 0;
+        for (int i = 1; i < length - 1; ++i) { crc ^= static_cast<uint8_t>(buf[i]); }
+        if (kind == CORPUS_BAD_CRC) { crc ^= 1 << random(8); }
+        length += snprintf(buf + length, sizeof(buf) - length, "%02X\r\n", crc);
+
+        if (kind == CORPUS_TRUNCATED) { length = random(1, length - 2); }
+
+        expected.time = time + timeFrac / 100.0;
+        expected.lat = lat + latFrac / 100000.0;
+        expected.lon = lon + lonFrac / 100000.0;
+        expected.alt = alt + altFrac / 10.0;
+        expected.stlCount = stlCount;
+        expected.vector = (south ? 0 : 0b10) | (west ? 0 : 0b01);
+        return std::string(buf, length);
+    }
+
+private:
+    std::mt19937 _rng;
+};
+
+#endif // __GPS_CORPUS_H__
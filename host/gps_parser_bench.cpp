@@ -0,0 +1,124 @@
+/* Стенд Kraken::parseNMEA на ПК.
+   Синтетический корпус (все заголовки, испорченные контрольные суммы,
+   оборванные сообщения, шум) и записанные логи NMEA из командной строки
+   прогоняются через посимвольный и буферный входы парсера.
+   Выводится нс/байт для обоих входов, худшее время на символ, а для корпуса -
+   ложно принятые, ложно отброшенные сообщения и ошибки значений.
+   Ненулевой код возврата - корпус разобран неверно */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <Kraken_GPS_Parser.h>
+#include "gps_corpus.h"
+
+#define GPS_BENCH_SENTENCES 20000
+#define GPS_BENCH_SEED      2022
+#define GPS_BENCH_REPEATS   20 // Повторы для замера нс/байт
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchTiming {
+    double byteNs;    // нс/байт посимвольно
+    double bufferNs;  // нс/байт буфером
+    double byteMaxNs; // Худший случай на символ (вместе с вызовом часов)
+};
+
+static double elapsedNs(Clock::time_point t0, Clock::time_point t1) {
+    return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+static BenchTiming measure(const std::vector<std::string> &sentences) {
+    BenchTiming timing = {0, 0, 0};
+    size_t bytes = 0;
+    for (const std::string &s : sentences) { bytes += s.size(); }
+
+    Clock::time_point t0 = Clock::now();
+    for (int r = 0; r < GPS_BENCH_REPEATS; ++r) {
+        for (const std::string &s : sentences) {
+            for (char c : s) { Kraken::parseNMEA(static_cast<unsigned char>(c)); }
+        }
+    }
+    timing.byteNs = elapsedNs(t0, Clock::now()) / (bytes * GPS_BENCH_REPEATS);
+
+    t0 = Clock::now();
+    for (int r = 0; r < GPS_BENCH_REPEATS; ++r) {
+        for (const std::string &s : sentences) {
+            Kraken::parseNMEA(reinterpret_cast<uint8_t *>(const_cast<char *>(s.data())), static_cast<uint16_t>(s.size()));
+        }
+    }
+    timing.bufferNs = elapsedNs(t0, Clock::now()) / (bytes * GPS_BENCH_REPEATS);
+
+    // Для каждого символа - лучшее время из повторов (без вытеснения ОС), затем худший символ
+    std::vector<double> best(bytes, 1e12);
+    for (int r = 0; r < GPS_BENCH_REPEATS; ++r) {
+        size_t n = 0;
+        for (const std::string &s : sentences) {
+            for (char c : s) {
+                Clock::time_point c0 = Clock::now();
+                Kraken::parseNMEA(static_cast<unsigned char>(c));
+                double ns = elapsedNs(c0, Clock::now());
+                if (ns < best[n]) { best[n] = ns; }
+                ++n;
+            }
+        }
+    }
+    for (double ns : best) { if (ns > timing.byteMaxNs) { timing.byteMaxNs = ns; } }
+    return timing;
+}
+
+static void printTiming(const char *name, size_t bytes, const BenchTiming &timing) {
+    printf("%s: %zu bytes, per-byte %.1f ns/byte, buffer %.1f ns/byte, worst %.0f ns/char\n",
+           name, bytes, timing.byteNs, timing.bufferNs, timing.byteMaxNs);
+}
+
+int main(int argc, char **argv) {
+    // Синтетический корпус и проверка разбора
+    GpsCorpus corpus(GPS_BENCH_SEED);
+    std::vector<std::string> sentences;
+    uint32_t falseAccept = 0, falseReject = 0, valueErrors = 0;
+    size_t bytes = 0;
+
+    for (uint32_t n = 0; n < GPS_BENCH_SENTENCES; ++n) {
+        GpsCorpusExpected expected;
+        uint8_t kind = corpus.random(CORPUS_KINDS);
+        std::string s = corpus.sentence(kind, expected);
+        sentences.push_back(s);
+        bytes += s.size();
+
+        // Метка, по которой видно, обновил ли парсер данные
+        Kraken::gpsTime = NAN;
+        for (char c : s) { Kraken::parseNMEA(static_cast<unsigned char>(c)); }
+        bool updated = !std::isnan(Kraken::gpsTime);
+
+        if (kind != CORPUS_VALID_GP && kind != CORPUS_VALID_GN) {
+            if (updated) { ++falseAccept; }
+            continue;
+        }
+        if (!updated) { ++falseReject; continue; }
+        if (fabs(Kraken::gpsTime - expected.time) > 0.01 || fabs(Kraken::gpsLat - expected.lat) > 1e-6
+            || fabs(Kraken::gpsLon - expected.lon) > 1e-6 || fabs(Kraken::gpsH - expected.alt) > 0.01
+            || Kraken::gpsStlCount != expected.stlCount || Kraken::gpsVector != expected.vector) {
+            ++valueErrors;
+        }
+    }
+    printTiming("synthetic", bytes, measure(sentences));
+    printf("synthetic: %u sentences, false accept %u, false reject %u, value errors %u\n",
+           GPS_BENCH_SENTENCES, falseAccept, falseReject, valueErrors);
+
+    // Записанные логи NMEA
+    for (int i = 1; i < argc; ++i) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) { perror(argv[i]); return 1; }
+        std::string log;
+        for (int c; (c = fgetc(f)) != EOF;) { log += static_cast<char>(c); }
+        fclose(f);
+
+        std::vector<std::string> chunks;
+        for (size_t p = 0; p < log.size(); p += 0xFFFF) { chunks.push_back(log.substr(p, 0xFFFF)); }
+        printTiming(argv[i], log.size(), measure(chunks));
+    }
+    return falseAccept || falseReject || valueErrors ? 1 : 0;
+}
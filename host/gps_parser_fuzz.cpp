@@ -0,0 +1,176 @@
+/* Фаззер Kraken::parseNMEA (libFuzzer).
+   Для каждого входа проверяется:
+   - посимвольный вход, буферный и буферный кусками дают одинаковые данные
+     и одинаковое состояние автомата
+   - данные публикуются только по '\r' после "*XX" с верной контрольной суммой
+   - после любого мусора верное сообщение разбирается в точные значения
+     (мусор не портит состояние парсера)
+   Сборка: make -C host gps_parser_libfuzzer (clang) или make -C host test -
+   тогда входы берутся из синтетического корпуса и генератора случайных байт */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <Kraken_GPS_Parser.h>
+#include "gps_corpus.h"
+
+namespace Kraken {
+// Состояние автомата, в заголовке парсера не объявлено
+extern uint8_t gpsTitleBuf[5];
+extern int8_t parserState;
+extern int8_t gpsElemType;
+extern uint8_t gpsXurSum;
+extern uint8_t gpsCtlSumBuf;
+extern uint8_t gpsCtlSumDigits;
+extern bool gpsTitleValid;
+}
+
+#define FUZZ_CHECK(condition) do { if (!(condition)) { \
+    fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); abort(); } } while (0)
+
+// Опубликованные значения и состояние автомата
+struct ParserSnapshot {
+    double lat, lon;
+    float h, time;
+    uint8_t vector, stlCount;
+    bool ready;
+    int8_t state, elemType;
+    uint8_t xorSum, ctlSum, ctlDigits;
+    bool titleValid;
+
+    static ParserSnapshot take() {
+        ParserSnapshot s;
+        memset(&s, 0, sizeof(s));
+        s.lat = Kraken::gpsLat; s.lon = Kraken::gpsLon;
+        s.h = Kraken::gpsH; s.time = Kraken::gpsTime;
+        s.vector = Kraken::gpsVector; s.stlCount = Kraken::gpsStlCount;
+        s.ready = Kraken::gpsReady;
+        s.state = Kraken::parserState; s.elemType = Kraken::gpsElemType;
+        s.xorSum = Kraken::gpsXurSum; s.ctlSum = Kraken::gpsCtlSumBuf;
+        s.ctlDigits = Kraken::gpsCtlSumDigits; s.titleValid = Kraken::gpsTitleValid;
+        return s;
+    }
+    bool operator==(const ParserSnapshot &o) const {
+        return lat == o.lat && lon == o.lon && h == o.h && time == o.time && vector == o.vector
+            && stlCount == o.stlCount && ready == o.ready && state == o.state
+            && elemType == o.elemType && xorSum == o.xorSum && ctlSum == o.ctlSum
+            && ctlDigits == o.ctlDigits && titleValid == o.titleValid;
+    }
+};
+
+static void resetParser() {
+    Kraken::gpsLat = 0; Kraken::gpsLon = 0;
+    Kraken::gpsH = 0; Kraken::gpsTime = 0;
+    Kraken::gpsVector = 0; Kraken::gpsStlCount = 0;
+    Kraken::gpsReady = false;
+    Kraken::parserState = -1;
+    Kraken::gpsElemType = 0;
+    Kraken::gpsXurSum = 0; Kraken::gpsCtlSumBuf = 0;
+    Kraken::gpsCtlSumDigits = 0; Kraken::gpsTitleValid = false;
+    memset(Kraken::gpsTitleBuf, 0, sizeof(Kraken::gpsTitleBuf));
+}
+
+static int hexValue(uint8_t c) {
+    if (c >= '0' && c <= '9') { return c - '0'; }
+    if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+    return -1;
+}
+/* Может ли сообщение data[start..end] ('$' ... '\r') быть опубликовано:
+   заголовок $GPGGA или $GNGGA, "*XX" перед '\r' и XOR тела между '$' и '*' равен XX */
+static bool isPublishable(const uint8_t *data, size_t start, size_t end) {
+    if (end < start + 10 || data[end - 3] != '*') { return false; }
+    if (memcmp(data + start, "$GPGGA,", 7) != 0 && memcmp(data + start, "$GNGGA,", 7) != 0) { return false; }
+    int hi = hexValue(data[end - 2]), lo = hexValue(data[end - 1]);
+    if (hi < 0 || lo < 0) { return false; }
+    uint8_t crc = 0;
+    for (size_t i = start + 1; i < end - 3; ++i) {
+        if (data[i] == '*') { return false; }
+        crc ^= data[i];
+    }
+    return crc == (hi << 4 | lo);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // 1. Посимвольно, с проверкой каждой публикации
+    resetParser();
+    size_t sentenceStart = SIZE_MAX;
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] == '$') { sentenceStart = i; }
+        float time = Kraken::gpsTime;
+        if (data[i] == '\r') { Kraken::gpsTime = NAN; }
+        Kraken::parseNMEA(static_cast<unsigned char>(data[i]));
+        if (data[i] != '\r') { continue; }
+        if (std::isnan(Kraken::gpsTime)) { Kraken::gpsTime = time; continue; }
+        // Пакет опубликован
+        FUZZ_CHECK(sentenceStart != SIZE_MAX);
+        FUZZ_CHECK(isPublishable(data, sentenceStart, i));
+        sentenceStart = SIZE_MAX;
+    }
+    FUZZ_CHECK(Kraken::parserState >= -2 && Kraken::parserState <= 1);
+    ParserSnapshot perByte = ParserSnapshot::take();
+
+    // 2. Одним буфером
+    resetParser();
+    std::vector<uint8_t> buffer(data, data + size);
+    Kraken::parseNMEA(buffer.data(), static_cast<uint16_t>(size));
+    if (size <= 0xFFFF) { FUZZ_CHECK(ParserSnapshot::take() == perByte); }
+
+    // 3. Кусками, границы - по первому байту входа
+    resetParser();
+    size_t step = size ? data[0] % 17 + 1 : 1;
+    for (size_t i = 0; i < size; i += step) {
+        size_t length = size - i < step ? size - i : step;
+        Kraken::parseNMEA(buffer.data() + i, static_cast<uint16_t>(length));
+    }
+    FUZZ_CHECK(ParserSnapshot::take() == perByte);
+
+    // 4. Верное сообщение после мусора
+    GpsCorpus corpus(size ? data[size - 1] : 0);
+    GpsCorpusExpected expected;
+    std::string sentence = corpus.sentence(CORPUS_VALID_GP, expected);
+    for (char c : sentence) { Kraken::parseNMEA(static_cast<unsigned char>(c)); }
+    FUZZ_CHECK(fabs(Kraken::gpsTime - expected.time) < 0.01);
+    FUZZ_CHECK(fabs(Kraken::gpsLat - expected.lat) < 1e-6);
+    FUZZ_CHECK(fabs(Kraken::gpsLon - expected.lon) < 1e-6);
+    FUZZ_CHECK(fabs(Kraken::gpsH - expected.alt) < 0.01);
+    FUZZ_CHECK(Kraken::gpsStlCount == expected.stlCount);
+    FUZZ_CHECK(Kraken::gpsVector == expected.vector);
+    return 0;
+}
+
+#ifdef GPS_FUZZ_STANDALONE
+/* Без libFuzzer: файлы из командной строки или GPS_FUZZ_RUNS входов
+   из склеенных сообщений корпуса и случайных байт */
+#define GPS_FUZZ_RUNS 20000
+#define GPS_FUZZ_SEED 2022
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) { perror(argv[i]); return 1; }
+        std::vector<uint8_t> input;
+        for (int c; (c = fgetc(f)) != EOF;) { input.push_back(static_cast<uint8_t>(c)); }
+        fclose(f);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    if (argc > 1) { return 0; }
+
+    GpsCorpus corpus(GPS_FUZZ_SEED);
+    GpsCorpusExpected expected;
+    for (uint32_t run = 0; run < GPS_FUZZ_RUNS; ++run) {
+        std::string input;
+        uint32_t count = corpus.random(1, 6);
+        for (uint32_t n = 0; n < count; ++n) { input += corpus.sentence(corpus.random(CORPUS_KINDS), expected); }
+        // Случайная порча отдельных байт
+        uint32_t flips = corpus.random(4);
+        for (uint32_t n = 0; n < flips && !input.empty(); ++n) {
+            input[corpus.random(input.size())] ^= static_cast<char>(1 << corpus.random(8));
+        }
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+    }
+    printf("gps_parser_fuzz: %u inputs OK\n", GPS_FUZZ_RUNS);
+    return 0;
+}
+#endif
@@ -0,0 +1,144 @@
+/* Проверка оценки смещения гироскопа (GyroBias.h) на ПК.
+   - Неподвижный спутник: смещение GYRO_TEST_BIAS и шум гироскопа, шум
+     магнитометра и акселерометра. Окна после первого должны приниматься, оценка - совпадать
+     со смещением в пределах нескольких своих СКО, а СКО - с разбросом оценок.
+   - Медленное ровное вращение (GYRO_TEST_SPIN) с поворотом поля: разброс
+     гироскопа мал, среднее похоже на смещение, но каждое окно после первого
+     (оно только запоминает поле) должно отклоняться по полю.
+   - Толчки (|acl| не g) обрывают окно.
+   - Таблица: интерполяция между ячейками, крайние ячейки вне них, номера
+     ячеек за пределами -40..75 °C, ограничение веса.
+   Ненулевой код возврата - какая-то из проверок не прошла */
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include "Arduino.h"
+#include "../GyroBias.h"
+
+#define GYRO_TEST_SCALE     0.00875f // °/с на единицу, SENS_250DPS
+#define GYRO_TEST_BIAS      137.0f   // Единицы АЦП по X
+#define GYRO_TEST_NOISE     0.1f     // °/с, шум среднего за опрос
+#define GYRO_TEST_MGN_NOISE 0.003f   // Гаусс на ось
+#define GYRO_TEST_ACL_NOISE 0.05f    // м/с²
+#define GYRO_TEST_FIELD     0.5f     // Гаусс
+#define GYRO_TEST_SPIN      0.5f     // °/с
+#define GYRO_TEST_WINDOWS   50
+#define GYRO_TEST_SEED      2022
+
+static const float BIAS[3] = {GYRO_TEST_BIAS, -42.0f, 18.0f};
+
+struct Sensors {
+    std::mt19937 rng;
+    std::normal_distribution<float> n;
+    float angle;          // Поворот вокруг Z (рад)
+    Sensors() : rng(GYRO_TEST_SEED), n(0, 1), angle(0) {}
+
+    // Опрос IMU (10 мс) при вращении rate (°/с) вокруг Z
+    uint8_t cycle(GyroStillWindow &window, float rate, float aclError, float estimate[3], float error[3]) {
+        angle += rate * DEG_TO_RAD * 0.01f;
+        float raw[3], field[3];
+        for (uint8_t i = 0; i < 3; ++i) {
+            raw[i] = BIAS[i] + (i == 2 ? rate : 0) / GYRO_TEST_SCALE + GYRO_TEST_NOISE / GYRO_TEST_SCALE * n(rng);
+        }
+        field[0] = GYRO_TEST_FIELD * 0.4f * cos(angle) + GYRO_TEST_MGN_NOISE * n(rng);
+        field[1] = -GYRO_TEST_FIELD * 0.4f * sin(angle) + GYRO_TEST_MGN_NOISE * n(rng);
+        field[2] = GYRO_TEST_FIELD * 0.92f + GYRO_TEST_MGN_NOISE * n(rng);
+        return gyroStillAdd(window, raw, aclError + GYRO_TEST_ACL_NOISE * n(rng), field, GYRO_TEST_SCALE, estimate, error);
+    }
+};
+
+static bool checkStill() {
+    Sensors sensors;
+    GyroStillWindow window = {};
+    uint16_t accepted = 0, rejected = 0;
+    float worst = 0, sumSq = 0, sumError = 0;
+    for (uint32_t k = 0; k < GYRO_TEST_WINDOWS * GYRO_STILL_CYCLES; ++k) {
+        float estimate[3], error[3];
+        uint8_t result = sensors.cycle(window, 0, 0, estimate, error);
+        if (result == GYRO_STILL_REJECTED) { ++rejected; }
+        if (result != GYRO_STILL_ACCEPTED) { continue; }
+        ++accepted;
+        for (uint8_t i = 0; i < 3; ++i) {
+            float d = (estimate[i] - BIAS[i]) * GYRO_TEST_SCALE;
+            worst = max(worst, static_cast<float>(fabs(d) / error[i]));
+            sumSq += d * d;
+            sumError += error[i];
+        }
+    }
+    float spread = accepted ? sqrt(sumSq / (3 * accepted)) : 0, meanError = accepted ? sumError / (3 * accepted) : 0;
+    bool ok = accepted == GYRO_TEST_WINDOWS - 1 && worst < 4 && spread < 1.5f * meanError && spread > meanError / 1.5f;
+    printf("still: %u accepted, %u rejected, estimate spread %.4f deg/s, reported error %.4f deg/s, worst %.1f sigma%s\n",
+           accepted, rejected, spread, meanError, worst, ok ? "" : "  FAIL");
+    return ok;
+}
+
+static bool checkSpin() {
+    Sensors sensors;
+    GyroStillWindow window = {};
+    uint16_t accepted = 0, rejected = 0;
+    for (uint32_t k = 0; k < GYRO_TEST_WINDOWS * GYRO_STILL_CYCLES; ++k) {
+        float estimate[3], error[3];
+        uint8_t result = sensors.cycle(window, GYRO_TEST_SPIN, 0, estimate, error);
+        accepted += result == GYRO_STILL_ACCEPTED;
+        rejected += result == GYRO_STILL_REJECTED;
+    }
+    bool ok = !accepted && rejected == GYRO_TEST_WINDOWS - 1;
+    printf("spin %.1f deg/s: %u accepted, %u rejected%s\n", GYRO_TEST_SPIN, accepted, rejected, ok ? "" : "  FAIL");
+    return ok;
+}
+
+// Толчок посреди каждого окна: ни одно не принимается, каждое отклоняется
+static bool checkBumps() {
+    Sensors sensors;
+    GyroStillWindow window = {};
+    uint16_t accepted = 0, rejected = 0;
+    for (uint32_t k = 0; k < GYRO_TEST_WINDOWS * GYRO_STILL_CYCLES; ++k) {
+        float estimate[3], error[3];
+        uint8_t result = sensors.cycle(window, 0, k % GYRO_STILL_CYCLES == GYRO_STILL_CYCLES - 10 ? 2.0f : 0, estimate, error);
+        accepted += result == GYRO_STILL_ACCEPTED;
+        rejected += result == GYRO_STILL_REJECTED;
+    }
+    bool ok = !accepted && rejected == GYRO_TEST_WINDOWS;
+    printf("bumps: %u accepted, %u rejected%s\n", accepted, rejected, ok ? "" : "  FAIL");
+    return ok;
+}
+
+static bool near(float a, float b) {
+    return fabs(a - b) < 0.07f; // Ячейки хранят 1/16 единицы
+}
+
+static bool checkTable() {
+    GyroBiasCell table[GYRO_TABLE_SIZE] = {};
+    float bias[3] = {1, 2, 3};
+    bool ok = !gyroBiasInterpolate(table, 20, bias) && bias[0] == 1 && bias[1] == 2 && bias[2] == 3;
+
+    const float cold[3] = {100, -50, 10}, warm[3] = {120, -40, 0};
+    ok &= gyroBiasLearn(table, 10.4f, cold) == 10;  // 10 °C
+    ok &= gyroBiasLearn(table, 29.0f, warm) == 14;  // 30 °C
+    ok &= gyroBiasInterpolate(table, 20, bias) && near(bias[0], 110) && near(bias[1], -45) && near(bias[2], 5);
+    ok &= gyroBiasInterpolate(table, 27.5f, bias) && near(bias[0], 117.5f);
+    ok &= gyroBiasInterpolate(table, -30, bias) && near(bias[0], 100); // Ниже заполненных - крайняя
+    ok &= gyroBiasInterpolate(table, 60, bias) && near(bias[0], 120);  // Выше - крайняя
+
+    // Вне таблицы - в крайние ячейки
+    ok &= gyroBiasLearn(table, -60, cold) == 0;
+    ok &= gyroBiasLearn(table, 100, warm) == GYRO_TABLE_SIZE - 1;
+
+    // Вес не больше GYRO_TABLE_WEIGHT_MAX, ячейка сходится к новым оценкам
+    const float drift[3] = {130, -30, -10};
+    for (uint8_t k = 0; k < 100; ++k) { gyroBiasLearn(table, 10, drift); }
+    ok &= table[10].weight == GYRO_TABLE_WEIGHT_MAX;
+    ok &= gyroBiasInterpolate(table, 10, bias) && fabs(bias[0] - 130) < 0.5f && fabs(bias[2] + 10) < 0.5f;
+    printf("table: interpolation, clamping and weight %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    ok &= checkStill();
+    ok &= checkSpin();
+    ok &= checkBumps();
+    ok &= checkTable();
+    return ok ? 0 : 1;
+}
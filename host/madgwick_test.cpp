@@ -0,0 +1,215 @@
+/* Точность MadgwickFixed по сравнению с float Madgwick из Troyka-IMU.
+   Оба фильтра получают одинаковые показания на синтетических траекториях
+   (истинная ориентация интегрируется точно, g и поле Земли переводятся
+   в связанную систему, к показаниям добавляется шум) и на записанных
+   логах из командной строки: строки "gx gy gz ax ay az mx my mz"
+   (рад/с, м/с², Гс) с частотой AHRS_FREQUENCY.
+   Для 9 осей сравнивается ориентация, для 6 - только вертикаль (рыскание
+   без магнитометра не наблюдается). Выводится расхождение фильтров и ошибка
+   каждого относительно истинной ориентации (°).
+   Затем выводится время update обоих фильтров (нс) - это время на ПК, оно
+   сравнивает фильтры между собой, такты AVR видны только на БУСОС.
+   В сборке с санитайзерами (HOST_NO_TIMING) время не мерится.
+   Ненулевой код возврата - расхождение или ошибка больше допуска */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "Arduino.h"
+#include <MadgwickAHRS.h>
+#include "../MadgwickFixed.h"
+
+#define AHRS_FREQUENCY  100   // Гц, как AHRS_FREQUENCY_DEFAULT на БУСОС
+#define GRAVITY_EARTH   9.80665f
+#define MAX_DIFF_DEG        2.0f  // Допуск на расхождение фильтров после схождения
+#define MAX_EXTRA_ERROR_DEG 0.1f  // Насколько ошибка MadgwickFixed (с.к.о.) может быть больше float
+#define SETTLE_STEPS    300   // Шагов на схождение из начального положения
+#define TIMING_ROUNDS   50    // Проходов трассы для замера времени, берётся лучший
+
+typedef std::chrono::steady_clock Clock;
+
+// Показания датчиков (9 значений на шаг) и истинная ориентация, если известна
+struct Trace {
+    std::vector<std::vector<float> > samples;
+    std::vector<std::vector<float> > truth;
+};
+
+struct Trajectory {
+    const char *name;
+    float w[3];       // Угловая скорость (рад/с)
+    float tilt;       // Начальный наклон вокруг x (рад), фильтры стартуют с единичного кватерниона
+    float gyroNoise;  // рад/с
+    float aclNoise;   // м/с²
+    float mgnNoise;   // Гс
+    uint16_t steps;
+};
+
+static const Trajectory TRAJECTORIES[] = {
+    {"static",        {0, 0, 0},            0,    0.005f, 0.05f, 0.003f, 3000},
+    {"slow rotation", {0.3f, -0.2f, 0.5f},  0,    0.01f,  0.05f, 0.005f, 3000},
+    {"fast rotation", {2.5f, 1.5f, -3.0f},  0,    0.02f,  0.1f,  0.005f, 3000},
+    {"tilted start",  {0, 0, 0.1f},         1.0f, 0.01f,  0.05f, 0.005f, 3000},
+};
+
+// Показания датчиков на траектории
+static Trace simulate(const Trajectory &t, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0, 1);
+    const float dt = 1.0f / AHRS_FREQUENCY;
+    const float g[3] = {0, 0, GRAVITY_EARTH}, b[3] = {0.2f, 0, -0.45f};
+    double q[4] = {cos(t.tilt / 2), sin(t.tilt / 2), 0, 0};
+    Trace trace;
+
+    for (uint16_t step = 0; step < t.steps; ++step) {
+        // Точный поворот за шаг: кватернион угловой скорости
+        double wn = sqrt(t.w[0]*t.w[0] + t.w[1]*t.w[1] + t.w[2]*t.w[2]);
+        if (wn > 0) {
+            double half = wn * dt / 2, k = sin(half) / wn;
+            double r[4] = {cos(half), t.w[0] * k, t.w[1] * k, t.w[2] * k};
+            double n[4] = {q[0]*r[0] - q[1]*r[1] - q[2]*r[2] - q[3]*r[3],
+                           q[0]*r[1] + q[1]*r[0] + q[2]*r[3] - q[3]*r[2],
+                           q[0]*r[2] - q[1]*r[3] + q[2]*r[0] + q[3]*r[1],
+                           q[0]*r[3] + q[1]*r[2] - q[2]*r[1] + q[3]*r[0]};
+            for (uint8_t i = 0; i < 4; ++i) { q[i] = n[i]; }
+        }
+        // Строки матрицы поворота = столбцы R^T
+        double m[3][3] = {
+            {1 - 2*(q[2]*q[2] + q[3]*q[3]), 2*(q[1]*q[2] - q[0]*q[3]), 2*(q[1]*q[3] + q[0]*q[2])},
+            {2*(q[1]*q[2] + q[0]*q[3]), 1 - 2*(q[1]*q[1] + q[3]*q[3]), 2*(q[2]*q[3] - q[0]*q[1])},
+            {2*(q[1]*q[3] - q[0]*q[2]), 2*(q[2]*q[3] + q[0]*q[1]), 1 - 2*(q[1]*q[1] + q[2]*q[2])}};
+        std::vector<float> sample(9);
+        for (uint8_t i = 0; i < 3; ++i) {
+            sample[i]   = t.w[i] + t.gyroNoise * noise(rng);
+            sample[3+i] = m[0][i]*g[0] + m[1][i]*g[1] + m[2][i]*g[2] + t.aclNoise * noise(rng);
+            sample[6+i] = m[0][i]*b[0] + m[1][i]*b[1] + m[2][i]*b[2] + t.mgnNoise * noise(rng);
+        }
+        trace.samples.push_back(sample);
+        trace.truth.push_back(std::vector<float>(q, q + 4));
+    }
+    return trace;
+}
+
+// Угол между ориентациями (°): через atan2, acos теряет точность у малых углов
+static float angleBetween(const float *a, const float *c) {
+    // Вращение conj(a)·c
+    double w = (double)a[0]*c[0] + (double)a[1]*c[1] + (double)a[2]*c[2] + (double)a[3]*c[3];
+    double x = (double)a[0]*c[1] - (double)a[1]*c[0] - (double)a[2]*c[3] + (double)a[3]*c[2];
+    double y = (double)a[0]*c[2] + (double)a[1]*c[3] - (double)a[2]*c[0] - (double)a[3]*c[1];
+    double z = (double)a[0]*c[3] - (double)a[1]*c[2] + (double)a[2]*c[1] - (double)a[3]*c[0];
+    return 2 * atan2(sqrt(x*x + y*y + z*z), fabs(w)) * RAD_TO_DEG;
+}
+// Угол между направлениями вертикали (°): без магнитометра рыскание не наблюдается
+static float tiltBetween(const float *a, const float *c) {
+    double za[3] = {2.0*(a[1]*a[3] - a[0]*a[2]), 2.0*(a[2]*a[3] + a[0]*a[1]), 1 - 2.0*(a[1]*a[1] + a[2]*a[2])};
+    double zc[3] = {2.0*(c[1]*c[3] - c[0]*c[2]), 2.0*(c[2]*c[3] + c[0]*c[1]), 1 - 2.0*(c[1]*c[1] + c[2]*c[2])};
+    double cross[3] = {za[1]*zc[2] - za[2]*zc[1], za[2]*zc[0] - za[0]*zc[2], za[0]*zc[1] - za[1]*zc[0]};
+    double dot = za[0]*zc[0] + za[1]*zc[1] + za[2]*zc[2];
+    return atan2(sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]), dot) * RAD_TO_DEG;
+}
+
+struct Stats {
+    float maxValue = 0, sumSq = 0;
+    uint32_t count = 0;
+    void add(float value) { maxValue = std::max(maxValue, value); sumSq += value * value; ++count; }
+    float rms() const { return count ? sqrt(sumSq / count) : 0; }
+};
+
+/* Прогон трассы через оба фильтра. Сравниваются ориентации фильтров между собой,
+   а если истинная ориентация известна - ошибка каждого фильтра относительно неё.
+   false - расхождение фильтров или лишняя ошибка MadgwickFixed больше допуска */
+static bool compare(const char *name, const Trace &trace, bool useMagnetometer) {
+    Madgwick reference;
+    MadgwickFixed fixed;
+    reference.begin(); reference.setSettings(BETA_DEFAULT); reference.setFrequency(AHRS_FREQUENCY);
+    fixed.begin();     fixed.setSettings(BETA_DEFAULT);     fixed.setFrequency(AHRS_FREQUENCY);
+    float (*metric)(const float *, const float *) = useMagnetometer ? angleBetween : tiltBetween;
+
+    Stats diff, referenceError, fixedError;
+    for (size_t step = 0; step < trace.samples.size(); ++step) {
+        const std::vector<float> &s = trace.samples[step];
+        if (useMagnetometer) {
+            reference.update(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8]);
+            fixed.update(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8]);
+        }
+        else {
+            reference.update(s[0], s[1], s[2], s[3], s[4], s[5]);
+            fixed.update(s[0], s[1], s[2], s[3], s[4], s[5]);
+        }
+        if (step < SETTLE_STEPS) { continue; }
+
+        float a[4], c[4];
+        reference.readQuaternion(a[0], a[1], a[2], a[3]);
+        fixed.readQuaternion(c[0], c[1], c[2], c[3]);
+        diff.add(metric(a, c));
+        if (!trace.truth.empty()) {
+            referenceError.add(metric(a, trace.truth[step].data()));
+            fixedError.add(metric(c, trace.truth[step].data()));
+        }
+    }
+
+    bool ok = diff.maxValue <= MAX_DIFF_DEG && fixedError.rms() <= referenceError.rms() + MAX_EXTRA_ERROR_DEG;
+    printf("%-16s %d-axis: diff max %.3f rms %.3f deg", name, useMagnetometer ? 9 : 6, diff.maxValue, diff.rms());
+    if (!trace.truth.empty()) {
+        printf(", error rms float %.3f fixed %.3f deg", referenceError.rms(), fixedError.rms());
+    }
+    printf(", saturations %u%s\n", fixed.saturations(), ok ? "" : "  FAIL");
+    return ok;
+}
+
+// Ориентации с замера времени, чтобы компилятор не выбросил update
+static volatile float timingSink;
+
+// Время одного update (нс) на трассе, лучшее из TIMING_ROUNDS проходов
+template <typename Filter>
+static double timeUpdate(const Trace &trace, bool useMagnetometer) {
+    double best = 1e12;
+    for (uint8_t round = 0; round < TIMING_ROUNDS; ++round) {
+        Filter filter;
+        filter.begin(); filter.setSettings(BETA_DEFAULT); filter.setFrequency(AHRS_FREQUENCY);
+        Clock::time_point t0 = Clock::now();
+        for (const std::vector<float> &s : trace.samples) {
+            if (useMagnetometer) { filter.update(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], s[8]); }
+            else { filter.update(s[0], s[1], s[2], s[3], s[4], s[5]); }
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / trace.samples.size();
+        if (ns < best) { best = ns; }
+        float w, x, y, z;
+        filter.readQuaternion(w, x, y, z);
+        timingSink = w + x + y + z;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    bool ok = true;
+    for (const Trajectory &t : TRAJECTORIES) {
+        Trace trace = simulate(t, 2022);
+        ok &= compare(t.name, trace, true);
+        ok &= compare(t.name, trace, false);
+    }
+#ifndef HOST_NO_TIMING
+    // Время на траектории с быстрым вращением: все ветви фильтров работают
+    Trace timingTrace = simulate(TRAJECTORIES[2], 2022);
+    for (uint8_t axes = 9; axes >= 6; axes -= 3) {
+        double floatNs = timeUpdate<Madgwick>(timingTrace, axes == 9);
+        double fixedNs = timeUpdate<MadgwickFixed>(timingTrace, axes == 9);
+        printf("timing           %u-axis: float %.1f ns/update, fixed %.1f ns/update\n", axes, floatNs, fixedNs);
+    }
+#endif
+    // Записанные логи IMU
+    for (int i = 1; i < argc; ++i) {
+        FILE *f = fopen(argv[i], "r");
+        if (!f) { perror(argv[i]); return 1; }
+        Trace trace;
+        std::vector<float> s(9);
+        while (fscanf(f, "%f %f %f %f %f %f %f %f %f", &s[0], &s[1], &s[2], &s[3], &s[4], &s[5], &s[6], &s[7], &s[8]) == 9) {
+            trace.samples.push_back(s);
+        }
+        fclose(f);
+        ok &= compare(argv[i], trace, true);
+        ok &= compare(argv[i], trace, false);
+    }
+    return ok ? 0 : 1;
+}
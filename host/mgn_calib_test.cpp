@@ -0,0 +1,138 @@
+/* Проверка калибровки магнитометра (MgnCalib.h) на ПК.
+   Поле Земли (MGN_TEST_FIELD) проходит по спирали все направления, как при
+   вращении спутника, к нему применяются soft-iron (симметричная матрица),
+   смещение hard-iron и шум. Отсчёты подаются в mgnCalibAdd, пока он не
+   разрешит решение, затем mgnCalibSolve. Для каждого смещения выводятся:
+   - ошибка найденного смещения (мГс)
+   - разброс модуля откалиброванного поля по направлениям (без шума, %)
+   - поворот осей: отклонение matrix·S от кратной единичной (%)
+   Вращение вокруг одной оси не должно давать калибровку: по третьей оси
+   эллипсоид не наблюдается.
+   Ненулевой код возврата - калибровка не сошлась или ошибка больше допуска */
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include "Arduino.h"
+#include "../MgnCalib.h"
+
+#define MGN_TEST_FIELD      0.5f   // Гаусс
+#define MGN_TEST_NOISE      0.005f // Гаусс на ось, 1% поля
+#define MGN_TEST_SPIRAL     600    // Точек на проход спирали от полюса до полюса
+#define MGN_TEST_TURNS      12     // Витков спирали за проход
+#define MGN_TEST_MAX_PASSES 20     // Проходов туда и обратно до отказа
+#define MGN_TEST_SEED       2022
+
+// Допуски
+#define MAX_BIAS_ERROR_MG   2.0f   // мГс
+#define MAX_SPREAD_PCT      1.0f   // %
+#define MAX_ROTATION_PCT    1.0f   // %
+
+// Soft-iron: симметричная, без поворота осей
+static const float SOFT_IRON[3][3] = {
+    { 1.08f,  0.04f, -0.03f},
+    { 0.04f,  0.93f,  0.05f},
+    {-0.03f,  0.05f,  1.02f},
+};
+static const float OFFSETS[] = {0.3f, 1.0f, 2.0f, 3.5f}; // Гаусс
+static const float OFFSET_DIR[3] = {0.6f, -0.48f, 0.64f};
+
+// Направление точки k спирали (единичный вектор)
+static void spiral(uint16_t k, float dir[3]) {
+    float theta = M_PI * (k + 0.5f) / MGN_TEST_SPIRAL;
+    float phi = 2 * M_PI * MGN_TEST_TURNS * (k + 0.5f) / MGN_TEST_SPIRAL;
+    dir[0] = sin(theta) * cos(phi);
+    dir[1] = sin(theta) * sin(phi);
+    dir[2] = cos(theta);
+}
+// Показание магнитометра для направления поля dir
+static void sensor(const float dir[3], const float offset[3], float noise, std::mt19937 &rng, float raw[3]) {
+    std::normal_distribution<float> n(0, 1);
+    for (uint8_t i = 0; i < 3; ++i) {
+        raw[i] = offset[i] + noise * n(rng);
+        for (uint8_t j = 0; j < 3; ++j) { raw[i] += SOFT_IRON[i][j] * dir[j] * MGN_TEST_FIELD; }
+    }
+}
+
+static bool checkOffset(float offsetNorm) {
+    float offset[3];
+    for (uint8_t i = 0; i < 3; ++i) { offset[i] = OFFSET_DIR[i] * offsetNorm; }
+    std::mt19937 rng(MGN_TEST_SEED);
+    MgnCalibFit fit;
+    memset(&fit, 0, sizeof(fit));
+    MgnCalibration calib = {{0, 0, 0}, {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+
+    // Спираль туда и обратно, пока уравнения не готовы
+    bool ready = false;
+    uint32_t fed = 0;
+    for (uint16_t pass = 0; pass < MGN_TEST_MAX_PASSES && !ready; ++pass) {
+        for (uint16_t k = 0; k < MGN_TEST_SPIRAL && !ready; ++k, ++fed) {
+            float dir[3], raw[3];
+            spiral(pass % 2 ? MGN_TEST_SPIRAL - 1 - k : k, dir);
+            sensor(dir, offset, MGN_TEST_NOISE, rng, raw);
+            ready = mgnCalibAdd(fit, raw);
+        }
+    }
+    if (!ready || !mgnCalibSolve(fit, calib)) {
+        printf("offset %.1f G: %s after %u samples  FAIL\n", offsetNorm, ready ? "solve failed" : "not ready", fed);
+        return false;
+    }
+
+    float biasError = 0;
+    for (uint8_t i = 0; i < 3; ++i) { biasError += (calib.bias[i] - offset[i]) * (calib.bias[i] - offset[i]); }
+    biasError = sqrt(biasError) * 1000;
+
+    // Модуль откалиброванного поля по направлениям спирали, без шума
+    float lo = 1e9f, hi = 0, sum = 0;
+    for (uint16_t k = 0; k < MGN_TEST_SPIRAL; ++k) {
+        float dir[3], v[3];
+        spiral(k, dir);
+        sensor(dir, offset, 0, rng, v);
+        mgnCalibApply(calib, v);
+        float norm = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+        lo = min(lo, norm); hi = max(hi, norm); sum += norm;
+    }
+    float mean = sum / MGN_TEST_SPIRAL;
+    float spread = (hi - lo) / mean * 100;
+
+    // matrix·S должна быть mean/поле·I: оси не повёрнуты
+    float rotation = 0;
+    for (uint8_t i = 0; i < 3; ++i) {
+        for (uint8_t j = 0; j < 3; ++j) {
+            float ms = 0;
+            for (uint8_t k = 0; k < 3; ++k) { ms += calib.matrix[i][k] * SOFT_IRON[k][j]; }
+            rotation = max(rotation, static_cast<float>(fabs(ms / (mean / MGN_TEST_FIELD) - (i == j))));
+        }
+    }
+    rotation *= 100;
+
+    bool ok = biasError <= MAX_BIAS_ERROR_MG && spread <= MAX_SPREAD_PCT && rotation <= MAX_ROTATION_PCT;
+    printf("offset %.1f G: %u samples, residual %.4f, bias error %.2f mG, spread %.3f%%, axes %.3f%%%s\n",
+           offsetNorm, fed, fit.residual, biasError, spread, rotation, ok ? "" : "  FAIL");
+    return ok;
+}
+
+// Вращение только вокруг Z: уравнения вырождены, решения быть не должно
+static bool checkPlanar() {
+    std::mt19937 rng(MGN_TEST_SEED);
+    MgnCalibFit fit;
+    memset(&fit, 0, sizeof(fit));
+    MgnCalibration calib;
+    const float offset[3] = {0.2f, -0.1f, 0.3f};
+    bool ready = false;
+    for (uint16_t k = 0; k < MGN_TEST_SPIRAL * MGN_TEST_MAX_PASSES && !ready; ++k) {
+        float phi = 2 * M_PI * k / 100, dir[3] = {cosf(phi) * 0.9f, sinf(phi) * 0.9f, 0.43589f}, raw[3];
+        sensor(dir, offset, MGN_TEST_NOISE, rng, raw);
+        ready = mgnCalibAdd(fit, raw);
+    }
+    bool solved = ready && mgnCalibSolve(fit, calib);
+    printf("rotation about Z only: %s\n", solved ? "solved  FAIL" : ready ? "solve rejected" : "not ready");
+    return !solved;
+}
+
+int main() {
+    bool ok = true;
+    for (float offset : OFFSETS) { ok &= checkOffset(offset); }
+    ok &= checkPlanar();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/* Пакетная калибровка фоторезисторов БУСОС с ПК (K17-K19, K72).
+   Для минимума и максимума: выставить эталонную освещённость (команда
+   --light или оператор по Enter), отправить K17 с уровнем и эталонным
+   значением, дождаться строки PHTCAL. Итоговая строка PHTCAL выводится в
+   stdout как есть, ход калибровки - в stderr.
+   pht_batch_cal <порт> <эталон минимума> <эталон максимума> [-t мс] [--light команда] [--save]
+     --light команда - запускается как "команда 0" и "команда 1" перед уровнем
+     --save          - сохранить диапазоны в EEPROM (K72)
+   Код возврата: 0 - диапазоны посчитаны, 1 - калибровка не удалась, 2 - параметры или порт */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define PHT_BAUD          B115200
+#define PHT_RESET_DELAY   2000  // мс, Arduino перезагружается при открытии порта
+#define PHT_REPLY_TIMEOUT 2000  // мс на ответ OK
+#define PHT_LEVEL_MARGIN  3000  // мс сверх времени усреднения на строку PHTCAL
+#define PHT_BATCH_TIME    1000  // мс, как на БУСОС
+#define PHT_BATCH_TIME_MAX 10000
+
+// Состояния из PhtBatchState на БУСОС
+enum { PHT_BATCH_IDLE, PHT_BATCH_RUNNING, PHT_BATCH_LEVEL_DONE, PHT_BATCH_DONE, PHT_BATCH_FAILED };
+
+static int openPort(const char *path) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) { return -1; }
+    termios tty;
+    if (tcgetattr(fd, &tty) != 0) { close(fd); return -1; }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, PHT_BAUD);
+    cfsetospeed(&tty, PHT_BAUD);
+    tty.c_cflag |= CLOCAL | CREAD;
+    if (tcsetattr(fd, TCSANOW, &tty) != 0) { close(fd); return -1; }
+    return fd;
+}
+
+// Строка из порта без '\r' и '\n', false - нет строки за timeout мс
+static bool readLine(int fd, std::string &line, int timeout) {
+    line.clear();
+    for (;;) {
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, timeout) <= 0) { return false; }
+        char c;
+        if (read(fd, &c, 1) != 1) { return false; }
+        if (c == '\n') { return true; }
+        if (c != '\r') { line += c; }
+    }
+}
+
+static bool sendCommand(int fd, const char *command) {
+    fprintf(stderr, "> %s", command);
+    size_t length = strlen(command);
+    return write(fd, command, length) == static_cast<ssize_t>(length);
+}
+
+/* Строки до "OK" (true) или до тишины (false). Сообщения БУСОС об ошибке
+   (параметры, калибровка уже идёт) приходят вместо OK и выводятся в stderr */
+static bool waitOk(int fd) {
+    std::string line;
+    while (readLine(fd, line, PHT_REPLY_TIMEOUT)) {
+        if (line == "OK") { return true; }
+        if (line.compare(0, 6, "PHTCAL") && !(line.size() && line[0] == 'K')) { fprintf(stderr, "< %s\n", line.c_str()); }
+    }
+    fprintf(stderr, "нет ответа OK\n");
+    return false;
+}
+
+// Поля строки PHTCAL: состояние, снятые уровни, ...
+static std::vector<std::string> splitRecord(const std::string &line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (size_t i = 0; i <= line.size(); ++i) {
+        if (i == line.size() || line[i] == ';') {
+            fields.push_back(line.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    return fields;
+}
+
+// Снять уровень: строка PHTCAL с этим уровнем в record, false - ошибка
+static bool captureLevel(int fd, int level, const char *reference, int duration, std::string &record) {
+    char command[64];
+    snprintf(command, sizeof(command), "K17 %d %s %d\n", level, reference, duration);
+    if (!sendCommand(fd, command) || !waitOk(fd)) { return false; }
+    std::string line;
+    while (readLine(fd, line, duration + PHT_LEVEL_MARGIN)) {
+        if (line.compare(0, 6, "PHTCAL")) { continue; }
+        std::vector<std::string> fields = splitRecord(line);
+        if (fields.size() < 4 || !(atoi(fields[2].c_str()) & (1 << level))) { continue; }
+        record = line;
+        fprintf(stderr, "< уровень %d снят, отсчётов %s\n", level, fields[3].c_str());
+        return true;
+    }
+    fprintf(stderr, "уровень %d: нет строки PHTCAL\n", level);
+    return false;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s <port> <min reference> <max reference> [-t ms] [--light command] [--save]\n", name);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) { usage(argv[0]); return 2; }
+    const char *port = argv[1], *references[2] = {argv[2], argv[3]}, *light = nullptr;
+    int duration = PHT_BATCH_TIME;
+    bool save = false;
+    for (int i = 4; i < argc; ++i) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) { duration = atoi(argv[++i]); }
+        else if (!strcmp(argv[i], "--light") && i + 1 < argc) { light = argv[++i]; }
+        else if (!strcmp(argv[i], "--save")) { save = true; }
+        else { usage(argv[0]); return 2; }
+    }
+    char *end;
+    for (const char *reference : references) {
+        strtof(reference, &end);
+        if (end == reference || *end) { usage(argv[0]); return 2; }
+    }
+    if (duration <= 0 || duration > PHT_BATCH_TIME_MAX) { usage(argv[0]); return 2; }
+
+    int fd = openPort(port);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", port, strerror(errno));
+        return 2;
+    }
+    // Вывод БУСОС после перезагрузки пропускается
+    usleep(PHT_RESET_DELAY * 1000);
+    tcflush(fd, TCIFLUSH);
+
+    if (!sendCommand(fd, "K19\n") || !waitOk(fd)) { return 1; }
+    std::string record;
+    for (int level = 0; level < 2; ++level) {
+        if (light) {
+            std::string command = std::string(light) + ' ' + std::to_string(level);
+            if (system(command.c_str()) != 0) {
+                fprintf(stderr, "%s: ошибка\n", command.c_str());
+                return 1;
+            }
+        }
+        else {
+            fprintf(stderr, "Выставьте %s (эталон %s) и нажмите Enter\n", level ? "максимум" : "минимум", references[level]);
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF) {}
+        }
+        if (!captureLevel(fd, level, references[level], duration, record)) { return 1; }
+    }
+
+    printf("%s\n", record.c_str());
+    int state = atoi(splitRecord(record)[1].c_str());
+    if (state != PHT_BATCH_DONE) {
+        fprintf(stderr, "диапазоны не посчитаны (состояние %d)\n", state);
+        return 1;
+    }
+    if (save && (!sendCommand(fd, "K72\n") || !waitOk(fd))) { return 1; }
+    close(fd);
+    return 0;
+}
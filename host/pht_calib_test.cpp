@@ -0,0 +1,115 @@
+/* Проверка целочисленной калибровки фоторезисторов (PhtCalib.h) на ПК.
+   Случайные диапазоны (от долей единицы до предела усиления, оба знака) и
+   случайные таблицы линеаризации, весь вход 0..65535 с шагом; результат
+   PhtCalib_apply сравнивается с расчётом в double:
+   min + (max - min)·lut(x)/PHT_CALIB_FULL_SCALE.
+   Диапазоны за пределами Q8 и не конечные должны отклоняться и давать
+   единицы АЦП (0..1023), как на БУСОС, БК и приёмнике.
+   Ненулевой код возврата - ошибка больше допуска или неверный отказ */
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include "Arduino.h"
+#include "../PhtCalib.h"
+
+#define PHT_TEST_RANGES  4000
+#define PHT_TEST_STEP    13    // Шаг входа (1/64 единицы АЦП)
+#define PHT_TEST_SEED    2022
+// Допуск: по половине шага Q8 на округление смещения и произведения плюс
+// относительная ошибка усиления
+#define MAX_ERROR_Q8     1.0
+#define MAX_ERROR_REL    6e-5
+
+// Интерполяция по таблице в double
+static double lookup(const uint16_t *lut, uint16_t x) {
+    uint8_t j = x >> PHT_CALIB_LUT_SHIFT;
+    double frac = static_cast<double>(x & ((1U << PHT_CALIB_LUT_SHIFT) - 1)) / (1U << PHT_CALIB_LUT_SHIFT);
+    return lut[j] + (static_cast<double>(lut[j + 1]) - lut[j]) * frac;
+}
+
+/* Наибольшая ошибка канала по всему входу в долях допуска (>1 - вне допуска).
+   Таблица в PhtCalib_lookup усекается до целого, это добавляет до 1 единицы входа */
+static double channelError(const PhtCalib &calib, float low, float high) {
+    double worst = 0;
+    for (uint32_t x = 0; x <= 0xFFFF; x += PHT_TEST_STEP) {
+        uint16_t in[8];
+        int32_t out[8];
+        for (uint8_t i = 0; i < 8; ++i) { in[i] = x; }
+        PhtCalib_apply(calib, in, out);
+        double lx = calib.useLut ? lookup(calib.lut, x) : x;
+        double slope = (static_cast<double>(high) - low) / PHT_CALIB_FULL_SCALE;
+        double expected = (low + slope * lx) * 256;
+        double tolerance = MAX_ERROR_Q8 + MAX_ERROR_REL * fabs(slope * 256) * 0xFFFF + (calib.useLut ? fabs(slope * 256) : 0);
+        worst = max(worst, fabs(out[0] - expected) / tolerance);
+    }
+    return worst;
+}
+
+static void randomLut(PhtCalib &calib, std::mt19937 &rng) {
+    std::uniform_int_distribution<uint32_t> node(0, 0xFFFF);
+    uint16_t nodes[PHT_CALIB_LUT_SEGMENTS + 1];
+    for (uint16_t &value : nodes) { value = node(rng); }
+    std::sort(nodes, nodes + PHT_CALIB_LUT_SEGMENTS + 1);
+    memcpy(calib.lut, nodes, sizeof(nodes));
+    calib.useLut = true;
+}
+
+static bool checkRanges() {
+    std::mt19937 rng(PHT_TEST_SEED);
+    std::uniform_real_distribution<float> unit(0, 1);
+    double worst = 0, worstLut = 0;
+    uint32_t rejected = 0;
+    for (uint32_t n = 0; n < PHT_TEST_RANGES; ++n) {
+        // Размах логарифмически от 0.01 до 4·10^6, любого знака
+        float span = pow(10.0f, -2 + 8.6f * unit(rng)) * (unit(rng) < 0.5f ? -1 : 1);
+        float low = (unit(rng) - 0.5f) * 2 * pow(10.0f, 6 * unit(rng));
+        PhtCalib calib;
+        PhtCalib_resetLut(calib);
+        bool ok = true;
+        for (uint8_t i = 0; i < 8; ++i) { ok &= PhtCalib_compileChannel(calib.channel[i], low, low + span); }
+        if (!ok) { ++rejected; continue; }
+        worst = max(worst, channelError(calib, low, low + span));
+        if (n % 8 == 0) {
+            randomLut(calib, rng);
+            worstLut = max(worstLut, channelError(calib, low, low + span));
+        }
+    }
+    bool ok = worst <= 1 && worstLut <= 1;
+    printf("ranges: %u, rejected %u, worst error %.2f of tolerance, with table %.2f%s\n",
+           PHT_TEST_RANGES, rejected, worst, worstLut, ok ? "" : "  FAIL");
+    return ok;
+}
+
+// Отказ: канал в единицах АЦП, как при диапазоне 0..1023
+static bool checkRejected() {
+    const float inf = std::numeric_limits<float>::infinity(), nan = std::numeric_limits<float>::quiet_NaN();
+    const float bad[][2] = {{nan, nan}, {0, nan}, {-inf, 1}, {0, 4.2e6f}, {1e6f, -3.3e6f}, {-5e6f, 4e6f}, {7.9e6f, 8.2e6f}};
+    PhtCalibChannel raw;
+    PhtCalib_compileChannel(raw, 0, 1023);
+    bool ok = true;
+    for (const float *range : bad) {
+        PhtCalibChannel channel = {12345, 1, 7};
+        bool accepted = PhtCalib_compileChannel(channel, range[0], range[1]);
+        bool same = channel.offset == raw.offset && channel.gain == raw.gain && channel.shift == raw.shift;
+        if (accepted || !same) {
+            printf("range %g..%g: %s  FAIL\n", range[0], range[1], accepted ? "accepted" : "not raw ADC");
+            ok = false;
+        }
+    }
+    // На пределе усиления - принимается, полный вход без переполнения (санитайзер)
+    PhtCalib calib;
+    PhtCalib_resetLut(calib);
+    for (uint8_t i = 0; i < 8; ++i) { ok &= PhtCalib_compileChannel(calib.channel[i], -3.8e6f, 0.3e6f); }
+    ok &= channelError(calib, -3.8e6f, 0.3e6f) <= 1;
+    printf("rejected ranges give raw ADC, gain limit %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    ok &= checkRanges();
+    ok &= checkRejected();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/* Pulse scan of the detector (PulseScan.h) on the host, the same code as on
+   the target. pairAbove is first checked for every pair of 12-bit samples
+   against the per-sample threshold and against __SSUB16/__SEL emulated here
+   (GE flag per halfword of the signed difference, SEL picks by the flags).
+   Synthetic half-buffer traces (noise baseline, pulses of random height and
+   width, flat tops, pulses cut by the buffer edge, from quiet to dense) are
+   scanned by scanPulsesScalar and scanPulsesPacked for every bin count and
+   for odd sizes, counts and histograms are compared.
+   Time per sample is printed for both scans; it shows the effect of skipping
+   quiet pairs, not Cortex-M4 cycles (those need the DWT counter on the target).
+   Non-zero exit code - pairAbove or the scans disagree */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "../PulseScan.h"
+
+#define HALF_BUFFER     512  // ADC_BUFFER_SIZE/2 in the detector
+#define BENCH_TRACES    8    // Rates 0 to ~100 pulses per 1024 samples, as the old self-test
+#define RANDOM_TRACES   2000 // Extra traces: random rate, seed and size
+#define BENCH_ROUNDS    2000 // Timing repeats per trace
+#define BINS_LOG2_MIN   6
+#define BINS_LOG2_MAX   10
+
+typedef std::chrono::steady_clock Clock;
+
+// Cortex-M4 APSR.GE[3:0] for the emulated DSP instructions
+static uint8_t geFlags;
+
+// SSUB16: signed halfword differences, GE pair set where a difference is >= 0
+static uint32_t __SSUB16(uint32_t a, uint32_t b) {
+	int32_t low = static_cast<int16_t>(a) - static_cast<int16_t>(b);
+	int32_t high = static_cast<int16_t>(a >> 16) - static_cast<int16_t>(b >> 16);
+	geFlags = (low >= 0 ? 0x3 : 0) | (high >= 0 ? 0xC : 0);
+	return (low & 0xFFFF) | static_cast<uint32_t>(high) << 16;
+}
+// SEL: each byte from a where its GE flag is set, otherwise from b
+static uint32_t __SEL(uint32_t a, uint32_t b) {
+	uint32_t mask = 0;
+	for (uint8_t i = 0; i < 4; ++i) {
+		if (geFlags & (1 << i)) { mask |= 0xFFUL << (8 * i); }
+	}
+	return (a & mask) | (b & ~mask);
+}
+
+// pairAbove for all 12-bit pairs: non-zero exactly where a sample is above
+// threshold, the same halfwords as SSUB16 with threshold + 1 and SEL
+static bool checkPairAbove() {
+	const uint32_t bias2 = (0x8000 - (DETECTION_THRESHOLD + 1)) * 0x00010001UL;
+	const uint32_t threshold2 = (DETECTION_THRESHOLD + 1) * 0x00010001UL;
+	uint32_t mismatches = 0;
+	for (uint32_t high = 0; high <= PULSE_SCAN_SAMPLE_MAX; ++high) {
+		for (uint32_t low = 0; low <= PULSE_SCAN_SAMPLE_MAX; ++low) {
+			uint32_t pair = low | high << 16;
+			uint32_t above = pairAbove(pair, bias2);
+			__SSUB16(pair, threshold2);
+			uint32_t sel = __SEL(0xFFFFFFFF, 0) & 0x80008000UL;
+			bool reference = low > DETECTION_THRESHOLD || high > DETECTION_THRESHOLD;
+			mismatches += above != sel || (above != 0) != reference;
+		}
+	}
+	printf("pairAbove: %u pairs, mismatches with SSUB16/SEL or threshold %u\n",
+	       (PULSE_SCAN_SAMPLE_MAX + 1) * (PULSE_SCAN_SAMPLE_MAX + 1), mismatches);
+	return !mismatches;
+}
+
+static uint32_t benchRandom(uint32_t &state) {
+	state = state * 1664525UL + 1013904223UL;
+	return state >> 16;
+}
+static void benchTrace(uint16_t *buf, uint16_t size, uint32_t seed, uint16_t rate) {
+	uint32_t state = 0x5EED + seed;
+	for (uint16_t i = 0; i < size; ++i) {
+		buf[i] = 200 + benchRandom(state) % 64;
+	}
+	for (uint16_t i = 0; i < size; ++i) {
+		if (benchRandom(state) % 1024 >= rate) { continue; }
+		uint16_t peak = 400 + benchRandom(state) % 3800;
+		uint8_t rise = 1 + benchRandom(state) % 4, fall = 2 + benchRandom(state) % 12;
+		for (uint8_t j = 1; j <= rise && i < size; ++j, ++i) {
+			uint16_t value = peak * j / rise;
+			buf[i] = value > 4095 ? 4095 : (value > buf[i] ? value : buf[i]);
+		}
+		for (uint8_t j = 1; j <= fall && i < size; ++j, ++i) {
+			uint16_t value = peak - peak * j / fall;
+			buf[i] = value > 4095 ? 4095 : (value > buf[i] ? value : buf[i]);
+		}
+	}
+}
+
+// Both scans on buf for every bin count, false if counts or histograms differ
+static bool compare(const uint16_t *buf, uint16_t size) {
+	std::vector<uint32_t> scalarHist(1 << BINS_LOG2_MAX), packedHist(1 << BINS_LOG2_MAX);
+	for (uint8_t binsLog2 = BINS_LOG2_MIN; binsLog2 <= BINS_LOG2_MAX; ++binsLog2) {
+		const uint8_t shift = 12 - binsLog2;
+		std::fill(scalarHist.begin(), scalarHist.end(), 0);
+		std::fill(packedHist.begin(), packedHist.end(), 0);
+		uint32_t scalar = scanPulsesScalar(buf, size, scalarHist.data(), shift);
+		uint32_t packed = scanPulsesPacked(buf, size, packedHist.data(), shift);
+		if (scalar != packed || scalarHist != packedHist) { return false; }
+	}
+	return true;
+}
+
+// ns per sample for one scan of buf, best of BENCH_ROUNDS
+template <typename Scan>
+static double timeScan(Scan scan, const uint16_t *buf, uint16_t size, uint32_t &count) {
+	std::vector<uint32_t> hist(1 << BINS_LOG2_MAX);
+	double best = 1e12;
+	for (uint32_t round = 0; round < BENCH_ROUNDS; ++round) {
+		Clock::time_point t0 = Clock::now();
+		count = scan(buf, size, hist.data(), 12 - BINS_LOG2_MAX);
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+		if (ns < best) { best = ns; }
+	}
+	return best / size;
+}
+
+int main() {
+	alignas(4) uint16_t buf[HALF_BUFFER];
+	uint32_t mismatches = 0, compared = 0;
+	bool pairOk = checkPairAbove();
+
+	// The traces of the old on-target self-test, with timing
+	for (uint8_t trace = 0; trace < BENCH_TRACES; ++trace) {
+		uint16_t rate = trace * trace * 2;
+		benchTrace(buf, HALF_BUFFER, trace, rate);
+		bool ok = compare(buf, HALF_BUFFER);
+		mismatches += !ok; ++compared;
+
+		uint32_t scalarCount, packedCount;
+		double scalarNs = timeScan(scanPulsesScalar, buf, HALF_BUFFER, scalarCount);
+		double packedNs = timeScan(scanPulsesPacked, buf, HALF_BUFFER, packedCount);
+		printf("trace %u, rate %3u/1024: %3u pulses, scalar %.2f ns/sample, packed %.2f ns/sample%s\n",
+		       trace, rate, scalarCount, scalarNs, packedNs, ok ? "" : "  MISMATCH");
+	}
+
+	// Random traces: any rate, sizes down to 1 and odd sizes (pair loop tail)
+	uint32_t state = 2022;
+	for (uint32_t n = 0; n < RANDOM_TRACES; ++n) {
+		uint16_t size = n % 4 ? 1 + benchRandom(state) % HALF_BUFFER : HALF_BUFFER;
+		uint16_t rate = benchRandom(state) % 400;
+		benchTrace(buf, size, BENCH_TRACES + n, rate);
+		if (!compare(buf, size)) {
+			++mismatches;
+			printf("random trace %u (size %u, rate %u): MISMATCH\n", n, size, rate);
+		}
+		++compared;
+	}
+	printf("pulse scan: %u traces x %u bin counts, mismatches %u\n",
+	       compared, BINS_LOG2_MAX - BINS_LOG2_MIN + 1, mismatches);
+	return mismatches || !pairOk ? 1 : 0;
+}
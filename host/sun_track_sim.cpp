@@ -0,0 +1,95 @@
+/* Модель наведения на Солнце для подбора коэффициентов регулятора.
+   Регулятор и коэффициенты по умолчанию - из SunTrack.h, тот же код, что на БУСОС.
+   Спутник на подвесе: тяга винтов с запаздыванием, вязкое трение и упругость
+   нити, шум датчиков и задержка оценки Солнца на один период регулятора.
+   Без параметров - набор начальных углов с коэффициентами по умолчанию,
+   ненулевой код возврата - наведение с каким-то из углов не успокоилось.
+   sun_track_sim <угол (°)> [время (с)] [Kp Ki Kd] - один прогон */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "Arduino.h"
+#include "../SunTrack.h"
+
+#define SIM_INERTIA      0.02f   // кг·м²
+#define SIM_TORQUE_MAX   0.004f  // Н·м при PWM_LIMIT
+#define SIM_MOTOR_TAU    0.15f   // с, разгон винта
+#define SIM_DAMPING      0.002f  // Н·м·с
+#define SIM_TORSION      0.0005f // Н·м/рад
+#define SIM_SUN_NOISE    0.02f   // рад
+#define SIM_GYRO_NOISE   0.005f  // рад/с
+#define SIM_STEP         0.005f  // с
+#define SIM_SETTLE_BAND  (3.0f * DEG_TO_RAD)
+#define SIM_DURATION     30.0f   // с
+#define SIM_SEED         2022
+
+struct SunTrackSimResult {
+    float settleTime; // Время успокоения в полосе SIM_SETTLE_BAND (с), -1 - не успокоилось
+    float overshoot;  // Перерегулирование (рад)
+    float energy;     // Затраты (доля полной тяги·с)
+    float maxRate;    // Наибольшая скорость (рад/с)
+};
+
+/* Солнце под углом angle (рад) от нормали панели 0, время duration (с) */
+static SunTrackSimResult sunTrackSimulate(const SunTrackGains &gains, float angle, float duration, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0, 1);
+    SunTrackState state = {};
+    float theta = -angle, omega = 0, torque = 0; // Поворот спутника, Солнце в нуле
+    float output = 0, measured = angle;
+    const uint8_t substeps = static_cast<uint8_t>(lround(SUN_TRACK_PERIOD * 1e-3f / SIM_STEP));
+    const float sign = angle >= 0 ? 1 : -1;
+    SunTrackSimResult result = {0, 0, 0, 0};
+
+    for (float t = 0; t < duration; t += substeps * SIM_STEP) {
+        // Регулятор по оценке прошлого периода и гироскопу
+        output = sunTrackStep(state, gains, measured, omega + SIM_GYRO_NOISE * noise(rng), SUN_TRACK_PERIOD * 1e-3f);
+        for (uint8_t i = 0; i < substeps; ++i) {
+            torque += (output * SIM_TORQUE_MAX - torque) * (SIM_STEP / SIM_MOTOR_TAU);
+            omega += (torque - SIM_DAMPING * omega - SIM_TORSION * theta) * (SIM_STEP / SIM_INERTIA);
+            theta += omega * SIM_STEP;
+        }
+        float error = -theta;
+        measured = error + SIM_SUN_NOISE * noise(rng);
+
+        result.energy += fabs(output) * substeps * SIM_STEP;
+        result.maxRate = std::max(result.maxRate, static_cast<float>(fabs(omega)));
+        if (error * sign < 0) { result.overshoot = std::max(result.overshoot, static_cast<float>(fabs(error))); }
+        if (fabs(error) > SIM_SETTLE_BAND) { result.settleTime = t + substeps * SIM_STEP; }
+    }
+    if (result.settleTime >= duration) { result.settleTime = -1; }
+    return result;
+}
+
+static void printResult(float angle, const SunTrackSimResult &result) {
+    printf("%7.1f deg: settle %6.2f s, overshoot %5.2f deg, energy %5.2f s, max rate %6.1f deg/s%s\n",
+           angle, result.settleTime, result.overshoot * RAD_TO_DEG, result.energy,
+           result.maxRate * RAD_TO_DEG, result.settleTime < 0 ? "  NOT SETTLED" : "");
+}
+
+int main(int argc, char **argv) {
+    SunTrackGains gains = {SUN_TRACK_KP, SUN_TRACK_KI, SUN_TRACK_KD};
+    if (argc > 1) {
+        float angle = atof(argv[1]);
+        float duration = argc > 2 ? atof(argv[2]) : SIM_DURATION;
+        if (argc > 5) { gains = {static_cast<float>(atof(argv[3])), static_cast<float>(atof(argv[4])), static_cast<float>(atof(argv[5]))}; }
+        if (fabs(angle) > 180 || duration <= 0) {
+            fprintf(stderr, "usage: %s <angle deg, -180..180> [duration s] [kp ki kd]\n", argv[0]);
+            return 2;
+        }
+        printResult(angle, sunTrackSimulate(gains, angle * DEG_TO_RAD, duration, SIM_SEED));
+        return 0;
+    }
+
+    static const float ANGLES[] = {10, 45, 90, -90, 135, 180};
+    printf("Kp %.3f Ki %.3f Kd %.3f, %.0f s\n", gains.kp, gains.ki, gains.kd, SIM_DURATION);
+    bool ok = true;
+    for (float angle : ANGLES) {
+        SunTrackSimResult result = sunTrackSimulate(gains, angle * DEG_TO_RAD, SIM_DURATION, SIM_SEED);
+        printResult(angle, result);
+        ok &= result.settleTime >= 0;
+    }
+    return ok ? 0 : 1;
+}